@@ -0,0 +1,405 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "stb_image.h"
+#include "GLState.h"
+#include "UploadRing.h"
+#include "Utility/Headers/MipBuilder.h"
+#include "Utility/Headers/ThreadPool.h"
+#include "Utility/Headers/Timer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Environment maps
+// ----------------
+// Cubemaps are decoded on the worker pool, one task per face, and uploaded with a full mip chain
+// so reflections can sample blurrier levels. Besides six separate images a cubemap can be one file:
+//   "*.ktx"   KTX 1 cubemap, every level and face uploaded as stored (compressed formats too)
+//   "*.hdr"   equirectangular panorama, resampled into RGB16F faces a quarter of its width wide
+//   other     horizontal cross, 4 faces wide and 3 high:
+//                   +Y
+//               -X  +Z  +X  -Z
+//                   -Y
+// Faces are in GL order: +X, -X, +Y, -Y, +Z, -Z.
+
+struct DecodedCubemap
+{
+	std::string path;
+	int size = 0;
+	GLenum internalFormat = GL_RGB8;
+	GLenum format = GL_RGB;
+	GLenum type = GL_UNSIGNED_BYTE; // 0 for compressed levels
+	int rowAlignment = 1; // KTX pads rows to 4 bytes
+	// per face, largest level first; pixels are tightly packed, floats for HDR maps
+	std::vector<MipLevel> faces[6];
+};
+
+// 2x2 average of a tightly packed RGB float level, odd sizes round down
+inline void DownsampleFloatRGB(const MipLevel &src, MipLevel &dst)
+{
+	dst.width = std::max(src.width / 2, 1);
+	dst.height = std::max(src.height / 2, 1);
+	dst.pixels.resize((size_t)dst.width * dst.height * 3 * sizeof(float));
+	const float *in = (const float*)src.pixels.data();
+	float *out = (float*)dst.pixels.data();
+	for (int y = 0; y < dst.height; y++)
+	{
+		int y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+		for (int x = 0; x < dst.width; x++)
+		{
+			int x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+			for (int c = 0; c < 3; c++)
+				out[((size_t)y * dst.width + x) * 3 + c] = 0.25f * (in[((size_t)y0 * src.width + x0) * 3 + c] + in[((size_t)y0 * src.width + x1) * 3 + c] +
+					in[((size_t)y1 * src.width + x0) * 3 + c] + in[((size_t)y1 * src.width + x1) * 3 + c]);
+		}
+	}
+}
+
+// direction through texel (u, v) in [-1, 1] of a face, the inverse of the GL cube map face selection
+inline void CubemapDirection(int face, float u, float v, float direction[3])
+{
+	switch (face)
+	{
+	case 0: direction[0] = 1.0f; direction[1] = -v; direction[2] = -u; break;
+	case 1: direction[0] = -1.0f; direction[1] = -v; direction[2] = u; break;
+	case 2: direction[0] = u; direction[1] = 1.0f; direction[2] = v; break;
+	case 3: direction[0] = u; direction[1] = -1.0f; direction[2] = -v; break;
+	case 4: direction[0] = u; direction[1] = -v; direction[2] = 1.0f; break;
+	default: direction[0] = -u; direction[1] = -v; direction[2] = -1.0f; break;
+	}
+}
+
+// one face of an equirectangular RGB float panorama, bilinearly sampled, with its mips
+inline std::vector<MipLevel> ResampleEquirectFace(const float *panorama, int width, int height, int face, int size)
+{
+	const float PI = 3.14159265358979f;
+	std::vector<MipLevel> levels(1);
+	MipLevel &top = levels[0];
+	top.width = top.height = size;
+	top.pixels.resize((size_t)size * size * 3 * sizeof(float));
+	float *out = (float*)top.pixels.data();
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			float direction[3];
+			CubemapDirection(face, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f, direction);
+			float length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+			float u = (std::atan2(direction[2], direction[0]) / (2.0f * PI) + 0.5f) * width - 0.5f;
+			float v = std::acos(std::max(-1.0f, std::min(1.0f, direction[1] / length))) / PI * height - 0.5f;
+			int u0 = (int)std::floor(u), v0 = (int)std::floor(v);
+			float fu = u - u0, fv = v - v0;
+			// wraps around horizontally, clamps at the poles
+			int x0 = (u0 % width + width) % width, x1 = (x0 + 1) % width;
+			int y0 = std::max(v0, 0), y1 = std::min(v0 + 1, height - 1);
+			y0 = std::min(y0, height - 1);
+			for (int c = 0; c < 3; c++)
+			{
+				float top0 = panorama[((size_t)y0 * width + x0) * 3 + c] * (1.0f - fu) + panorama[((size_t)y0 * width + x1) * 3 + c] * fu;
+				float bottom = panorama[((size_t)y1 * width + x0) * 3 + c] * (1.0f - fu) + panorama[((size_t)y1 * width + x1) * 3 + c] * fu;
+				out[((size_t)y * size + x) * 3 + c] = top0 * (1.0f - fv) + bottom * fv;
+			}
+		}
+	}
+	while (levels.back().width > 1 || levels.back().height > 1)
+	{
+		MipLevel next;
+		DownsampleFloatRGB(levels.back(), next);
+		levels.push_back(std::move(next));
+	}
+	return levels;
+}
+
+inline GLenum CubemapFormat(int components)
+{
+	return components == 4 ? GL_RGBA : GL_RGB;
+}
+
+// six images, decoded and mipped in parallel; every face is promoted to the most channels any of them has
+inline bool DecodeCubemap(const std::vector<std::string> &faces, DecodedCubemap &cubemap)
+{
+	if (faces.size() != 6)
+	{
+		std::cout << "ERROR::CUBEMAP::FACE_COUNT " << faces.size() << std::endl;
+		return false;
+	}
+	cubemap.path = faces[0];
+	int components = 3;
+	for (const std::string &face : faces)
+	{
+		int width, height, faceComponents;
+		if (stbi_info(face.c_str(), &width, &height, &faceComponents) && faceComponents == 4)
+			components = 4;
+	}
+
+	std::future<std::vector<MipLevel> > jobs[6];
+	for (int i = 0; i < 6; i++)
+	{
+		std::string path = faces[i];
+		jobs[i] = ThreadPool::Shared().submit([path, components]() {
+			std::vector<MipLevel> levels;
+			int width, height, fileComponents;
+			unsigned char *data = stbi_load(path.c_str(), &width, &height, &fileComponents, components);
+			if (!data)
+				return levels;
+			BuildMipChain(data, width, height, components, MipOptions(), levels);
+			stbi_image_free(data);
+			return levels;
+		});
+	}
+	bool complete = true;
+	for (int i = 0; i < 6; i++)
+	{
+		cubemap.faces[i] = jobs[i].get();
+		if (cubemap.faces[i].empty())
+		{
+			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+			complete = false;
+		}
+	}
+	cubemap.size = cubemap.faces[0].empty() ? 0 : cubemap.faces[0][0].width;
+	cubemap.format = CubemapFormat(components);
+	cubemap.internalFormat = components == 4 ? GL_RGBA8 : GL_RGB8;
+	cubemap.type = GL_UNSIGNED_BYTE;
+	return complete;
+}
+
+// KTX 1 cubemap with one array element, the levels are taken as they are
+inline bool ReadKTXCubemap(const std::string &path, DecodedCubemap &cubemap)
+{
+	static const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+	struct KTXHeader
+	{
+		uint32_t endianness;
+		uint32_t glType;
+		uint32_t glTypeSize;
+		uint32_t glFormat;
+		uint32_t glInternalFormat;
+		uint32_t glBaseInternalFormat;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t numberOfArrayElements;
+		uint32_t numberOfFaces;
+		uint32_t numberOfMipmapLevels;
+		uint32_t bytesOfKeyValueData;
+	};
+
+	std::ifstream file(path, std::ios::binary);
+	std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	KTXHeader header;
+	if (data.size() < sizeof(KTX_IDENTIFIER) + sizeof(header) || std::memcmp(data.data(), KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0)
+		return false;
+	std::memcpy(&header, data.data() + sizeof(KTX_IDENTIFIER), sizeof(header));
+	// only files written in this machine's byte order
+	if (header.endianness != 0x04030201 || header.numberOfFaces != 6 || header.numberOfArrayElements > 1 ||
+		header.pixelWidth != header.pixelHeight || header.pixelDepth > 1 || header.pixelWidth == 0 || header.pixelWidth > 16384)
+		return false;
+	// bytes per pixel of uncompressed data; compressed levels are sized by glCompressedTexImage2D's imageSize
+	size_t pixelBytes = 0;
+	if (header.glType != 0)
+	{
+		switch (header.glFormat)
+		{
+		case GL_RED: pixelBytes = 1; break;
+		case GL_RG: pixelBytes = 2; break;
+		case GL_RGB: pixelBytes = 3; break;
+		case GL_RGBA: pixelBytes = 4; break;
+		default: return false;
+		}
+		pixelBytes *= header.glTypeSize;
+	}
+
+	size_t offset = sizeof(KTX_IDENTIFIER) + sizeof(header) + (size_t)header.bytesOfKeyValueData;
+	// a full chain ends at 1x1, anything past it is ignored
+	uint32_t maxLevels = 1;
+	while ((header.pixelWidth >> maxLevels) > 0)
+		maxLevels++;
+	uint32_t levelCount = std::min(std::max(header.numberOfMipmapLevels, 1u), maxLevels);
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		uint32_t imageSize;
+		if (offset + sizeof(imageSize) > data.size())
+			return false;
+		std::memcpy(&imageSize, data.data() + offset, sizeof(imageSize));
+		offset += sizeof(imageSize);
+		int size = std::max((int)(header.pixelWidth >> level), 1);
+		// rows are padded to 4 bytes
+		if (pixelBytes && imageSize < (((size_t)size * pixelBytes + 3) & ~(size_t)3) * size)
+			return false;
+		for (int face = 0; face < 6; face++)
+		{
+			if (offset > data.size() || imageSize > data.size() - offset)
+				return false;
+			MipLevel mip;
+			mip.width = mip.height = size;
+			mip.pixels.assign(data.begin() + offset, data.begin() + offset + imageSize);
+			cubemap.faces[face].push_back(std::move(mip));
+			offset += (imageSize + 3) & ~3u; // cube padding
+		}
+	}
+	cubemap.path = path;
+	cubemap.size = (int)header.pixelWidth;
+	cubemap.internalFormat = header.glInternalFormat;
+	cubemap.format = header.glFormat;
+	cubemap.type = header.glType;
+	cubemap.rowAlignment = 4;
+	return true;
+}
+
+// a single file cubemap, see the top of this file for the layouts
+inline bool DecodeCubemap(const std::string &path, DecodedCubemap &cubemap)
+{
+	cubemap.path = path;
+	std::string extension = path.substr(path.find_last_of('.') + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	if (extension == "ktx")
+	{
+		if (ReadKTXCubemap(path, cubemap))
+			return true;
+		std::cout << "ERROR::CUBEMAP::KTX_INVALID " << path << std::endl;
+		return false;
+	}
+
+	std::future<std::vector<MipLevel> > jobs[6];
+	if (extension == "hdr")
+	{
+		int width, height, components;
+		float *panorama = stbi_loadf(path.c_str(), &width, &height, &components, 3);
+		if (!panorama)
+		{
+			std::cout << "Cubemap texture failed to load at path: " << path << std::endl;
+			return false;
+		}
+		int size = std::max(width / 4, 1);
+		for (int i = 0; i < 6; i++)
+			jobs[i] = ThreadPool::Shared().submit([panorama, width, height, i, size]() { return ResampleEquirectFace(panorama, width, height, i, size); });
+		for (int i = 0; i < 6; i++)
+			cubemap.faces[i] = jobs[i].get();
+		stbi_image_free(panorama);
+		cubemap.size = size;
+		cubemap.internalFormat = GL_RGB16F;
+		cubemap.format = GL_RGB;
+		cubemap.type = GL_FLOAT;
+		return true;
+	}
+
+	// horizontal cross
+	int width, height, fileComponents;
+	int components = stbi_info(path.c_str(), &width, &height, &fileComponents) && fileComponents == 4 ? 4 : 3;
+	unsigned char *data = stbi_load(path.c_str(), &width, &height, &fileComponents, components);
+	if (!data || width / 4 != height / 3 || width < 4)
+	{
+		std::cout << (data ? "ERROR::CUBEMAP::LAYOUT " : "Cubemap texture failed to load at path: ") << path << std::endl;
+		stbi_image_free(data);
+		return false;
+	}
+	const int cells[6][2] = { { 2, 1 }, { 0, 1 }, { 1, 0 }, { 1, 2 }, { 1, 1 }, { 3, 1 } };
+	int size = width / 4;
+	for (int i = 0; i < 6; i++)
+	{
+		const unsigned char *corner = data + ((size_t)cells[i][1] * size * width + (size_t)cells[i][0] * size) * components;
+		jobs[i] = ThreadPool::Shared().submit([corner, width, size, components]() {
+			std::vector<unsigned char> face((size_t)size * size * components);
+			for (int y = 0; y < size; y++)
+				std::memcpy(face.data() + (size_t)y * size * components, corner + (size_t)y * width * components, (size_t)size * components);
+			std::vector<MipLevel> levels;
+			BuildMipChain(face.data(), size, size, components, MipOptions(), levels);
+			return levels;
+		});
+	}
+	for (int i = 0; i < 6; i++)
+		cubemap.faces[i] = jobs[i].get();
+	stbi_image_free(data);
+	cubemap.size = size;
+	cubemap.format = CubemapFormat(components);
+	cubemap.internalFormat = components == 4 ? GL_RGBA8 : GL_RGB8;
+	cubemap.type = GL_UNSIGNED_BYTE;
+	return true;
+}
+
+// uploads every face and level to the bound GL_TEXTURE_CUBE_MAP, staged through the upload ring when it has room
+inline void UploadCubemap(const DecodedCubemap &cubemap)
+{
+	UploadRing &ring = UploadRing::Shared();
+	size_t levelCount = cubemap.faces[0].size();
+	for (int i = 1; i < 6; i++)
+		levelCount = std::min(levelCount, cubemap.faces[i].size());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, cubemap.rowAlignment);
+	for (size_t level = 0; level < levelCount; level++)
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			const MipLevel &mip = cubemap.faces[i][level];
+			UploadRegion region;
+			bool staged = ring.Allocate(mip.pixels.size(), region);
+			if (staged)
+			{
+				std::memcpy(region.data, mip.pixels.data(), mip.pixels.size());
+				ring.Commit(region);
+				ring.Bind();
+			}
+			const void *pixels = staged ? UploadRing::Pointer(region) : mip.pixels.data();
+			if (cubemap.type == 0)
+				glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, (GLint)level, cubemap.internalFormat, mip.width, mip.height, 0, (GLsizei)mip.pixels.size(), pixels);
+			else
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, (GLint)level, cubemap.internalFormat, mip.width, mip.height, 0, cubemap.format, cubemap.type, pixels);
+			if (staged)
+				ring.Unbind();
+		}
+	}
+	ring.Fence();
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levelCount ? (GLint)levelCount - 1 : 0);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+}
+
+// six faces or, given one path, a single file; waits on the worker pool, so don't call it from a pool task
+inline bool DecodeCubemapFiles(const std::vector<std::string> &faces, DecodedCubemap &cubemap)
+{
+	return faces.size() == 1 ? DecodeCubemap(faces[0], cubemap) : DecodeCubemap(faces, cubemap);
+}
+
+// a new GL cubemap holding the decoded faces
+inline unsigned int CreateCubemap(const DecodedCubemap &cubemap)
+{
+	unsigned int textureID;
+	glGenTextures(1, &textureID);
+	GLState::Shared().BindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+	UploadCubemap(cubemap);
+	return textureID;
+}
+
+// decodes and uploads a cubemap from six faces or, given one path, a single file
+inline unsigned int LoadCubemap(const std::vector<std::string> &faces)
+{
+	Timer timer;
+	DecodedCubemap cubemap;
+	if (!DecodeCubemapFiles(faces, cubemap))
+	{
+		std::cout << "ERROR::CUBEMAP::LOAD_FAILED " << (faces.empty() ? std::string() : faces[0]) << std::endl;
+		return 0;
+	}
+	double decodeMs = timer.elapsedMs();
+
+	unsigned int textureID = CreateCubemap(cubemap);
+	std::cout << "CUBEMAP::LOAD " << cubemap.path << " " << cubemap.size << "x" << cubemap.size << " " << cubemap.faces[0].size()
+		<< " levels in " << timer.elapsedMs() << " ms (" << decodeMs << " ms decoding)" << std::endl;
+	return textureID;
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "Utility/Headers/AssetCache.h"
+#include "Utility/Headers/BlockCompression.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// DirectDraw Surface container
+// ----------------------------
+// Cooked textures are stored in the AssetCache ("<hash>.dds") as the DDS header followed by
+// the whole block compressed mip chain, largest level first. Only the formats the cooker
+// writes are read back, both with the legacy FourCC header and the DX10 one.
+
+struct DDSLevel
+{
+	int width;
+	int height;
+	size_t offset; // into DDSImage::data
+	size_t size;
+};
+
+struct DDSImage
+{
+	BlockFormat format = BlockFormat::BC1;
+	int width = 0;
+	int height = 0;
+	std::vector<DDSLevel> levels;
+	std::vector<unsigned char> data;
+};
+
+struct DDSPixelFormat
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t rgbBitCount;
+	uint32_t bitMask[4];
+};
+
+struct DDSHeader
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitchOrLinearSize;
+	uint32_t depth;
+	uint32_t mipMapCount;
+	uint32_t reserved1[11];
+	DDSPixelFormat pixelFormat;
+	uint32_t caps[4];
+	uint32_t reserved2;
+};
+
+struct DDSHeaderDX10
+{
+	uint32_t dxgiFormat;
+	uint32_t resourceDimension;
+	uint32_t miscFlag;
+	uint32_t arraySize;
+	uint32_t miscFlags2;
+};
+
+const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+const uint32_t DDPF_FOURCC = 0x4;
+const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+
+inline uint32_t DDSFourCC(const char code[4])
+{
+	return (uint32_t)(unsigned char)code[0] | ((uint32_t)(unsigned char)code[1] << 8) |
+		((uint32_t)(unsigned char)code[2] << 16) | ((uint32_t)(unsigned char)code[3] << 24);
+}
+
+// bump whenever the cooker's output changes, textures cooked before are no longer found then
+const uint32_t TEXTURE_COOK_VERSION = 1;
+
+// AssetCache entry of the image cooked as a normal map or not; empty if the image can't be read
+inline std::string CookedTextureKey(const std::string &imagePath, bool normalMap)
+{
+	return AssetCache::Shared().key(imagePath, "dds", normalMap ? 1 : 0, TEXTURE_COOK_VERSION);
+}
+
+inline bool WriteDDS(const std::string &path, const DDSImage &image)
+{
+	static const char *fourCCs[] = { "DXT1", "DXT5", "ATI1", "ATI2" };
+
+	DDSHeader header = {};
+	header.size = sizeof(DDSHeader);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = (uint32_t)image.height;
+	header.width = (uint32_t)image.width;
+	header.pitchOrLinearSize = image.levels.empty() ? 0 : (uint32_t)image.levels[0].size;
+	header.mipMapCount = (uint32_t)image.levels.size();
+	header.pixelFormat.size = sizeof(DDSPixelFormat);
+	header.pixelFormat.flags = DDPF_FOURCC;
+	header.pixelFormat.fourCC = DDSFourCC(fourCCs[(int)image.format]);
+	header.caps[0] = DDSCAPS_TEXTURE | (image.levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+	file.write((const char*)&DDS_MAGIC, sizeof(DDS_MAGIC));
+	file.write((const char*)&header, sizeof(header));
+	for (const DDSLevel &level : image.levels)
+		file.write((const char*)image.data.data() + level.offset, level.size);
+	return file.good();
+}
+
+// reads a block compressed DDS, false for anything the cooker would not have written
+inline bool ReadDDS(const std::string &path, DDSImage &image)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+	std::streamoff fileSize = file.tellg();
+	if (fileSize < (std::streamoff)(sizeof(uint32_t) + sizeof(DDSHeader)))
+		return false;
+	image.data.resize((size_t)fileSize);
+	file.seekg(0);
+	if (!file.read((char*)image.data.data(), fileSize))
+		return false;
+
+	uint32_t magic;
+	DDSHeader header;
+	std::memcpy(&magic, image.data.data(), sizeof(magic));
+	std::memcpy(&header, image.data.data() + sizeof(magic), sizeof(header));
+	if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || !(header.pixelFormat.flags & DDPF_FOURCC))
+		return false;
+
+	size_t offset = sizeof(magic) + sizeof(header);
+	uint32_t fourCC = header.pixelFormat.fourCC;
+	if (fourCC == DDSFourCC("DX10"))
+	{
+		if (image.data.size() < offset + sizeof(DDSHeaderDX10))
+			return false;
+		DDSHeaderDX10 dx10;
+		std::memcpy(&dx10, image.data.data() + offset, sizeof(dx10));
+		offset += sizeof(dx10);
+		switch (dx10.dxgiFormat)
+		{
+		case 71: case 72: image.format = BlockFormat::BC1; break; // DXGI_FORMAT_BC1_UNORM(_SRGB)
+		case 77: case 78: image.format = BlockFormat::BC3; break; // DXGI_FORMAT_BC3_UNORM(_SRGB)
+		case 80: image.format = BlockFormat::BC4; break;          // DXGI_FORMAT_BC4_UNORM
+		case 83: image.format = BlockFormat::BC5; break;          // DXGI_FORMAT_BC5_UNORM
+		default: return false;
+		}
+	}
+	else if (fourCC == DDSFourCC("DXT1"))
+		image.format = BlockFormat::BC1;
+	else if (fourCC == DDSFourCC("DXT5"))
+		image.format = BlockFormat::BC3;
+	else if (fourCC == DDSFourCC("ATI1") || fourCC == DDSFourCC("BC4U"))
+		image.format = BlockFormat::BC4;
+	else if (fourCC == DDSFourCC("ATI2") || fourCC == DDSFourCC("BC5U"))
+		image.format = BlockFormat::BC5;
+	else
+		return false;
+
+	image.width = (int)header.width;
+	image.height = (int)header.height;
+	uint32_t levelCount = (header.flags & DDSD_MIPMAPCOUNT) && header.mipMapCount ? header.mipMapCount : 1;
+	image.levels.clear();
+	int width = image.width, height = image.height;
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		DDSLevel level = { width, height, offset, CompressedSize(image.format, width, height) };
+		if (level.offset + level.size > image.data.size())
+			return false;
+		image.levels.push_back(level);
+		offset += level.size;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	return image.width > 0 && image.height > 0;
+}
@@ -0,0 +1,403 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// GL state cache
+// --------------
+// Shadows the state the renderer sets (program, vertex array, texture units, framebuffers, viewport,
+// buffer bindings and the blend/depth/raster/stencil blocks) and drops every call that would set what
+// is already set. Anything that changes this state has to go through here or the shadow goes stale;
+// ImGui's renderer is the exception, it puts back everything it touched. Objects are deleted through
+// the Delete* calls, GL unbinds deleted names and may hand the same name out again.
+// State starts out unknown, so the first call for each piece of state is always issued.
+// Fixed function state is set as whole blocks that are compared field by field with the block
+// applied before, e.g. Apply(sceneDepth) then Apply(skyboxDepth) only changes the depth func.
+// All calls must be made from the GL context thread.
+
+// defaults are GL's initial state
+struct BlendState
+{
+	bool enabled = false;
+	GLenum source = GL_ONE;
+	GLenum destination = GL_ZERO;
+};
+
+struct DepthState
+{
+	bool test = false;
+	bool write = true;
+	GLenum func = GL_LESS;
+};
+
+struct RasterState
+{
+	bool cull = false;
+	GLenum cullFace = GL_BACK;
+	GLenum frontFace = GL_CCW;
+};
+
+struct StencilState
+{
+	bool test = false;
+	GLenum func = GL_ALWAYS;
+	GLint reference = 0;
+	GLuint readMask = 0xFF;
+	GLuint writeMask = 0xFF;
+	GLenum stencilFail = GL_KEEP;
+	GLenum depthFail = GL_KEEP;
+	GLenum depthPass = GL_KEEP;
+};
+
+// GL calls made and dropped since the last ResetStats
+struct GLStateStats
+{
+	size_t issued = 0;
+	size_t elided = 0;
+};
+
+class GLState
+{
+public:
+	static const unsigned int MAX_TEXTURE_UNITS = 16;
+
+	static GLState &Shared()
+	{
+		static GLState state;
+		return state;
+	}
+
+	void UseProgram(GLuint program)
+	{
+		if (set(currentProgram, program))
+			glUseProgram(program);
+	}
+
+	// the element array binding belongs to the vertex array, it is unknown again after a switch
+	void BindVertexArray(GLuint vertexArray)
+	{
+		if (!set(currentVertexArray, vertexArray))
+			return;
+		glBindVertexArray(vertexArray);
+		buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+	}
+
+	// unit as GL_TEXTURE0 + i
+	void ActiveTexture(GLenum unit)
+	{
+		if (set(activeUnit, unit))
+			glActiveTexture(unit);
+	}
+
+	// on the active unit, e.g. to upload to the texture; unit 0 is made active if the active unit isn't known
+	void BindTexture(GLenum target, GLuint texture)
+	{
+		if (activeUnit == UNKNOWN)
+			ActiveTexture(GL_TEXTURE0);
+		GLuint *bound = textureSlot(activeUnit, target);
+		if (!bound)
+		{
+			glBindTexture(target, texture);
+			stats.issued++;
+		}
+		else if (set(*bound, texture))
+			glBindTexture(target, texture);
+	}
+
+	// on unit GL_TEXTURE0 + unit, which is only made active if the binding changes
+	void BindTexture(unsigned int unit, GLenum target, GLuint texture)
+	{
+		GLuint *bound = textureSlot(GL_TEXTURE0 + unit, target);
+		if (bound && *bound == texture)
+		{
+			stats.elided++;
+			return;
+		}
+		ActiveTexture(GL_TEXTURE0 + unit);
+		BindTexture(target, texture);
+	}
+
+	// GL_FRAMEBUFFER binds both the read and the draw framebuffer
+	void BindFramebuffer(GLenum target, GLuint framebuffer)
+	{
+		if (target == GL_FRAMEBUFFER)
+		{
+			if (readFramebuffer == framebuffer && drawFramebuffer == framebuffer)
+			{
+				stats.elided++;
+				return;
+			}
+			readFramebuffer = drawFramebuffer = framebuffer;
+			stats.issued++;
+			glBindFramebuffer(target, framebuffer);
+		}
+		else if (set(target == GL_READ_FRAMEBUFFER ? readFramebuffer : drawFramebuffer, framebuffer))
+			glBindFramebuffer(target, framebuffer);
+	}
+
+	void Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+	{
+		if (viewportKnown && viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height)
+		{
+			stats.elided++;
+			return;
+		}
+		viewportKnown = true;
+		viewport[0] = x;
+		viewport[1] = y;
+		viewport[2] = width;
+		viewport[3] = height;
+		stats.issued++;
+		glViewport(x, y, width, height);
+	}
+
+	void BindBuffer(GLenum target, GLuint buffer)
+	{
+		int slot = bufferSlot(target);
+		if (slot < 0)
+		{
+			glBindBuffer(target, buffer);
+			stats.issued++;
+		}
+		else if (set(buffers[slot], buffer))
+			glBindBuffer(target, buffer);
+	}
+
+	// binds an indexed range, which also makes buffer the target's generic binding
+	void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+	{
+		glBindBufferRange(target, index, buffer, offset, size);
+		stats.issued++;
+		int slot = bufferSlot(target);
+		if (slot >= 0)
+			buffers[slot] = buffer;
+	}
+
+	void Apply(const BlendState &state)
+	{
+		enable(GL_BLEND, blendKnown ? &blend.enabled : nullptr, state.enabled);
+		if (blendKnown && blend.source == state.source && blend.destination == state.destination)
+			stats.elided++;
+		else
+		{
+			glBlendFunc(state.source, state.destination);
+			stats.issued++;
+		}
+		blend = state;
+		blendKnown = true;
+	}
+
+	void Apply(const DepthState &state)
+	{
+		enable(GL_DEPTH_TEST, depthKnown ? &depth.test : nullptr, state.test);
+		if (depthKnown && depth.write == state.write)
+			stats.elided++;
+		else
+		{
+			glDepthMask(state.write ? GL_TRUE : GL_FALSE);
+			stats.issued++;
+		}
+		if (depthKnown && depth.func == state.func)
+			stats.elided++;
+		else
+		{
+			glDepthFunc(state.func);
+			stats.issued++;
+		}
+		depth = state;
+		depthKnown = true;
+	}
+
+	void Apply(const RasterState &state)
+	{
+		enable(GL_CULL_FACE, rasterKnown ? &raster.cull : nullptr, state.cull);
+		if (rasterKnown && raster.cullFace == state.cullFace)
+			stats.elided++;
+		else
+		{
+			glCullFace(state.cullFace);
+			stats.issued++;
+		}
+		if (rasterKnown && raster.frontFace == state.frontFace)
+			stats.elided++;
+		else
+		{
+			glFrontFace(state.frontFace);
+			stats.issued++;
+		}
+		raster = state;
+		rasterKnown = true;
+	}
+
+	void Apply(const StencilState &state)
+	{
+		enable(GL_STENCIL_TEST, stencilKnown ? &stencil.test : nullptr, state.test);
+		if (stencilKnown && stencil.func == state.func && stencil.reference == state.reference && stencil.readMask == state.readMask)
+			stats.elided++;
+		else
+		{
+			glStencilFunc(state.func, state.reference, state.readMask);
+			stats.issued++;
+		}
+		if (stencilKnown && stencil.writeMask == state.writeMask)
+			stats.elided++;
+		else
+		{
+			glStencilMask(state.writeMask);
+			stats.issued++;
+		}
+		if (stencilKnown && stencil.stencilFail == state.stencilFail && stencil.depthFail == state.depthFail && stencil.depthPass == state.depthPass)
+			stats.elided++;
+		else
+		{
+			glStencilOp(state.stencilFail, state.depthFail, state.depthPass);
+			stats.issued++;
+		}
+		stencil = state;
+		stencilKnown = true;
+	}
+
+	// deleting a bound object unbinds it, the shadow has to follow
+	void DeleteTexture(GLuint texture)
+	{
+		glDeleteTextures(1, &texture);
+		for (GLuint &bound : textures)
+			if (bound == texture)
+				bound = 0;
+	}
+
+	void DeleteBuffer(GLuint buffer)
+	{
+		glDeleteBuffers(1, &buffer);
+		for (GLuint &bound : buffers)
+			if (bound == buffer)
+				bound = 0;
+	}
+
+	void DeleteVertexArray(GLuint vertexArray)
+	{
+		glDeleteVertexArrays(1, &vertexArray);
+		if (currentVertexArray == vertexArray)
+		{
+			currentVertexArray = 0;
+			buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+		}
+	}
+
+	void DeleteFramebuffer(GLuint framebuffer)
+	{
+		glDeleteFramebuffers(1, &framebuffer);
+		if (readFramebuffer == framebuffer)
+			readFramebuffer = 0;
+		if (drawFramebuffer == framebuffer)
+			drawFramebuffer = 0;
+	}
+
+	// forgets everything, for code that changed state without going through here
+	void Invalidate()
+	{
+		currentProgram = currentVertexArray = activeUnit = UNKNOWN;
+		readFramebuffer = drawFramebuffer = UNKNOWN;
+		for (GLuint &bound : textures)
+			bound = UNKNOWN;
+		for (GLuint &bound : buffers)
+			bound = UNKNOWN;
+		viewportKnown = blendKnown = depthKnown = rasterKnown = stencilKnown = false;
+	}
+
+	const GLStateStats &Stats() const { return stats; }
+	void ResetStats() { stats = GLStateStats(); }
+
+private:
+	static const GLuint UNKNOWN = 0xFFFFFFFFu;
+	static const unsigned int TEXTURE_TARGETS = 4;
+	static const unsigned int BUFFER_TARGETS = 8;
+
+	GLuint currentProgram = UNKNOWN;
+	GLuint currentVertexArray = UNKNOWN;
+	GLenum activeUnit = UNKNOWN;
+	GLuint readFramebuffer = UNKNOWN;
+	GLuint drawFramebuffer = UNKNOWN;
+	GLuint textures[MAX_TEXTURE_UNITS * TEXTURE_TARGETS];
+	GLuint buffers[BUFFER_TARGETS];
+	GLint viewport[4] = { 0, 0, 0, 0 };
+	bool viewportKnown = false;
+	BlendState blend;
+	DepthState depth;
+	RasterState raster;
+	StencilState stencil;
+	bool blendKnown = false;
+	bool depthKnown = false;
+	bool rasterKnown = false;
+	bool stencilKnown = false;
+	GLStateStats stats;
+
+	GLState()
+	{
+		Invalidate();
+	}
+
+	// true (and counted as issued) if value changes, the caller then makes the GL call
+	bool set(GLuint &current, GLuint value)
+	{
+		if (current == value)
+		{
+			stats.elided++;
+			return false;
+		}
+		current = value;
+		stats.issued++;
+		return true;
+	}
+
+	// current is null while the capability's state is unknown
+	void enable(GLenum capability, const bool *current, bool enabled)
+	{
+		if (current && *current == enabled)
+		{
+			stats.elided++;
+			return;
+		}
+		if (enabled)
+			glEnable(capability);
+		else
+			glDisable(capability);
+		stats.issued++;
+	}
+
+	// nullptr for units and targets that aren't shadowed, binds to those are always issued
+	GLuint *textureSlot(GLenum unit, GLenum target)
+	{
+		if (unit < GL_TEXTURE0 || unit >= GL_TEXTURE0 + MAX_TEXTURE_UNITS)
+			return nullptr;
+		unsigned int index;
+		switch (target)
+		{
+		case GL_TEXTURE_2D: index = 0; break;
+		case GL_TEXTURE_CUBE_MAP: index = 1; break;
+		case GL_TEXTURE_2D_MULTISAMPLE: index = 2; break;
+		case GL_TEXTURE_BUFFER: index = 3; break;
+		default: return nullptr;
+		}
+		return &textures[(unit - GL_TEXTURE0) * TEXTURE_TARGETS + index];
+	}
+
+	static int bufferSlot(GLenum target)
+	{
+		switch (target)
+		{
+		case GL_ARRAY_BUFFER: return 0;
+		case GL_ELEMENT_ARRAY_BUFFER: return 1;
+		case GL_UNIFORM_BUFFER: return 2;
+		case GL_COPY_READ_BUFFER: return 3;
+		case GL_COPY_WRITE_BUFFER: return 4;
+		case GL_PIXEL_UNPACK_BUFFER: return 5;
+#if defined(GL_VERSION_4_3)
+		case GL_DRAW_INDIRECT_BUFFER: return 6;
+#endif
+		case GL_TEXTURE_BUFFER: return 7;
+		default: return -1;
+		}
+	}
+};
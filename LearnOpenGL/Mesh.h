@@ -6,11 +6,17 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Shader.h"
+#include "GLState.h"
+#include "Utility/Headers/MeshletBuilder.h"
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <utility>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 
 struct Vertex 
 {
@@ -20,6 +26,71 @@ struct Vertex
 	glm::vec3 Tangent;
 };
 
+// compact alternative to Vertex, 20 instead of 44 bytes, filled by PackVertices:
+// positions and texture coordinates are 16 bit fixed point within the mesh's bounds, which the
+// vertex shader scales back with the posScale/posOffset and uvScale/uvOffset uniforms, normals
+// and tangents are octahedral encoded unit vectors
+struct PackedVertex
+{
+	uint16_t Position[4]; // w is padding
+	int16_t Normal[2];
+	int16_t Tangent[2];
+	uint16_t TexCoords[2];
+};
+
+// maps a unit vector onto the octahedron, unfolded into [-1,1]^2; must match octDecode in vertex.vert
+inline void OctEncode(const glm::vec3 &v, int16_t out[2])
+{
+	float length = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+	float x = length > 0.0f ? v.x / length : 0.0f;
+	float y = length > 0.0f ? v.y / length : 0.0f;
+	if (v.z < 0.0f)
+	{
+		float folded = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		y = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = folded;
+	}
+	out[0] = (int16_t)std::lround(std::min(std::max(x, -1.0f), 1.0f) * 32767.0f);
+	out[1] = (int16_t)std::lround(std::min(std::max(y, -1.0f), 1.0f) * 32767.0f);
+}
+
+inline uint16_t QuantizeUnorm16(float value, float minimum, float extent)
+{
+	if (extent <= 0.0f)
+		return 0;
+	float t = std::min(std::max((value - minimum) / extent, 0.0f), 1.0f);
+	return (uint16_t)std::lround(t * 65535.0f);
+}
+
+// quantizes vertices within boundsMin/boundsMax (which must contain every position) and returns the
+// texture coordinate range they were quantized against
+inline void PackVertices(const std::vector<Vertex> &vertices, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax,
+	std::vector<PackedVertex> &packed, glm::vec2 &texCoordMin, glm::vec2 &texCoordMax)
+{
+	texCoordMin = texCoordMax = vertices.empty() ? glm::vec2(0.0f) : vertices[0].TexCoords;
+	for (const Vertex &vertex : vertices)
+	{
+		texCoordMin = glm::min(texCoordMin, vertex.TexCoords);
+		texCoordMax = glm::max(texCoordMax, vertex.TexCoords);
+	}
+	glm::vec3 extent = boundsMax - boundsMin;
+	glm::vec2 texCoordExtent = texCoordMax - texCoordMin;
+
+	packed.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		const Vertex &vertex = vertices[i];
+		PackedVertex &out = packed[i];
+		for (int axis = 0; axis < 3; axis++)
+			out.Position[axis] = QuantizeUnorm16(vertex.Position[axis], boundsMin[axis], extent[axis]);
+		out.Position[3] = 0;
+		OctEncode(vertex.Normal, out.Normal);
+		OctEncode(vertex.Tangent, out.Tangent);
+		out.TexCoords[0] = QuantizeUnorm16(vertex.TexCoords.x, texCoordMin.x, texCoordExtent.x);
+		out.TexCoords[1] = QuantizeUnorm16(vertex.TexCoords.y, texCoordMin.y, texCoordExtent.y);
+	}
+}
+
 struct Texture 
 {
 	unsigned int id;
@@ -27,6 +98,108 @@ struct Texture
 	std::string path;
 };
 
+// texture unit of each material texture type, the same for every mesh so the program's samplers are
+// pointed at them once instead of per draw; main binds the parallax depth map to 4 and the shadow cube map to 5
+struct MaterialSampler
+{
+	const char *type;
+	const char *uniform;
+	unsigned int unit;
+};
+
+const MaterialSampler MATERIAL_SAMPLERS[] = {
+	{ "texture_diffuse", "material.texture_diffuse", 0 },
+	{ "texture_specular", "material.texture_specular", 1 },
+	{ "texture_reflection", "material.texture_reflection", 2 },
+	{ "texture_normal", "material.texture_normal", 3 },
+};
+
+// one texture of a mesh's material on its unit, resolved from the texture's type when the mesh is made
+struct TextureBinding
+{
+	unsigned int unit;
+	unsigned int id;
+};
+
+// Model's multi-draw indirect path: the texture buffer of per-mesh draw records is bound to this unit, and
+// each draw's record index reaches the vertex shader through an instanced attribute at this location
+const unsigned int DRAW_RECORD_UNIT = 6;
+const unsigned int DRAW_RECORD_ATTRIBUTE = 4;
+
+// what glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER for each draw
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// locations of the uniforms Mesh sets per draw, looked up once per program
+struct MeshUniforms
+{
+	unsigned int program = 0;
+	GLint quantized = -1;
+	GLint posScale = -1;
+	GLint posOffset = -1;
+	GLint uvScale = -1;
+	GLint uvOffset = -1;
+	GLint indirect = -1; // set while the quantization comes from the draw records instead
+
+	// also points the program's material samplers at MATERIAL_SAMPLERS' units, so shader must be in use
+	static MeshUniforms Resolve(const Shader &shader)
+	{
+		MeshUniforms uniforms;
+		uniforms.program = shader.ID;
+		uniforms.quantized = shader.location("quantized");
+		uniforms.posScale = shader.location("posScale");
+		uniforms.posOffset = shader.location("posOffset");
+		uniforms.uvScale = shader.location("uvScale");
+		uniforms.uvOffset = shader.location("uvOffset");
+		uniforms.indirect = shader.location("indirect");
+		for (const MaterialSampler &sampler : MATERIAL_SAMPLERS)
+			glUniform1i(shader.location(sampler.uniform), (GLint)sampler.unit);
+		glUniform1i(shader.location("drawRecords"), (GLint)DRAW_RECORD_UNIT);
+		return uniforms;
+	}
+};
+
+// material texture reference as found during import, resolved to a Texture on the GL thread
+struct TextureRef
+{
+	std::string type;
+	std::string path;
+};
+
+// index range of one level of detail; every level of a mesh indexes the same vertices, level 0 is the full mesh
+struct MeshLod
+{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	float error; // surface deviation from level 0, relative to the bounding box diagonal
+};
+
+const unsigned int MESH_MAX_LODS = 4;
+
+// CPU side result of importing one mesh, can be produced on any thread
+struct MeshData
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<TextureRef> textures;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	// replaces vertices when the model is quantized, see PackVertices
+	std::vector<PackedVertex> packedVertices;
+	glm::vec2 texCoordMin;
+	glm::vec2 texCoordMax;
+	// levels of detail stored one after another in indices, empty when indices is just the mesh
+	std::vector<MeshLod> lods;
+	// clusters of level 0, see MeshletBuilder.h
+	std::vector<Meshlet> meshlets;
+};
+
 class Mesh
 {
 public:
@@ -34,70 +207,150 @@ public:
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
 	std::vector<Texture> textures;
+	// what bindMaterial binds, one per unit of MATERIAL_SAMPLERS that this mesh has a texture for
+	std::vector<TextureBinding> bindings;
+	unsigned int indexCount; // of every level together
+	unsigned int vertexCount;
+	// at least level 0, coarser levels follow in the same index buffer
+	std::vector<MeshLod> lods;
+	// level 0 split into separately cullable ranges, empty unless the model was built with meshlets
+	std::vector<Meshlet> meshlets;
+	// GL_UNSIGNED_SHORT whenever every index fits, GL_UNSIGNED_INT otherwise
+	unsigned int indexType = GL_UNSIGNED_INT;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	// PackedVertex layout, decoded in the vertex shader
+	bool quantized = false;
+	glm::vec3 posScale = glm::vec3(1.0f);
+	glm::vec3 posOffset = glm::vec3(0.0f);
+	glm::vec2 uvScale = glm::vec2(1.0f);
+	glm::vec2 uvOffset = glm::vec2(0.0f);
 
 	/*  Functions  */
 	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
+		: vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures))
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
-
-		setupMesh();
+		setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
 	}
-	void Draw(Shader shader)
+	// uploads straight from external memory (e.g. a mapped mesh cache) without keeping a CPU copy,
+	// vertices and indices stay empty for these meshes
+	Mesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount, std::vector<Texture> textures)
+		: textures(std::move(textures))
 	{
-		unsigned int diffuseNr = 1;
-		unsigned int specularNr = 1;
-		unsigned int reflectionNr = 1;
-		unsigned int normalNr = 1;
-
-		for (unsigned int i = 0; i < textures.size(); i++)
-		{
-			glActiveTexture(GL_TEXTURE0 + i); // activate proper texture unit before binding
-			// retrieve texture number (the N in diffuse_textureN)
-			std::string number;
-			std::string name = textures[i].type;
-		
-			if (name == "texture_diffuse")
-				number = std::to_string(diffuseNr++);
-			else if (name == "texture_specular")
-				number = std::to_string(specularNr++);
-			else if (name == "texture_reflection")
-				number = std::to_string(reflectionNr++);
-			else if (name == "texture_normal")
-				number = std::to_string(normalNr++);
-				
-			glBindTexture(GL_TEXTURE_2D, textures[i].id);
-			shader.setInt(("material." + name).c_str(), i);
-		}
-		glActiveTexture(GL_TEXTURE0);
+		setupMesh(vertexData, vertexCount, indexData, indexCount);
+	}
+	// quantized vertices as produced by PackVertices against these bounds, no CPU copy is kept either
+	Mesh(const PackedVertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount, std::vector<Texture> textures,
+		const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, const glm::vec2 &texCoordMin, const glm::vec2 &texCoordMax)
+		: textures(std::move(textures)), boundsMin(boundsMin), boundsMax(boundsMax), quantized(true),
+		posScale(boundsMax - boundsMin), posOffset(boundsMin), uvScale(texCoordMax - texCoordMin), uvOffset(texCoordMin)
+	{
+		setupMesh(vertexData, vertexCount, indexData, indexCount);
+	}
+	// shader must be in use; resolves its uniforms on every call, Model keeps them per program instead
+	void Draw(const Shader &shader)
+	{
+		Draw(MeshUniforms::Resolve(shader), lods[0].firstIndex, lods[0].indexCount);
+	}
+	// draws count indices starting at firstIndex with this mesh's textures, uniforms of the program in use;
+	// the vertex array stays bound, GLState skips binding it again for the next draw from it
+	void Draw(const MeshUniforms &uniforms, unsigned int firstIndex, unsigned int count)
+	{
+		GLState::Shared().BindVertexArray(VAO);
+		DrawBound(uniforms, firstIndex, count);
+	}
+	// same, but expects GetVOA() to be bound already so meshes sharing a vertex array (see MoveIntoBuffers)
+	// can be drawn back to back without rebinding it
+	void DrawBound(const MeshUniforms &uniforms, unsigned int firstIndex, unsigned int count)
+	{
+		bindMaterial(uniforms);
+		glDrawElementsBaseVertex(GL_TRIANGLES, count, indexType, (void*)(indexOffset + firstIndex * IndexSize()), baseVertex);
+		releaseMaterial(uniforms);
+	}
+	// several index ranges in one multi-draw, e.g. the meshlets that survived culling; GetVOA() must be bound
+	void DrawBoundRanges(const MeshUniforms &uniforms, const unsigned int *firstIndices, const GLsizei *counts, GLsizei rangeCount)
+	{
+		if (rangeCount <= 0)
+			return;
+		rangeOffsets.resize(rangeCount);
+		rangeBaseVertices.assign(rangeCount, baseVertex);
+		for (GLsizei i = 0; i < rangeCount; i++)
+			rangeOffsets[i] = (const void*)(indexOffset + firstIndices[i] * IndexSize());
+		bindMaterial(uniforms);
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, indexType, rangeOffsets.data(), rangeCount, rangeBaseVertices.data());
+		releaseMaterial(uniforms);
+	}
 
-		// draw mesh
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+	// the range DrawBound(uniforms, firstIndex, count) would draw as a command for the buffer GetVOA() draws from;
+	// baseInstance selects drawRecord for the vertex shader, see DRAW_RECORD_ATTRIBUTE
+	DrawElementsIndirectCommand IndirectCommand(unsigned int firstIndex, unsigned int count, unsigned int drawRecord) const
+	{
+		return { count, 1, (GLuint)(indexOffset / IndexSize()) + firstIndex, baseVertex, drawRecord };
 	}
 
-private:
+	// binds the material's textures to their units
+	void BindTextures() const
+	{
+		for (const TextureBinding &binding : bindings)
+			GLState::Shared().BindTexture(binding.unit, GL_TEXTURE_2D, binding.id);
+	}
 
-	/*  Render data  */
-	unsigned int VAO, VBO, EBO;
+	// true if both meshes bind the same textures to the same units
+	bool SameMaterial(const Mesh &other) const
+	{
+		return materialKey == other.materialKey && bindings.size() == other.bindings.size()
+			&& std::equal(bindings.begin(), bindings.end(), other.bindings.begin(),
+				[](const TextureBinding &a, const TextureBinding &b) { return a.unit == b.unit && a.id == b.id; });
+	}
 
-	/*  Functions    */
-	void setupMesh()
+	// frees the GL buffers, the mesh must not be drawn afterwards; shared buffers belong to whoever made them
+	void Delete()
 	{
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO);
-		glGenBuffers(1, &EBO);
+		if (ownsBuffers)
+		{
+			GLState::Shared().DeleteVertexArray(VAO);
+			GLState::Shared().DeleteBuffer(VBO);
+			GLState::Shared().DeleteBuffer(EBO);
+		}
+		VAO = VBO = EBO = 0;
+	}
 
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	size_t VertexStride() const
+	{
+		return quantized ? sizeof(PackedVertex) : sizeof(Vertex);
+	}
 
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+	// equal for meshes binding the same textures to the same units, for RenderQueue's material bits
+	uint32_t MaterialKey() const
+	{
+		return materialKey;
+	}
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+	size_t IndexSize() const
+	{
+		return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+	}
 
+	// binds the attributes of the Vertex or PackedVertex layout to the buffer bound to GL_ARRAY_BUFFER
+	static void SetupVertexLayout(bool packed)
+	{
+		if (packed)
+		{
+			// normalized integers arrive in the shader as [0,1] / [-1,1] floats
+			// vertex positions
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+			// vertex normals, 2 components: .z stays 0 and the shader unfolds the octahedron
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+			// vertex texture coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+			// vertex tangent
+			glEnableVertexAttribArray(3);
+			glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+			return;
+		}
 		// vertex positions
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -110,13 +363,141 @@ private:
 		// vertex tangent
 		glEnableVertexAttribArray(3);
 		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+	}
+
+	// copies the vertices and indices on the GPU into another vertex array's buffers at the given byte offsets
+	// (vertexOffset a multiple of VertexStride(), indexOffset of IndexSize()), frees this mesh's own buffers and draws
+	// from there with a base vertex afterwards; the buffers need room for VertexStride() * vertexCount and
+	// IndexSize() * indexCount bytes
+	void MoveIntoBuffers(unsigned int sharedVAO, unsigned int sharedVBO, size_t vertexOffset, unsigned int sharedEBO, size_t indexOffset)
+	{
+		// the copy targets leave the element array binding of whatever vertex array is bound alone
+		GLState &state = GLState::Shared();
+		state.BindBuffer(GL_COPY_READ_BUFFER, VBO);
+		state.BindBuffer(GL_COPY_WRITE_BUFFER, sharedVBO);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, vertexOffset, vertexCount * VertexStride());
+		state.BindBuffer(GL_COPY_READ_BUFFER, EBO);
+		state.BindBuffer(GL_COPY_WRITE_BUFFER, sharedEBO);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, this->indexOffset, indexOffset, indexCount * IndexSize());
+		state.BindBuffer(GL_COPY_READ_BUFFER, 0);
+		state.BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		Delete();
+		VAO = sharedVAO;
+		VBO = sharedVBO;
+		EBO = sharedEBO;
+		ownsBuffers = false;
+		baseVertex = (int)(vertexOffset / VertexStride());
+		this->indexOffset = indexOffset;
+	}
+
+private:
+
+	/*  Render data  */
+	unsigned int VAO, VBO, EBO;
+	// false once the geometry lives in buffers shared with other meshes, see MoveIntoBuffers
+	bool ownsBuffers = true;
+	int baseVertex = 0;
+	size_t indexOffset = 0; // bytes into EBO
+	uint32_t materialKey = 0;
+	// scratch for DrawBoundRanges
+	std::vector<const void*> rangeOffsets;
+	std::vector<GLint> rangeBaseVertices;
+
+	/*  Functions    */
+	// textures and the quantization uniforms of this mesh
+	void bindMaterial(const MeshUniforms &uniforms)
+	{
+		BindTextures();
+
+		if (quantized)
+		{
+			glUniform1i(uniforms.quantized, 1);
+			glUniform3fv(uniforms.posScale, 1, &posScale[0]);
+			glUniform3fv(uniforms.posOffset, 1, &posOffset[0]);
+			glUniform2fv(uniforms.uvScale, 1, &uvScale[0]);
+			glUniform2fv(uniforms.uvOffset, 1, &uvOffset[0]);
+		}
+	}
+
+	// the shader only applies the dequantization while quantized is set, so it is cleared again
+	// for whatever the program draws next
+	void releaseMaterial(const MeshUniforms &uniforms)
+	{
+		if (quantized)
+			glUniform1i(uniforms.quantized, 0);
+	}
+
+	// the shader has one sampler per type, a second texture of a type replaces the first as it did
+	// when each draw pointed the sampler at the last one
+	void resolveBindings()
+	{
+		bindings.clear();
+		for (const Texture &texture : textures)
+		{
+			for (const MaterialSampler &sampler : MATERIAL_SAMPLERS)
+			{
+				if (texture.type != sampler.type)
+					continue;
+				TextureBinding binding = { sampler.unit, texture.id };
+				auto bound = std::find_if(bindings.begin(), bindings.end(), [&](const TextureBinding &b) { return b.unit == binding.unit; });
+				if (bound != bindings.end())
+					*bound = binding;
+				else
+					bindings.push_back(binding);
+			}
+		}
+		// FNV-1a over the bindings, in MATERIAL_SAMPLERS' unit order so the texture order doesn't matter
+		std::sort(bindings.begin(), bindings.end(), [](const TextureBinding &a, const TextureBinding &b) { return a.unit < b.unit; });
+		materialKey = 2166136261u;
+		for (const TextureBinding &binding : bindings)
+		{
+			materialKey = (materialKey ^ binding.unit) * 16777619u;
+			materialKey = (materialKey ^ binding.id) * 16777619u;
+		}
+	}
+
+	// vertexData holds Vertex or, for quantized meshes, PackedVertex
+	void setupMesh(const void *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount)
+	{
+		this->indexCount = (unsigned int)indexCount;
+		this->vertexCount = (unsigned int)vertexCount;
+		lods.assign(1, { 0, (unsigned int)indexCount, 0.0f });
+		resolveBindings();
+
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+
+		GLState &state = GLState::Shared();
+		state.BindVertexArray(VAO);
+		state.BindBuffer(GL_ARRAY_BUFFER, VBO);
+
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * VertexStride(), vertexData, GL_STATIC_DRAW);
+
+		// indices are relative to the mesh's own vertices (merged buffers add a base vertex), so any mesh
+		// with at most 65536 vertices can use half the index memory and fetch bandwidth
+		state.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		if (vertexCount <= 65536)
+		{
+			std::vector<uint16_t> shortIndices(indexData, indexData + indexCount);
+			indexType = GL_UNSIGNED_SHORT;
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+		}
+		else
+		{
+			indexType = GL_UNSIGNED_INT;
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+		}
+
+		SetupVertexLayout(quantized);
 
-		glBindVertexArray(0);
+		state.BindVertexArray(0);
 	}
 
 public :
 
-	int GetVOA()
+	int GetVOA() const
 	{
 		return VAO;
 	}
@@ -0,0 +1,447 @@
+#pragma once
+
+#include "Mesh.h"
+#include "Utility/Headers/AssetCache.h"
+#include "Utility/Headers/MappedFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// Binary mesh cache
+// -----------------
+// Written to the AssetCache ("<hash>.mesh") after the first import so later launches can skip
+// the importer entirely. Everything is stored the way Model/Mesh use it,
+// so the file can be memory mapped and the streams handed straight to glBufferData:
+//
+//   MeshCacheHeader
+//   MeshCacheMesh     [meshCount]
+//   MeshCacheTexture  [textureCount]
+//   MeshCacheDependency [dependencyCount]
+//   char              [stringBytes]   zero terminated texture types and paths, dependency paths
+//   Vertex            [vertexCount]   16 byte aligned, PackedVertex for MESH_BUILD_QUANTIZED
+//   unsigned int      [indexCount]    16 byte aligned, each mesh's levels of detail one after another
+//   Meshlet           [meshletCount]  16 byte aligned, MESH_BUILD_MESHLETS only, see MeshletBuilder.h
+//
+// The entry's name already covers the contents of the source file, the material libraries an
+// .obj names, the import and build flags and the version; the header repeats them so a cache is
+// never used for the wrong model. Every other file the importer opened is listed with the hash
+// of its contents and Open misses when one of them changed. Bump MESH_CACHE_VERSION whenever
+// the layout or the meaning of any stream changes.
+
+const uint32_t MESH_CACHE_MAGIC = 0x4843534D; // "MSCH"
+const uint32_t MESH_CACHE_VERSION = 8;
+
+// MeshCacheHeader::buildFlags
+const uint32_t MESH_BUILD_OPTIMIZED = 1; // vertex cache, overdraw and fetch order, see MeshOptimizer.h
+const uint32_t MESH_BUILD_QUANTIZED = 2; // PackedVertex stream
+const uint32_t MESH_BUILD_LODS = 4;      // simplified levels of detail, see MeshSimplifier.h
+const uint32_t MESH_BUILD_MESHLETS = 8;  // level 0 clustered into meshlets with culling bounds
+
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexSize;
+	uint32_t importFlags;
+	uint32_t buildFlags; // processing done after the import, e.g. MESH_BUILD_OPTIMIZED
+	uint32_t dependencyCount;
+	uint64_t sourceHash; // AssetCache::HashFile of the model
+	uint32_t meshCount;
+	uint32_t textureCount;
+	uint64_t stringOffset;
+	uint64_t stringBytes;
+	uint64_t vertexOffset;
+	uint64_t vertexCount;
+	uint64_t indexOffset;
+	uint64_t indexCount;
+	uint64_t meshletOffset;
+	uint64_t meshletCount;
+};
+
+struct MeshCacheMesh
+{
+	uint64_t firstVertex;
+	uint64_t firstIndex;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t firstTexture;
+	uint32_t textureCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	float texCoordMin[2]; // quantization range of PackedVertex::TexCoords
+	float texCoordMax[2];
+	// indexCount covers every level, level 0 starts at firstIndex and each further level right after the previous
+	uint32_t lodCount;
+	uint32_t lodIndexCount[MESH_MAX_LODS];
+	float lodError[MESH_MAX_LODS];
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+};
+
+struct MeshCacheTexture
+{
+	uint32_t typeOffset; // into the string table
+	uint32_t pathOffset;
+};
+
+// a file the importer read besides the model, e.g. an .obj's .mtl
+struct MeshCacheDependency
+{
+	uint64_t hash; // AssetCache::HashFile
+	uint32_t pathOffset; // into the string table
+	uint32_t padding;
+};
+
+class MeshCache
+{
+public:
+	// AssetCache entry of a model imported with importFlags and processed with buildFlags; empty if the model can't be read
+	static std::string KeyFor(const std::string &modelPath, uint32_t importFlags, uint32_t buildFlags, uint64_t &sourceHash)
+	{
+		return AssetCache::Shared().key(modelPath, "mesh", ((uint64_t)buildFlags << 32) | importFlags, MESH_CACHE_VERSION, &sourceHash,
+			AssetCache::HashFiles(MaterialLibraries(modelPath)));
+	}
+
+	// the files an .obj's mtllib lines name, next to the model; nothing for other formats
+	static std::vector<std::string> MaterialLibraries(const std::string &modelPath)
+	{
+		std::vector<std::string> libraries;
+		size_t dot = modelPath.find_last_of('.');
+		std::string extension = dot == std::string::npos ? std::string() : modelPath.substr(dot + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		MappedFile source;
+		if (extension != "obj" || !source.open(modelPath.c_str()))
+			return libraries;
+		size_t slash = modelPath.find_last_of("/\\");
+		std::string directory = slash == std::string::npos ? std::string() : modelPath.substr(0, slash + 1);
+		const char *data = (const char*)source.data();
+		const size_t size = source.size();
+		for (size_t line = 0; line < size; )
+		{
+			const char *end = (const char*)std::memchr(data + line, '\n', size - line);
+			size_t next = end ? end - data + 1 : size;
+			// the rest of the line is the name, the way Assimp's obj parser reads it
+			if (next - line > 7 && std::memcmp(data + line, "mtllib", 6) == 0 && (data[line + 6] == ' ' || data[line + 6] == '\t'))
+			{
+				size_t first = line + 7, last = next;
+				while (first < last && (data[first] == ' ' || data[first] == '\t'))
+					first++;
+				while (last > first && std::isspace((unsigned char)data[last - 1]))
+					last--;
+				if (last > first)
+					libraries.push_back(directory + std::string(data + first, last - first));
+			}
+			line = next;
+		}
+		return libraries;
+	}
+
+	static size_t VertexSizeFor(uint32_t buildFlags)
+	{
+		return buildFlags & MESH_BUILD_QUANTIZED ? sizeof(PackedVertex) : sizeof(Vertex);
+	}
+
+	// writes the processed meshes of a model in draw order, with the files the importer read besides it
+	static bool Write(const std::string &cachePath, const std::vector<std::shared_ptr<MeshData> > &meshes, uint32_t importFlags, uint32_t buildFlags,
+		uint64_t sourceHash, const std::vector<std::string> &dependencyPaths)
+	{
+		std::vector<MeshCacheMesh> records;
+		std::vector<MeshCacheTexture> textures;
+		std::vector<MeshCacheDependency> dependencies;
+		std::string strings;
+		uint64_t vertexCount = 0;
+		uint64_t indexCount = 0;
+		uint64_t meshletCount = 0;
+
+		records.reserve(meshes.size());
+		for (const std::shared_ptr<MeshData> &data : meshes)
+		{
+			const MeshData &mesh = *data;
+			MeshCacheMesh record;
+			record.firstVertex = vertexCount;
+			record.firstIndex = indexCount;
+			record.vertexCount = (uint32_t)vertexCountOf(mesh);
+			record.indexCount = (uint32_t)mesh.indices.size();
+			record.firstTexture = (uint32_t)textures.size();
+			record.textureCount = (uint32_t)mesh.textures.size();
+			for (int axis = 0; axis < 3; axis++)
+			{
+				record.boundsMin[axis] = mesh.boundsMin[axis];
+				record.boundsMax[axis] = mesh.boundsMax[axis];
+			}
+			for (int axis = 0; axis < 2; axis++)
+			{
+				record.texCoordMin[axis] = mesh.texCoordMin[axis];
+				record.texCoordMax[axis] = mesh.texCoordMax[axis];
+			}
+			std::vector<MeshLod> lods = mesh.lods.empty() ? std::vector<MeshLod>(1, { 0, (unsigned int)mesh.indices.size(), 0.0f }) : mesh.lods;
+			record.lodCount = (uint32_t)std::min<size_t>(lods.size(), MESH_MAX_LODS);
+			for (uint32_t lod = 0; lod < MESH_MAX_LODS; lod++)
+			{
+				record.lodIndexCount[lod] = lod < record.lodCount ? lods[lod].indexCount : 0;
+				record.lodError[lod] = lod < record.lodCount ? lods[lod].error : 0.0f;
+			}
+			record.firstMeshlet = (uint32_t)meshletCount;
+			record.meshletCount = (uint32_t)mesh.meshlets.size();
+			records.push_back(record);
+
+			for (const TextureRef &texture : mesh.textures)
+			{
+				MeshCacheTexture ref;
+				ref.typeOffset = (uint32_t)strings.size();
+				strings.append(texture.type.c_str(), texture.type.size() + 1);
+				ref.pathOffset = (uint32_t)strings.size();
+				strings.append(texture.path.c_str(), texture.path.size() + 1);
+				textures.push_back(ref);
+			}
+
+			vertexCount += vertexCountOf(mesh);
+			indexCount += mesh.indices.size();
+			meshletCount += mesh.meshlets.size();
+		}
+		for (const std::string &path : dependencyPaths)
+		{
+			MeshCacheDependency dependency = {};
+			dependency.hash = AssetCache::HashFile(path.c_str());
+			dependency.pathOffset = (uint32_t)strings.size();
+			strings.append(path.c_str(), path.size() + 1);
+			dependencies.push_back(dependency);
+		}
+
+		MeshCacheHeader header = {};
+		header.magic = MESH_CACHE_MAGIC;
+		header.version = MESH_CACHE_VERSION;
+		header.vertexSize = (uint32_t)VertexSizeFor(buildFlags);
+		header.importFlags = importFlags;
+		header.buildFlags = buildFlags;
+		header.dependencyCount = (uint32_t)dependencies.size();
+		header.sourceHash = sourceHash;
+		header.meshCount = (uint32_t)records.size();
+		header.textureCount = (uint32_t)textures.size();
+		header.stringOffset = sizeof(MeshCacheHeader) + records.size() * sizeof(MeshCacheMesh) + textures.size() * sizeof(MeshCacheTexture) +
+			dependencies.size() * sizeof(MeshCacheDependency);
+		header.stringBytes = strings.size();
+		header.vertexOffset = align(header.stringOffset + header.stringBytes);
+		header.vertexCount = vertexCount;
+		header.indexOffset = align(header.vertexOffset + vertexCount * header.vertexSize);
+		header.indexCount = indexCount;
+		header.meshletOffset = align(header.indexOffset + indexCount * sizeof(unsigned int));
+		header.meshletCount = meshletCount;
+
+		std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)records.data(), records.size() * sizeof(MeshCacheMesh));
+		file.write((const char*)textures.data(), textures.size() * sizeof(MeshCacheTexture));
+		file.write((const char*)dependencies.data(), dependencies.size() * sizeof(MeshCacheDependency));
+		file.write(strings.data(), strings.size());
+		pad(file, header.vertexOffset);
+		for (const std::shared_ptr<MeshData> &mesh : meshes)
+		{
+			if (buildFlags & MESH_BUILD_QUANTIZED)
+				file.write((const char*)mesh->packedVertices.data(), mesh->packedVertices.size() * sizeof(PackedVertex));
+			else
+				file.write((const char*)mesh->vertices.data(), mesh->vertices.size() * sizeof(Vertex));
+		}
+		pad(file, header.indexOffset);
+		for (const std::shared_ptr<MeshData> &mesh : meshes)
+			file.write((const char*)mesh->indices.data(), mesh->indices.size() * sizeof(unsigned int));
+		pad(file, header.meshletOffset);
+		for (const std::shared_ptr<MeshData> &mesh : meshes)
+			file.write((const char*)mesh->meshlets.data(), mesh->meshlets.size() * sizeof(Meshlet));
+
+		return file.good();
+	}
+
+	// maps the cache and validates it against the source file and the files it pulled in; false means the
+	// model has to be imported again
+	bool Open(const std::string &cachePath, uint32_t importFlags, uint32_t buildFlags, uint64_t sourceHash)
+	{
+		if (!file.open(cachePath.c_str()) || file.size() < sizeof(MeshCacheHeader))
+			return false;
+
+		const MeshCacheHeader &h = Header();
+		if (h.magic != MESH_CACHE_MAGIC || h.version != MESH_CACHE_VERSION || h.vertexSize != VertexSizeFor(buildFlags) ||
+			h.importFlags != importFlags || h.buildFlags != buildFlags || h.sourceHash != sourceHash)
+		{
+			file.close();
+			return false;
+		}
+		if (!validRegions() || !validRecords())
+		{
+			std::cout << "ERROR::MESHCACHE::CORRUPT " << cachePath << std::endl;
+			file.close();
+			return false;
+		}
+		const MeshCacheDependency *dependencies = Dependencies();
+		for (uint32_t i = 0; i < h.dependencyCount; i++)
+			if (AssetCache::HashFile(String(dependencies[i].pathOffset)) != dependencies[i].hash)
+			{
+				std::cout << "MESHCACHE::STALE " << String(dependencies[i].pathOffset) << " changed" << std::endl;
+				file.close();
+				return false;
+			}
+		return true;
+	}
+
+	void Close()
+	{
+		file.close();
+	}
+
+	const MeshCacheHeader &Header() const
+	{
+		return *(const MeshCacheHeader*)file.data();
+	}
+	const MeshCacheMesh *Meshes() const
+	{
+		return (const MeshCacheMesh*)(file.data() + sizeof(MeshCacheHeader));
+	}
+	const MeshCacheTexture *Textures() const
+	{
+		return (const MeshCacheTexture*)(Meshes() + Header().meshCount);
+	}
+	const MeshCacheDependency *Dependencies() const
+	{
+		return (const MeshCacheDependency*)(Textures() + Header().textureCount);
+	}
+	const char *String(uint32_t offset) const
+	{
+		return (const char*)file.data() + Header().stringOffset + offset;
+	}
+	const Vertex *Vertices() const
+	{
+		return (const Vertex*)(file.data() + Header().vertexOffset);
+	}
+	// the vertex stream of a MESH_BUILD_QUANTIZED cache
+	const PackedVertex *PackedVertices() const
+	{
+		return (const PackedVertex*)(file.data() + Header().vertexOffset);
+	}
+	const unsigned int *Indices() const
+	{
+		return (const unsigned int*)(file.data() + Header().indexOffset);
+	}
+	// a record's meshlets are Meshlets() + firstMeshlet, their index ranges relative to its firstIndex
+	const Meshlet *Meshlets() const
+	{
+		return (const Meshlet*)(file.data() + Header().meshletOffset);
+	}
+	// index ranges of a record's levels, relative to its firstIndex
+	static std::vector<MeshLod> Lods(const MeshCacheMesh &record)
+	{
+		std::vector<MeshLod> lods;
+		unsigned int first = 0;
+		for (uint32_t lod = 0; lod < record.lodCount && lod < MESH_MAX_LODS; lod++)
+		{
+			lods.push_back({ first, record.lodIndexCount[lod], record.lodError[lod] });
+			first += record.lodIndexCount[lod];
+		}
+		return lods;
+	}
+
+private:
+	MappedFile file;
+
+	// true if count elements of elementSize starting at offset lie within [0, limit), without overflowing
+	static bool fits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t limit)
+	{
+		return offset <= limit && count <= (limit - offset) / elementSize;
+	}
+
+	// the tables, the string region and the streams lie within the file in the order Write puts them, and every
+	// string ends inside the string region
+	bool validRegions() const
+	{
+		const MeshCacheHeader &h = Header();
+		const uint64_t size = file.size();
+		if (h.stringOffset != sizeof(MeshCacheHeader) + (uint64_t)h.meshCount * sizeof(MeshCacheMesh) + (uint64_t)h.textureCount * sizeof(MeshCacheTexture) +
+			(uint64_t)h.dependencyCount * sizeof(MeshCacheDependency))
+			return false;
+		if (!fits(h.stringOffset, h.stringBytes, 1, size) || h.vertexOffset != align(h.stringOffset + h.stringBytes))
+			return false;
+		if (!fits(h.vertexOffset, h.vertexCount, h.vertexSize, size) || h.indexOffset != align(h.vertexOffset + h.vertexCount * h.vertexSize))
+			return false;
+		if (!fits(h.indexOffset, h.indexCount, sizeof(unsigned int), size) || h.meshletOffset != align(h.indexOffset + h.indexCount * sizeof(unsigned int)))
+			return false;
+		if (!fits(h.meshletOffset, h.meshletCount, sizeof(Meshlet), size))
+			return false;
+		// with the last byte a terminator, any offset into the region starts a terminated string
+		if ((h.textureCount || h.dependencyCount) && (h.stringBytes == 0 || *String((uint32_t)(h.stringBytes - 1)) != '\0'))
+			return false;
+		const MeshCacheTexture *textures = Textures();
+		for (uint32_t i = 0; i < h.textureCount; i++)
+			if (textures[i].typeOffset >= h.stringBytes || textures[i].pathOffset >= h.stringBytes)
+				return false;
+		const MeshCacheDependency *dependencies = Dependencies();
+		for (uint32_t i = 0; i < h.dependencyCount; i++)
+			if (dependencies[i].pathOffset >= h.stringBytes)
+				return false;
+		return true;
+	}
+
+	// every record's textures, vertices, indices, levels and meshlets lie within the regions,
+	// and its indices only name its own vertices since they go to the GPU unchecked
+	bool validRecords() const
+	{
+		const MeshCacheHeader &h = Header();
+		const MeshCacheMesh *records = Meshes();
+		const Meshlet *meshlets = Meshlets();
+		const unsigned int *indices = Indices();
+		for (uint32_t i = 0; i < h.meshCount; i++)
+		{
+			const MeshCacheMesh &record = records[i];
+			if (!fits(record.firstTexture, record.textureCount, 1, h.textureCount) ||
+				!fits(record.firstVertex, record.vertexCount, 1, h.vertexCount) ||
+				!fits(record.firstIndex, record.indexCount, 1, h.indexCount) ||
+				!fits(record.firstMeshlet, record.meshletCount, 1, h.meshletCount))
+				return false;
+			if (record.lodCount == 0 || record.lodCount > MESH_MAX_LODS)
+				return false;
+			uint64_t lodIndices = 0;
+			for (uint32_t lod = 0; lod < record.lodCount; lod++)
+				lodIndices += record.lodIndexCount[lod];
+			if (lodIndices > record.indexCount)
+				return false;
+			unsigned int maxIndex = 0;
+			for (uint32_t index = 0; index < record.indexCount; index++)
+				maxIndex = std::max(maxIndex, indices[record.firstIndex + index]);
+			if (record.indexCount > 0 && maxIndex >= record.vertexCount)
+				return false;
+			for (uint32_t m = 0; m < record.meshletCount; m++)
+			{
+				const Meshlet &meshlet = meshlets[record.firstMeshlet + m];
+				if (!fits(meshlet.firstIndex, meshlet.indexCount, 1, record.lodIndexCount[0]))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	static size_t vertexCountOf(const MeshData &mesh)
+	{
+		return mesh.packedVertices.empty() ? mesh.vertices.size() : mesh.packedVertices.size();
+	}
+
+	static uint64_t align(uint64_t offset)
+	{
+		return (offset + 15) & ~(uint64_t)15;
+	}
+
+	static void pad(std::ofstream &out, uint64_t offset)
+	{
+		static const char zeros[16] = {};
+		uint64_t position = (uint64_t)out.tellp();
+		if (offset > position)
+			out.write(zeros, offset - position);
+	}
+};
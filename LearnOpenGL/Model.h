@@ -7,16 +7,106 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/DefaultIOSystem.h>
 
 #include "Shader.h"
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "TextureCache.h"
+#include "Utility/Headers/BlendFile.h"
+#include "Utility/Headers/ImportProfiler.h"
+#include "Utility/Headers/MeshOptimizer.h"
+#include "Utility/Headers/MeshSimplifier.h"
+#include "Utility/Headers/RenderQueue.h"
+#include "Utility/Headers/Timer.h"
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <xmmintrin.h>
+#define MODEL_SSE 1
+#endif
+
+// post-processing applied to every import, part of the mesh cache key
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+// Assimp's own file system, noting every file an import opens besides the model, e.g. an .obj's .mtl, so the
+// mesh cache can tell when one of them changed
+class RecordingIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+	RecordingIOSystem(const std::string &modelPath, std::vector<std::string> &opened) : modelPath(modelPath), opened(opened) {}
+
+	Assimp::IOStream *Open(const char *file, const char *mode = "rb") override
+	{
+		Assimp::IOStream *stream = DefaultIOSystem::Open(file, mode);
+		if (stream && modelPath != file && std::find(opened.begin(), opened.end(), file) == opened.end())
+			opened.push_back(file);
+		return stream;
+	}
+
+private:
+	std::string modelPath;
+	std::vector<std::string> &opened;
+};
+
+struct ModelOptions
+{
+	bool gammaCorrection = false;
+	// import on a background thread and return right away; meshes appear as Update() streams them in
+	// and textures as TextureCache::Update() uploads them
+	bool async = false;
+	// reorder indices for the vertex cache and overdraw, then vertices for fetch locality, at import time
+	bool optimizeMeshes = true;
+	// store vertices as PackedVertex (20 bytes) instead of Vertex (44 bytes), see Mesh.h; needs shaders
+	// that understand the quantized uniforms like vertex.vert and shadowcubemap.vert
+	bool quantizeVertices = false;
+	// once loaded, move every mesh into one vertex and one index buffer behind a single vertex array and
+	// draw the submeshes with base vertex offsets instead of binding a vertex array per mesh
+	bool mergeBuffers = false;
+	// textures start at a small mip and follow RequestTextureDetail under TextureCache's memory budget
+	bool streamTextures = false;
+	// simplify every mesh into up to MESH_MAX_LODS levels of detail at import time, see Draw(shader, model, view)
+	bool generateLods = false;
+	// split level 0 of every mesh into meshlets with bounding spheres and normal cones at import time,
+	// see LodView::cullMeshlets
+	bool buildMeshlets = false;
+	// draw the whole model with glMultiDrawElementsIndirect once its buffers are merged, where the context
+	// is GL 4.3 or newer; Draw's per mesh path is the fallback. Can be changed between frames
+	bool multiDrawIndirect = false;
+};
+
+// what Model::Draw needs to pick each mesh's level of detail from its size on screen
+struct LodView
+{
+	glm::vec3 cameraPos;
+	float fovY;           // radians, e.g. glm::radians(Camera::Zoom)
+	float viewportHeight; // pixels
+	// the coarsest level whose simplification error stays below this many pixels is drawn
+	float pixelError = 1.0f;
+	bool enabled = true;
+	// meshes drawn at level 0 skip the meshlets outside the frustum or facing away from cameraPos;
+	// leave it off for passes that draw back faces, like the shadow cubemap
+	bool cullMeshlets = false;
+	glm::mat4 viewProjection; // used by cullMeshlets
+};
+
+// levels coarser than this stop being generated, relative to the mesh's bounding box diagonal
+const float MODEL_LOD_MAX_ERROR = 0.05f;
 
 class Model
 {
@@ -26,188 +116,1641 @@ public:
 	std::vector<Mesh> meshes;
 	std::string directory;
 	bool gammaCorrection;
+	ModelOptions options;
 
 	/*  Functions   */
-	Model(std::string const &path, bool gamma = false) : gammaCorrection(gamma)
+	Model(std::string const &path, bool gamma = false) : Model(path, gammaOptions(gamma))
+	{
+	}
+	Model(std::string const &path, const ModelOptions &options) : gammaCorrection(options.gammaCorrection), options(options)
 	{
 		loadModel(path);
 	}
-	void Draw(Shader shader)
+	~Model()
+	{
+		if (streaming && streaming->worker.joinable())
+		{
+			streaming->cancel = true;
+			streaming->worker.join();
+		}
+	}
+	void Draw(const Shader &shader)
+	{
+		drawLevels(shader, nullptr, nullptr);
+	}
+	// draws each mesh at the level of detail its projected size calls for; model is the matrix the shader uses
+	void Draw(const Shader &shader, const glm::mat4 &model, const LodView &view)
+	{
+		drawLevels(shader, &model, &view);
+	}
+
+	// the whole model in as many glMultiDrawElementsIndirect calls as it has materials, from a command buffer
+	// kept per pass and object (each instance has its own levels of detail and culled meshlets) and rewritten
+	// only when those change; falls back to Draw(shader, model, view) unless CanDrawIndirect
+	void DrawIndirect(const Shader &shader, unsigned int pass, uint32_t object, const glm::mat4 &model, const LodView &view)
+	{
+		if (!CanDrawIndirect())
+		{
+			drawLevels(shader, &model, &view);
+			return;
+		}
+#if defined(GL_VERSION_4_3)
+		Timer timer;
+		shader.use();
+		drawIndirect(uniformsFor(shader), pass, object, model, view);
+		drawCalls++;
+		drawMs += timer.elapsedMs();
+#endif
+	}
+
+	// false as well where the loader was generated without GL 4.3
+	static bool IndirectSupported()
+	{
+#if defined(GL_VERSION_4_3)
+		return GLAD_GL_VERSION_4_3 != 0;
+#else
+		return false;
+#endif
+	}
+
+	bool CanDrawIndirect() const
+	{
+		return mergedVAO && IndirectSupported();
+	}
+
+	// one RenderQueue item per mesh, and one for the placeholder boxes while meshes are still streaming;
+	// depth is the distance of each mesh's bounds from eye, normalized between nearPlane and farPlane.
+	// With options.multiDrawIndirect a model that CanDrawIndirect is a single item at the distance of its bounds.
+	// shader is only used for the key, DrawPart draws the items with it
+	void Enqueue(RenderQueue &queue, unsigned int pass, const Shader &shader, const glm::mat4 &model, const glm::vec3 &eye,
+		float nearPlane, float farPlane, uint32_t object) const
 	{
+		if (options.multiDrawIndirect && CanDrawIndirect())
+		{
+			glm::vec3 center = glm::vec3(model * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+			float depth = RenderQueue::NormalizeDepth(glm::length(center - eye), nearPlane, farPlane);
+			queue.push(RenderQueue::MakeKey(pass, shader.ID, 0, mergedVAO, depth), object, INDIRECT_PART);
+			return;
+		}
+		for (uint32_t i = 0; i < meshes.size(); i++)
+		{
+			const Mesh &mesh = meshes[i];
+			glm::vec3 center = glm::vec3(model * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+			float depth = RenderQueue::NormalizeDepth(glm::length(center - eye), nearPlane, farPlane);
+			unsigned int vertexArray = mergedVAO ? mergedVAO : (unsigned int)mesh.GetVOA();
+			queue.push(RenderQueue::MakeKey(pass, shader.ID, mesh.MaterialKey(), vertexArray, depth), object, i);
+		}
+		// behind everything else, the boxes cover the space the missing meshes will fill
+		if (placeholdersPending())
+			queue.push(RenderQueue::MakeKey(pass, shader.ID, 0, streaming->placeholder->GetVOA(), 1.0f), object, PLACEHOLDER_PART);
+	}
+	// draws an item Enqueue made, with the same level of detail and culling Draw(shader, model, view) would use
+	void DrawPart(const Shader &shader, const RenderItem &item, const glm::mat4 &model, const LodView &view)
+	{
+		if (item.part == INDIRECT_PART)
+		{
+			DrawIndirect(shader, RenderQueue::Pass(item.key), item.object, model, view);
+			return;
+		}
+		Timer timer;
 		shader.use();
-		for (unsigned int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shader);
+		const MeshUniforms &uniforms = uniformsFor(shader);
+		const uint32_t part = item.part;
+		if (part == PLACEHOLDER_PART)
+			drawPlaceholders(uniforms);
+		else if (part < meshes.size())
+		{
+			Mesh &mesh = meshes[part];
+			glm::vec4 frustum[6];
+			if (view.cullMeshlets && !mesh.meshlets.empty())
+				frustumPlanes(view.viewProjection, frustum);
+			drawMesh(mesh, uniforms, &model, &view, frustum);
+		}
+		drawCalls++;
+		drawMs += timer.elapsedMs();
+	}
+
+	// triangles the Draw calls since the last ResetDrawStats submitted, and what they would have been at level 0
+	void DrawStats(size_t &submitted, size_t &full) const
+	{
+		submitted = trianglesSubmitted;
+		full = trianglesFull;
+	}
+	// meshlets tested since the last ResetDrawStats and how many were culled, with the triangles they hold
+	void MeshletStats(size_t &tested, size_t &culled, size_t &triangles, size_t &trianglesCulled) const
+	{
+		tested = meshletsTested;
+		culled = meshletsCulled;
+		triangles = meshletTriangles;
+		trianglesCulled = meshletTrianglesCulled;
+	}
+	// Draw, DrawPart and DrawIndirect calls since the last ResetDrawStats and the CPU time they took together
+	void DrawTime(size_t &draws, double &ms) const
+	{
+		draws = drawCalls;
+		ms = drawMs;
+	}
+	void ResetDrawStats()
+	{
+		drawCalls = 0;
+		drawMs = 0.0;
+		trianglesSubmitted = trianglesFull = 0;
+		meshletsTested = meshletsCulled = meshletTriangles = meshletTrianglesCulled = 0;
+	}
+
+	// level Draw would pick for a mesh with the given transform and view
+	static unsigned int SelectLod(const Mesh &mesh, const glm::mat4 &model, const LodView &view)
+	{
+		if (!view.enabled || mesh.lods.size() < 2)
+			return 0;
+		float pixels = projectedPixels(mesh, model, view.cameraPos, pixelsPerUnit(view.fovY, view.viewportHeight));
+		unsigned int lod = 0;
+		while (lod + 1 < mesh.lods.size() && mesh.lods[lod + 1].error * pixels <= view.pixelError)
+			lod++;
+		return lod;
+	}
+
+	// streams finished meshes and textures onto the GPU within budgetMs, call once per frame from the GL thread;
+	// returns true once every mesh is uploaded
+	bool Update(double budgetMs = 2.0)
+	{
+		if (!streaming)
+		{
+			if (!texturesReported)
+				texturesReported = reportTextureMemory();
+			return true;
+		}
+
+		Timer timer;
+		Streaming &s = *streaming;
+		bool done;
+		bool fromCache;
+		{
+			std::lock_guard<std::mutex> lock(s.mutex);
+			fromCache = s.fromCache;
+		}
+		if (fromCache)
+		{
+			if (options.async && !s.placeholder)
+				buildPlaceholder();
+			const MeshCacheHeader &header = s.cache.Header();
+			if (meshes.capacity() < header.meshCount)
+				meshes.reserve(header.meshCount);
+			while (s.nextCached < header.meshCount)
+			{
+				Timer upload;
+				addCachedMesh(s.cache, s.cache.Meshes()[s.nextCached++]);
+				profile.add(ImportStage::MeshUpload, upload.elapsedMs(), meshBytes(meshes.back()));
+				if (timer.elapsedMs() >= budgetMs)
+					break;
+			}
+			done = s.nextCached == header.meshCount;
+		}
+		else
+		{
+			if (options.async && !s.placeholder)
+				buildPlaceholder();
+			for (;;)
+			{
+				std::shared_ptr<MeshData> data;
+				bool owned;
+				{
+					std::lock_guard<std::mutex> lock(s.mutex);
+					if (s.ready.empty())
+						break;
+					if (meshes.capacity() < s.bounds.size())
+						meshes.reserve(s.bounds.size());
+					data = std::move(s.ready.front());
+					s.ready.pop_front();
+					// the import thread reads every mesh until the mesh cache is written, finished says it is done
+					owned = s.finished;
+				}
+				Timer upload;
+				addMesh(data, owned);
+				profile.add(ImportStage::MeshUpload, upload.elapsedMs(), meshBytes(meshes.back()));
+				if (timer.elapsedMs() >= budgetMs)
+					break;
+			}
+			std::lock_guard<std::mutex> lock(s.mutex);
+			done = s.finished && s.ready.empty();
+		}
+
+		if (done)
+		{
+			if (s.worker.joinable())
+				s.worker.join();
+			if (!options.async)
+				TextureCache::Shared().LoadPending();
+			if (s.placeholder)
+				s.placeholder->Delete();
+			std::cout << (s.fromCache ? "MODEL::LOAD::WARM " : "MODEL::LOAD::COLD ") << s.path << " " << meshes.size() << " meshes in "
+				<< s.timer.elapsedMs() << (s.fromCache ? " ms (mesh cache)" : s.nativeBlend ? " ms (native .blend import)" : " ms (Assimp import)") << std::endl;
+			if (s.optimizedTriangles)
+				std::cout << "MODEL::OPTIMIZE " << s.path << " ACMR " << s.acmrBefore / s.optimizedTriangles << " -> " << s.acmrAfter / s.optimizedTriangles
+					<< " over " << s.optimizedTriangles << " triangles in " << profile.stage(ImportStage::Optimize).ms << " ms" << std::endl;
+			if (s.buildFlags & MESH_BUILD_LODS)
+				reportLods(s);
+			if (s.meshletCount)
+				std::cout << "MODEL::MESHLETS " << s.path << " " << s.meshletCount << " meshlets, " << (double)s.meshletTriangles / s.meshletCount
+					<< " triangles each on average, in " << profile.stage(ImportStage::Meshlets).ms << " ms" << std::endl;
+			reportGeometryMemory();
+			if (options.mergeBuffers)
+				mergeBuffers();
+			texturesReported = reportTextureMemory();
+			streaming.reset();
+		}
+		return done;
+	}
+
+	bool IsLoaded() const
+	{
+		return !streaming;
+	}
+
+	// meshes uploaded so far and the total once it is known (0 while Assimp is still parsing)
+	void LoadProgress(size_t &loaded, size_t &total)
+	{
+		loaded = meshes.size();
+		total = meshes.size();
+		if (streaming)
+		{
+			std::lock_guard<std::mutex> lock(streaming->mutex);
+			total = streaming->bounds.size();
+		}
+	}
+
+	// GPU bytes of the uploaded meshes; the wide figures are what the full Vertex layout and 32 bit indices
+	// would take, shortIndexMeshes counts the meshes drawn with 16 bit indices
+	void GeometryMemory(size_t &vertexBytes, size_t &indexBytes, size_t &wideVertexBytes, size_t &wideIndexBytes, size_t &shortIndexMeshes) const
+	{
+		vertexBytes = indexBytes = wideVertexBytes = wideIndexBytes = shortIndexMeshes = 0;
+		for (const Mesh &mesh : meshes)
+		{
+			vertexBytes += mesh.vertexCount * mesh.VertexStride();
+			indexBytes += mesh.indexCount * mesh.IndexSize();
+			wideVertexBytes += mesh.vertexCount * sizeof(Vertex);
+			wideIndexBytes += mesh.indexCount * sizeof(unsigned int);
+			shortIndexMeshes += mesh.indexType == GL_UNSIGNED_SHORT ? 1 : 0;
+		}
+	}
+
+	// vertex arrays Draw binds per call
+	size_t VertexArrayCount() const
+	{
+		return mergedVAO ? 1 : meshes.size();
+	}
+
+	// tells TextureCache how much detail this frame needs from each texture: every mesh's bounding sphere
+	// is projected for a camera at cameraPos, times how often its texture coordinates repeat the texture
+	void RequestTextureDetail(const glm::mat4 &model, const glm::vec3 &cameraPos, float fovY, float viewportHeight)
+	{
+		for (const Mesh &mesh : meshes)
+		{
+			float pixels = projectedPixels(mesh, model, cameraPos, pixelsPerUnit(fovY, viewportHeight));
+			pixels *= std::max(1.0f, std::max(std::abs(mesh.uvScale.x), std::abs(mesh.uvScale.y)));
+			for (const Texture &texture : mesh.textures)
+			{
+				auto found = loadedLookup.find(texture.path);
+				if (found != loadedLookup.end())
+					TextureCache::Shared().RequestDetail(textureHandles[found->second], pixels);
+			}
+		}
+	}
+
+	// GPU bytes of the textures this model uses that are uploaded so far, and what they would take uncompressed
+	void TextureMemory(size_t &resident, size_t &uncompressed, size_t &compressedCount) const
+	{
+		resident = uncompressed = compressedCount = 0;
+		for (const TextureHandle &handle : textureHandles)
+		{
+			resident += handle.get()->bytes;
+			uncompressed += handle.get()->uncompressedBytes;
+			compressedCount += handle.get()->compressed ? 1 : 0;
+		}
+	}
+
+	// where the load time went, complete (and printed) once every texture of the model has been uploaded
+	const ImportProfiler &Profile() const { return profile; }
+	bool ProfileComplete() const { return texturesReported; }
+
+	// entry point for --bench-blend: the CPU side of getting a .blend's meshes into MeshData, natively, through Assimp's
+	// Blender importer and through Assimp from the .fbx Blender exported of the same file; best of a few runs each
+	static int BenchmarkBlend(const std::string &blendPath, const std::string &fbxPath)
+	{
+		const int RUNS = 5;
+		for (int method = 0; method < 3; method++)
+		{
+			const std::string &path = method == 2 ? fbxPath : blendPath;
+			const char *name = method == 0 ? "native blend" : method == 1 ? "assimp blend" : "assimp fbx  ";
+			double best = 1e30;
+			size_t meshCount = 0, vertices = 0, triangles = 0;
+			bool failed = false;
+			for (int run = 0; run < RUNS && !failed; run++)
+			{
+				Timer timer;
+				std::vector<std::shared_ptr<MeshData> > converted;
+				if (method == 0)
+					failed = !readBlend(path, converted, nullptr);
+				else
+				{
+					Assimp::Importer import;
+					const aiScene *scene = import.ReadFile(path, MODEL_IMPORT_FLAGS);
+					failed = !scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode;
+					std::vector<const aiMesh*> order;
+					size_t nodes = 0;
+					if (!failed)
+						processNode(scene->mRootNode, scene, order, nodes);
+					for (const aiMesh *mesh : order)
+					{
+						converted.push_back(std::make_shared<MeshData>());
+						processMesh(mesh, scene, *converted.back());
+					}
+				}
+				best = std::min(best, timer.elapsedMs());
+				meshCount = converted.size();
+				vertices = triangles = 0;
+				for (const std::shared_ptr<MeshData> &data : converted)
+				{
+					vertices += data->vertices.size();
+					triangles += data->indices.size() / 3;
+				}
+			}
+			if (failed)
+				std::cout << "BLEND::BENCH " << name << " failed " << path << std::endl;
+			else
+				std::cout << "BLEND::BENCH " << name << " " << best << " ms, " << meshCount << " meshes, " << vertices << " vertices, " << triangles << " triangles" << std::endl;
+		}
+		return 0;
 	}
 
 private:
+	static const unsigned int PLACEHOLDER_INDICES = 36;
+	static const uint32_t PLACEHOLDER_PART = 0xFFFFFFFFu;
+	static const uint32_t INDIRECT_PART = 0xFFFFFFFEu;
+
+	// consecutive commands of an indirect pass that share textures and index type, drawn in one call
+	struct IndirectRun
+	{
+		unsigned int mesh; // whose textures and index type the run has
+		size_t firstCommand;
+		GLsizei commandCount;
+	};
+
+	// the commands of one object in one pass, see DrawIndirect
+	struct IndirectPass
+	{
+		GLuint commandBuffer = 0;
+		std::vector<DrawElementsIndirectCommand> commands; // what commandBuffer holds
+		std::vector<IndirectRun> runs;
+	};
+
+	size_t drawCalls = 0;
+	double drawMs = 0.0;
+	size_t trianglesSubmitted = 0;
+	size_t trianglesFull = 0;
+	size_t meshletsTested = 0;
+	size_t meshletsCulled = 0;
+	size_t meshletTriangles = 0;
+	size_t meshletTrianglesCulled = 0;
+	// one per program this model was drawn with, see uniformsFor
+	std::vector<MeshUniforms> programUniforms;
+	// union of the meshes' bounds, known once the buffers are merged
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+	// multi-draw indirect: the draw records as a texture buffer, the instanced record index attribute's buffer,
+	// the meshes ordered so those sharing a material are next to each other, and the commands of each pass and
+	// object, by indirectPassKey
+	GLuint drawRecordBuffer = 0;
+	GLuint drawRecordTexture = 0;
+	GLuint drawRecordIndexBuffer = 0;
+	std::vector<unsigned int> indirectOrder;
+	std::unordered_map<uint64_t, IndirectPass> indirectPasses;
+	std::vector<DrawElementsIndirectCommand> indirectCommands; // scratch for the frame's commands
+	// index ranges of the meshlets that survived culling, reused between draws
+	std::vector<unsigned int> visibleFirst;
+	std::vector<GLsizei> visibleCount;
+
+	static float pixelsPerUnit(float fovY, float viewportHeight)
+	{
+		return viewportHeight / (2.0f * std::tan(fovY * 0.5f));
+	}
+
+	// screen diameter of the mesh's bounding sphere, in pixels
+	static float projectedPixels(const Mesh &mesh, const glm::mat4 &model, const glm::vec3 &cameraPos, float pixelsPerUnit)
+	{
+		float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		glm::vec3 center = glm::vec3(model * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+		float radius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f * scale;
+		float distance = std::max(glm::length(center - cameraPos) - radius, radius * 0.1f + 1e-4f);
+		return 2.0f * radius * pixelsPerUnit / distance;
+	}
+
+	// every mesh at the level view asks for, level 0 without a view
+	void drawLevels(const Shader &shader, const glm::mat4 *model, const LodView *view)
+	{
+		Timer timer;
+		shader.use();
+		const MeshUniforms &uniforms = uniformsFor(shader);
+		glm::vec4 frustum[6];
+		if (view && view->cullMeshlets)
+			frustumPlanes(view->viewProjection, frustum);
+		for (Mesh &mesh : meshes)
+			drawMesh(mesh, uniforms, model, view, frustum);
+		drawPlaceholders(uniforms);
+		drawCalls++;
+		drawMs += timer.elapsedMs();
+	}
+
+	// frustum is only read when view culls meshlets
+	void drawMesh(Mesh &mesh, const MeshUniforms &uniforms, const glm::mat4 *model, const LodView *view, const glm::vec4 frustum[6])
+	{
+		unsigned int level = view ? SelectLod(mesh, *model, *view) : 0;
+		const MeshLod &lod = mesh.lods[level];
+		GLState::Shared().BindVertexArray(mergedVAO ? mergedVAO : mesh.GetVOA());
+		if (level == 0 && view && view->cullMeshlets && !mesh.meshlets.empty())
+		{
+			size_t submitted = cullMeshlets(mesh, *model, *view, frustum);
+			mesh.DrawBoundRanges(uniforms, visibleFirst.data(), visibleCount.data(), (GLsizei)visibleFirst.size());
+			trianglesSubmitted += submitted;
+		}
+		else
+		{
+			mesh.DrawBound(uniforms, lod.firstIndex, lod.indexCount);
+			trianglesSubmitted += lod.indexCount / 3;
+		}
+		trianglesFull += mesh.lods[0].indexCount / 3;
+	}
+
+	// boxes stand in for the meshes that are still streaming, they are stored in mesh order
+	void drawPlaceholders(const MeshUniforms &uniforms)
+	{
+		if (!placeholdersPending())
+			return;
+		unsigned int first = (unsigned int)meshes.size() * PLACEHOLDER_INDICES;
+		streaming->placeholder->Draw(uniforms, first, streaming->placeholder->indexCount - first);
+	}
+
+	bool placeholdersPending() const
+	{
+		return streaming && streaming->placeholder && meshes.size() < streaming->placeholderCount;
+	}
+
+#if defined(GL_VERSION_4_3)
+	void drawIndirect(const MeshUniforms &uniforms, unsigned int pass, uint32_t object, const glm::mat4 &model, const LodView &view)
+	{
+		if (!drawRecordTexture)
+			setupIndirect();
+		IndirectPass &batch = indirectPassFor(pass, object);
+
+		// the same levels and meshlets the per mesh path would draw, one command per range
+		glm::vec4 frustum[6];
+		if (view.cullMeshlets)
+			frustumPlanes(view.viewProjection, frustum);
+		indirectCommands.clear();
+		batch.runs.clear();
+		for (unsigned int i : indirectOrder)
+		{
+			const Mesh &mesh = meshes[i];
+			unsigned int level = SelectLod(mesh, model, view);
+			const MeshLod &lod = mesh.lods[level];
+			size_t first = indirectCommands.size();
+			if (level == 0 && view.cullMeshlets && !mesh.meshlets.empty())
+			{
+				trianglesSubmitted += cullMeshlets(mesh, model, view, frustum);
+				for (size_t range = 0; range < visibleFirst.size(); range++)
+					indirectCommands.push_back(mesh.IndirectCommand(visibleFirst[range], (unsigned int)visibleCount[range], i));
+			}
+			else
+			{
+				indirectCommands.push_back(mesh.IndirectCommand(lod.firstIndex, lod.indexCount, i));
+				trianglesSubmitted += lod.indexCount / 3;
+			}
+			trianglesFull += mesh.lods[0].indexCount / 3;
+			if (indirectCommands.size() == first)
+				continue;
+			// one call draws with one set of textures and one index type
+			const Mesh *runMesh = batch.runs.empty() ? nullptr : &meshes[batch.runs.back().mesh];
+			if (!runMesh || !runMesh->SameMaterial(mesh) || runMesh->indexType != mesh.indexType)
+				batch.runs.push_back({ i, first, 0 });
+			batch.runs.back().commandCount += (GLsizei)(indirectCommands.size() - first);
+		}
+
+		GLState &state = GLState::Shared();
+		state.BindBuffer(GL_DRAW_INDIRECT_BUFFER, batch.commandBuffer);
+		if (indirectCommands.size() != batch.commands.size()
+			|| std::memcmp(indirectCommands.data(), batch.commands.data(), indirectCommands.size() * sizeof(DrawElementsIndirectCommand)) != 0)
+		{
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, indirectCommands.size() * sizeof(DrawElementsIndirectCommand), indirectCommands.data(), GL_DYNAMIC_DRAW);
+			batch.commands = indirectCommands;
+		}
+
+		state.BindVertexArray(mergedVAO);
+		state.BindTexture(DRAW_RECORD_UNIT, GL_TEXTURE_BUFFER, drawRecordTexture);
+		glUniform1i(uniforms.indirect, 1);
+		for (const IndirectRun &run : batch.runs)
+		{
+			const Mesh &mesh = meshes[run.mesh];
+			mesh.BindTextures();
+			glMultiDrawElementsIndirect(GL_TRIANGLES, mesh.indexType, (const void*)(run.firstCommand * sizeof(DrawElementsIndirectCommand)), run.commandCount, 0);
+		}
+		glUniform1i(uniforms.indirect, 0);
+	}
+
+	// the draw records, the record index attribute of the merged vertex array and the material order of the meshes
+	void setupIndirect()
+	{
+		// three texels per mesh: (posScale, quantized) (posOffset, 0) (uvScale, uvOffset), read by vertex.vert
+		std::vector<glm::vec4> records;
+		records.reserve(meshes.size() * 3);
+		for (const Mesh &mesh : meshes)
+		{
+			records.push_back(glm::vec4(mesh.posScale, mesh.quantized ? 1.0f : 0.0f));
+			records.push_back(glm::vec4(mesh.posOffset, 0.0f));
+			records.push_back(glm::vec4(mesh.uvScale.x, mesh.uvScale.y, mesh.uvOffset.x, mesh.uvOffset.y));
+		}
+		GLState &state = GLState::Shared();
+		glGenBuffers(1, &drawRecordBuffer);
+		state.BindBuffer(GL_TEXTURE_BUFFER, drawRecordBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, records.size() * sizeof(glm::vec4), records.data(), GL_STATIC_DRAW);
+		glGenTextures(1, &drawRecordTexture);
+		state.BindTexture(DRAW_RECORD_UNIT, GL_TEXTURE_BUFFER, drawRecordTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawRecordBuffer);
+
+		// instance i of a command reads element baseInstance + i, so baseInstance alone picks the record
+		std::vector<GLuint> recordIndices(meshes.size());
+		for (size_t i = 0; i < recordIndices.size(); i++)
+			recordIndices[i] = (GLuint)i;
+		glGenBuffers(1, &drawRecordIndexBuffer);
+		state.BindVertexArray(mergedVAO);
+		state.BindBuffer(GL_ARRAY_BUFFER, drawRecordIndexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, recordIndices.size() * sizeof(GLuint), recordIndices.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(DRAW_RECORD_ATTRIBUTE);
+		glVertexAttribIPointer(DRAW_RECORD_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+		glVertexAttribDivisor(DRAW_RECORD_ATTRIBUTE, 1);
+
+		indirectOrder = recordIndices;
+		std::stable_sort(indirectOrder.begin(), indirectOrder.end(), [this](unsigned int a, unsigned int b)
+		{
+			const Mesh &first = meshes[a], &second = meshes[b];
+			if (first.MaterialKey() != second.MaterialKey())
+				return first.MaterialKey() < second.MaterialKey();
+			return first.indexType < second.indexType;
+		});
+		std::cout << "MODEL::INDIRECT " << modelPath << " " << meshes.size() << " meshes, " << materialCount() << " materials" << std::endl;
+	}
+
+	static uint64_t indirectPassKey(unsigned int pass, uint32_t object)
+	{
+		return ((uint64_t)pass << 32) | object;
+	}
+
+	IndirectPass &indirectPassFor(unsigned int pass, uint32_t object)
+	{
+		IndirectPass &batch = indirectPasses[indirectPassKey(pass, object)];
+		if (!batch.commandBuffer)
+			glGenBuffers(1, &batch.commandBuffer);
+		return batch;
+	}
+#endif
+
+	// distinct materials among the meshes, DrawIndirect makes at least this many calls
+	size_t materialCount() const
+	{
+		size_t count = 0;
+		for (size_t i = 0; i < indirectOrder.size(); i++)
+			if (i == 0 || !meshes[indirectOrder[i]].SameMaterial(meshes[indirectOrder[i - 1]]))
+				count++;
+		return count;
+	}
+
+	// the uniform locations of a program this model was drawn with before, looked up on its first draw
+	const MeshUniforms &uniformsFor(const Shader &shader)
+	{
+		for (const MeshUniforms &uniforms : programUniforms)
+			if (uniforms.program == shader.ID)
+				return uniforms;
+		programUniforms.push_back(MeshUniforms::Resolve(shader));
+		return programUniforms.back();
+	}
+
+	// planes of the clip volume as (normal, distance) with the normals pointing inwards
+	static void frustumPlanes(const glm::mat4 &viewProjection, glm::vec4 planes[6])
+	{
+		glm::vec4 rows[4];
+		for (int row = 0; row < 4; row++)
+			rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			planes[axis * 2] = rows[3] + rows[axis];
+			planes[axis * 2 + 1] = rows[3] - rows[axis];
+		}
+		for (int plane = 0; plane < 6; plane++)
+			planes[plane] /= glm::length(glm::vec3(planes[plane]));
+	}
+
+	// fills visibleFirst and visibleCount with the mesh's meshlets that can be seen, neighbouring ranges joined
+	// into one, and returns their triangle count
+	size_t cullMeshlets(const Mesh &mesh, const glm::mat4 &model, const LodView &view, const glm::vec4 frustum[6])
+	{
+		visibleFirst.clear();
+		visibleCount.clear();
+		glm::mat3 linear(model);
+		float scale = std::max(glm::length(linear[0]), std::max(glm::length(linear[1]), glm::length(linear[2])));
+		// a mirroring transform turns the winding around, and with it the side the cone faces
+		float facing = glm::determinant(linear) < 0.0f ? -1.0f : 1.0f;
+		size_t submitted = 0;
+		for (const Meshlet &meshlet : mesh.meshlets)
+		{
+			glm::vec3 center = glm::vec3(model * glm::vec4(meshlet.center[0], meshlet.center[1], meshlet.center[2], 1.0f));
+			float radius = meshlet.radius * scale;
+			bool visible = true;
+			for (int plane = 0; plane < 6 && visible; plane++)
+				visible = glm::dot(glm::vec3(frustum[plane]), center) + frustum[plane].w >= -radius;
+			if (visible && meshlet.coneCutoff < 1.0f)
+			{
+				glm::vec3 toCenter = center - view.cameraPos;
+				glm::vec3 axis = glm::normalize(linear * glm::vec3(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2])) * facing;
+				visible = glm::dot(toCenter, axis) < meshlet.coneCutoff * glm::length(toCenter) + radius;
+			}
+
+			meshletsTested++;
+			meshletTriangles += meshlet.indexCount / 3;
+			if (!visible)
+			{
+				meshletsCulled++;
+				meshletTrianglesCulled += meshlet.indexCount / 3;
+				continue;
+			}
+			submitted += meshlet.indexCount / 3;
+			if (!visibleFirst.empty() && visibleFirst.back() + visibleCount.back() == meshlet.firstIndex)
+				visibleCount.back() += meshlet.indexCount;
+			else
+			{
+				visibleFirst.push_back(meshlet.firstIndex);
+				visibleCount.push_back(meshlet.indexCount);
+			}
+		}
+		return submitted;
+	}
+
+	// state shared with the import thread while the model is loading
+	struct Streaming
+	{
+		std::string path;
+		Timer timer;
+		std::thread worker;
+		std::atomic<bool> cancel{ false };
+
+		// guarded by mutex
+		std::mutex mutex;
+		std::deque<std::shared_ptr<MeshData> > ready;
+		std::vector<std::pair<glm::vec3, glm::vec3> > bounds;
+		bool finished = false;
+
+		// warm start, meshes are uploaded straight from the mapped cache; the import thread opens the
+		// cache and then sets fromCache (guarded by mutex), after which only the GL thread touches it
+		bool fromCache = false;
+		MeshCache cache;
+		uint32_t nextCached = 0;
+
+		std::unique_ptr<Mesh> placeholder;
+		size_t placeholderCount = 0;
+
+		// set before the import starts
+		uint32_t buildFlags = 0;
+		ImportProfiler *profile = nullptr;
+		// written by the import thread, read once it finished
+		std::string cacheKey; // empty when the source can't be read
+		std::vector<std::string> dependencies; // the files the importer opened besides the model
+		uint64_t sourceHash = 0;
+		uint64_t sourceSize = 0;
+		bool nativeBlend = false;
+		double acmrBefore = 0.0;
+		double acmrAfter = 0.0;
+		size_t optimizedTriangles = 0;
+		size_t meshletCount = 0;
+		size_t meshletTriangles = 0;
+	};
+	std::unique_ptr<Streaming> streaming;
+
+	// keeps this model's textures alive in the shared TextureCache
+	std::vector<TextureHandle> textureHandles;
+	// texture path -> index into textures_loaded
+	std::unordered_map<std::string, size_t> loadedLookup;
+	std::string modelPath;
+	bool texturesReported = false;
+	ImportProfiler profile;
+	Timer loadTimer;
+	// shared buffers of ModelOptions::mergeBuffers, 0 while every mesh has its own
+	unsigned int mergedVAO = 0, mergedVBO = 0, mergedEBO = 0;
+
+	static ModelOptions gammaOptions(bool gamma)
+	{
+		ModelOptions options;
+		options.gammaCorrection = gamma;
+		return options;
+	}
 
 	/*  Functions   */
 	void loadModel(std::string path)
 	{
+		modelPath = path;
+		streaming.reset(new Streaming());
+		Streaming &s = *streaming;
+		s.path = path;
+		directory = path.substr(0, path.find_last_of('/'));
+
+		s.buildFlags = (options.optimizeMeshes ? MESH_BUILD_OPTIMIZED : 0) | (options.quantizeVertices ? MESH_BUILD_QUANTIZED : 0) |
+			(options.generateLods ? MESH_BUILD_LODS : 0) | (options.buildMeshlets ? MESH_BUILD_MESHLETS : 0);
+		s.profile = &profile;
+		if (options.async)
+			s.worker = std::thread(&Model::importScene, &s, path);
+		else
+			importScene(&s, path);
+
+		if (!options.async)
+			while (!Update(1e30)) {}
+	}
+
+	// CPU half of the import, runs on the loader thread for async models: parses the file (natively for .blend,
+	// with Assimp for everything else), converts every mesh and hands it to the GL thread, then writes the mesh cache
+	static void importScene(Streaming *s, std::string path)
+	{
+		if (openCache(s, path))
+			return;
+		if (isBlendFile(path))
+		{
+			Timer timer;
+			std::vector<std::shared_ptr<MeshData> > converted;
+			if (readBlend(path, converted, s->profile))
+			{
+				std::cout << "MODEL::BLEND " << path << " " << converted.size() << " meshes read natively in " << timer.elapsedMs() << " ms" << std::endl;
+				s->nativeBlend = true;
+				std::vector<std::pair<glm::vec3, glm::vec3> > bounds;
+				for (const std::shared_ptr<MeshData> &data : converted)
+				{
+					glm::vec3 boundsMin, boundsMax;
+					computeBounds(data->vertices, boundsMin, boundsMax);
+					bounds.push_back(std::make_pair(boundsMin, boundsMax));
+				}
+				publishBounds(s, bounds);
+				for (size_t i = 0; i < converted.size() && !s->cancel; i++)
+					finishMesh(s, converted[i], bounds[i]);
+				finishImport(s, converted);
+				return;
+			}
+			std::cout << "MODEL::BLEND falling back to Assimp " << path << std::endl;
+		}
+
+		Timer timer;
 		Assimp::Importer import;
-		const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+		// the importer owns and deletes it
+		import.SetIOHandler(new RecordingIOSystem(path, s->dependencies));
+		const aiScene *scene = import.ReadFile(path, MODEL_IMPORT_FLAGS);
 
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 		{
 			std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
+			std::lock_guard<std::mutex> lock(s->mutex);
+			s->finished = true;
 			return;
 		}
-		directory = path.substr(0, path.find_last_of('/'));
+		s->profile->add(ImportStage::Parse, timer.elapsedMs(), (size_t)s->sourceSize, scene->mNumMeshes);
 
-		processNode(scene->mRootNode, scene);
-	}
+		timer.reset();
+		std::vector<const aiMesh*> order;
+		size_t nodes = 0;
+		processNode(scene->mRootNode, scene, order, nodes);
+		s->profile->add(ImportStage::Nodes, timer.elapsedMs(), 0, nodes);
 
-	void processNode(aiNode *node, const aiScene *scene)
-	{
-		// process all the node's meshes (if any)
-		for (unsigned int i = 0; i < node->mNumMeshes; i++)
+		// publish the bounds first so placeholders can show up before any mesh is converted
+		std::vector<std::pair<glm::vec3, glm::vec3> > bounds;
+		for (const aiMesh *mesh : order)
 		{
-			aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-			meshes.push_back(processMesh(mesh, scene));
+			glm::vec3 boundsMin, boundsMax;
+			computeBounds(mesh, boundsMin, boundsMax);
+			bounds.push_back(std::make_pair(boundsMin, boundsMax));
 		}
-		// then do the same for each of its children
-		for (unsigned int i = 0; i < node->mNumChildren; i++)
+		publishBounds(s, bounds);
+
+		std::vector<std::shared_ptr<MeshData> > processed;
+		for (size_t i = 0; i < order.size() && !s->cancel; i++)
 		{
-			processNode(node->mChildren[i], scene);
+			std::shared_ptr<MeshData> data = std::make_shared<MeshData>();
+			timer.reset();
+			processMesh(order[i], scene, *data);
+			s->profile->add(ImportStage::Convert, timer.elapsedMs(), dataBytes(*data));
+			finishMesh(s, data, bounds[i]);
+			processed.push_back(data);
 		}
+		finishImport(s, processed);
 	}
 
-	Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+	// warm start: hashes the source for its AssetCache entry and, if the processed meshes are still in the cache,
+	// maps them and publishes their bounds so Update uploads straight from the mapping; false means import
+	static bool openCache(Streaming *s, const std::string &path)
 	{
-		std::vector<Vertex> vertices;
-		std::vector<unsigned int> indices;
-		std::vector<Texture> textures;
+		Timer timer;
+		int64_t sourceTime;
+		GetFileStamp(path.c_str(), s->sourceSize, sourceTime);
+		s->cacheKey = MeshCache::KeyFor(path, MODEL_IMPORT_FLAGS, s->buildFlags, s->sourceHash);
+		s->profile->add(ImportStage::SourceHash, timer.elapsedMs(), (size_t)s->sourceSize);
+		timer.reset();
+		std::string cachePath = AssetCache::Shared().find(s->cacheKey);
+		if (cachePath.empty() || !s->cache.Open(cachePath, MODEL_IMPORT_FLAGS, s->buildFlags, s->sourceHash))
+			return false;
+		uint64_t cacheSize = 0;
+		int64_t cacheTime;
+		GetFileStamp(cachePath.c_str(), cacheSize, cacheTime);
+		const MeshCacheHeader &header = s->cache.Header();
+		s->profile->add(ImportStage::CacheRead, timer.elapsedMs(), (size_t)cacheSize, header.meshCount);
 
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-		{
-			Vertex vertex;
+		std::vector<std::pair<glm::vec3, glm::vec3> > bounds;
+		const MeshCacheMesh *records = s->cache.Meshes();
+		for (uint32_t i = 0; i < header.meshCount; i++)
+			bounds.push_back(std::make_pair(glm::vec3(records[i].boundsMin[0], records[i].boundsMin[1], records[i].boundsMin[2]),
+				glm::vec3(records[i].boundsMax[0], records[i].boundsMax[1], records[i].boundsMax[2])));
+		std::lock_guard<std::mutex> lock(s->mutex);
+		s->bounds = bounds;
+		s->fromCache = true;
+		s->finished = true;
+		return true;
+	}
 
-			glm::vec3 vector;
-			vector.x = mesh->mVertices[i].x;
-			vector.y = mesh->mVertices[i].y;
-			vector.z = mesh->mVertices[i].z;
-			vertex.Position = vector;
+	static void publishBounds(Streaming *s, const std::vector<std::pair<glm::vec3, glm::vec3> > &bounds)
+	{
+		std::lock_guard<std::mutex> lock(s->mutex);
+		s->bounds = bounds;
+	}
 
-			vector.x = mesh->mNormals[i].x;
-			vector.y = mesh->mNormals[i].y;
-			vector.z = mesh->mNormals[i].z;
-			vertex.Normal = vector;
+	// the build steps of a converted mesh, then queues it for upload
+	static void finishMesh(Streaming *s, const std::shared_ptr<MeshData> &data, const std::pair<glm::vec3, glm::vec3> &bounds)
+	{
+		if (s->buildFlags & MESH_BUILD_OPTIMIZED)
+			optimizeMesh(*data, *s);
+		// before the levels of detail are appended, meshlets only cover level 0
+		if (s->buildFlags & MESH_BUILD_MESHLETS)
+			buildMeshlets(*data, *s);
+		if (s->buildFlags & MESH_BUILD_LODS)
+			buildLods(*data, *s);
+		data->boundsMin = bounds.first;
+		data->boundsMax = bounds.second;
+		if (s->buildFlags & MESH_BUILD_QUANTIZED)
+		{
+			Timer timer;
+			PackVertices(data->vertices, data->boundsMin, data->boundsMax, data->packedVertices, data->texCoordMin, data->texCoordMax);
+			std::vector<Vertex>().swap(data->vertices);
+			s->profile->add(ImportStage::Quantize, timer.elapsedMs(), data->packedVertices.size() * sizeof(PackedVertex));
+		}
 
-			vector.x = mesh->mTangents[i].x;
-			vector.y = mesh->mTangents[i].y;
-			vector.z = mesh->mTangents[i].z;
-			vertex.Tangent = vector;
+		std::lock_guard<std::mutex> lock(s->mutex);
+		s->ready.push_back(data);
+	}
 
-			if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+	// stores the processed meshes in the AssetCache for the next launch and lets the GL thread finish up
+	static void finishImport(Streaming *s, std::vector<std::shared_ptr<MeshData> > &processed)
+	{
+		if (!s->cacheKey.empty() && !s->cancel)
+		{
+			Timer timer;
+			AssetCache &cache = AssetCache::Shared();
+			std::string staging = cache.stagingPath(s->cacheKey);
+			uint64_t cacheSize = 0;
+			int64_t cacheTime;
+			bool written = MeshCache::Write(staging, processed, MODEL_IMPORT_FLAGS, s->buildFlags, s->sourceHash, s->dependencies) &&
+				GetFileStamp(staging.c_str(), cacheSize, cacheTime);
+			if (!written)
 			{
-				glm::vec2 vec;
-				vec.x = mesh->mTextureCoords[0][i].x;
-				vec.y = mesh->mTextureCoords[0][i].y;
-				vertex.TexCoords = vec;
+				std::cout << "ERROR::MESHCACHE::WRITE_FAILED " << staging << std::endl;
+				cache.discard(staging);
 			}
-			else
-				vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+			else if (cache.commit(staging, s->cacheKey))
+				s->profile->add(ImportStage::CacheWrite, timer.elapsedMs(), (size_t)cacheSize);
+		}
+		processed.clear();
+
+		// from here on the meshes still queued belong to the GL thread, see Update
+		std::lock_guard<std::mutex> lock(s->mutex);
+		s->finished = true;
+	}
+
+	static void processNode(aiNode *node, const aiScene *scene, std::vector<const aiMesh*> &order, size_t &nodes)
+	{
+		nodes++;
+		// process all the node's meshes (if any)
+		for (unsigned int i = 0; i < node->mNumMeshes; i++)
+			order.push_back(scene->mMeshes[node->mMeshes[i]]);
+		// then do the same for each of its children
+		for (unsigned int i = 0; i < node->mNumChildren; i++)
+		{
+			processNode(node->mChildren[i], scene, order, nodes);
+		}
+	}
 
-			vertices.push_back(vertex);			
+	static void computeBounds(const aiMesh *mesh, glm::vec3 &boundsMin, glm::vec3 &boundsMax)
+	{
+		boundsMin = glm::vec3(0.0f);
+		boundsMax = glm::vec3(0.0f);
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+		{
+			glm::vec3 position(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+			boundsMin = i ? glm::min(boundsMin, position) : position;
+			boundsMax = i ? glm::max(boundsMax, position) : position;
 		}
+	}
 
-		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+	static void computeBounds(const std::vector<Vertex> &vertices, glm::vec3 &boundsMin, glm::vec3 &boundsMax)
+	{
+		boundsMin = glm::vec3(0.0f);
+		boundsMax = glm::vec3(0.0f);
+		for (size_t i = 0; i < vertices.size(); i++)
 		{
-			aiFace face = mesh->mFaces[i];
-			for (unsigned int j = 0; j < face.mNumIndices; j++)
-				indices.push_back(face.mIndices[j]);
+			boundsMin = i ? glm::min(boundsMin, vertices[i].Position) : vertices[i].Position;
+			boundsMax = i ? glm::max(boundsMax, vertices[i].Position) : vertices[i].Position;
 		}
+	}
 
+	static void processMesh(const aiMesh *mesh, const aiScene *scene, MeshData &data)
+	{
+		// sized once up front, every vertex and index is then written in place
+		data.vertices.resize(mesh->mNumVertices);
+		convertVertices(mesh, data.vertices.data());
+
+		std::vector<unsigned int> &indices = data.indices;
+		if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+		{
+			// only triangles (the common case after aiProcess_Triangulate), every face is exactly 3 indices
+			indices.resize((size_t)mesh->mNumFaces * 3);
+			unsigned int *out = indices.data();
+			for (unsigned int i = 0; i < mesh->mNumFaces; i++, out += 3)
+				std::memcpy(out, mesh->mFaces[i].mIndices, 3 * sizeof(unsigned int));
+		}
+		else
+		{
+			size_t count = 0;
+			for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+				count += mesh->mFaces[i].mNumIndices;
+			indices.resize(count);
+			unsigned int *out = indices.data();
+			for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+			{
+				const aiFace &face = mesh->mFaces[i];
+				std::memcpy(out, face.mIndices, face.mNumIndices * sizeof(unsigned int));
+				out += face.mNumIndices;
+			}
+		}
 
 		// process material
 		if (mesh->mMaterialIndex >= 0)
 		{
 			aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
 
-			std::vector<Texture> diffuseMaps = this->loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-			textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+			collectMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data.textures);
+			collectMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", data.textures);
+			collectMaterialTextures(material, aiTextureType_AMBIENT, "texture_reflection", data.textures);
+			collectMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", data.textures);
+		}
+	}
 
-			std::vector<Texture> specularMaps = this->loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-			textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+	static void collectMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName, std::vector<TextureRef> &textures)
+	{
+		for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+		{
+			aiString str;
+			mat->GetTexture(type, i, &str);
+			textures.push_back({ typeName, str.C_Str() });
+		}
+	}
 
-			std::vector<Texture> reflectionMaps = this->loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_reflection");
-			textures.insert(textures.end(), reflectionMaps.begin(), reflectionMaps.end());
+	static bool isBlendFile(const std::string &path)
+	{
+		std::string extension = path.substr(path.find_last_of('.') + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		return path.find('.') != std::string::npos && extension == "blend";
+	}
 
-			std::vector<Texture> normalMaps = this->loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-			textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+	// native .blend import, see BlendFile.h: every mesh object in world space, turned Y up the way Blender's FBX
+	// export does it and split into a mesh per material slot. False when the file or its layout can't be read
+	static bool readBlend(const std::string &path, std::vector<std::shared_ptr<MeshData> > &converted, ImportProfiler *profile)
+	{
+		Timer timer;
+		BlendFile blend;
+		if (!blend.open(path.c_str()))
+			return false;
+		if (profile)
+			profile->add(ImportStage::Parse, timer.elapsedMs(), blend.size(), blend.blocks().size());
+		// Blender 2.63 up to 3.3 store meshes as vertices, loops and polygons; older files only have tessellated
+		// faces and newer ones keep everything in generic attribute layers, Assimp is left to deal with those
+		const BlendStruct *object = blend.structNamed("Object");
+		const BlendStruct *mesh = blend.structNamed("Mesh");
+		if (!object || !mesh || !mesh->field("mvert") || !mesh->field("mpoly") || !mesh->field("mloop") ||
+			!blend.structNamed("MVert") || !blend.structNamed("MPoly") || !blend.structNamed("MLoop"))
+		{
+			std::cout << "ERROR::BLEND::LAYOUT no vertex/loop/polygon meshes in version " << blend.version() << " " << path << std::endl;
+			return false;
 		}
 
-		return Mesh(vertices, indices, textures);
+		for (const BlendBlock &block : blend.blocks())
+		{
+			if (std::memcmp(block.code, "OB\0\0", 4) != 0 || block.type != object)
+				continue;
+			for (uint32_t i = 0; i < block.count; i++)
+			{
+				timer.reset();
+				size_t first = converted.size();
+				// Blender 3.4 to 3.6 still describe MVert but leave mvert null and write attribute layers instead
+				if (!readBlendObject(blend, block.data + i * object->size, converted))
+				{
+					std::cout << "ERROR::BLEND::LAYOUT a mesh without vertex/loop/polygon arrays in version " << blend.version() << " " << path << std::endl;
+					converted.clear();
+					return false;
+				}
+				size_t bytes = 0;
+				for (size_t m = first; m < converted.size(); m++)
+					bytes += dataBytes(*converted[m]);
+				if (profile && converted.size() > first)
+					profile->add(ImportStage::Convert, timer.elapsedMs(), bytes, converted.size() - first);
+			}
+		}
+		if (converted.empty())
+		{
+			std::cout << "ERROR::BLEND::NO_MESHES " << path << std::endl;
+			return false;
+		}
+		return true;
 	}
 
-	std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName)
+	// false for a mesh object this reader can't take apart, anything else that isn't a mesh is skipped
+	static bool readBlendObject(const BlendFile &blend, const unsigned char *object, std::vector<std::shared_ptr<MeshData> > &converted)
 	{
-		std::vector<Texture> textures;
-		for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+		const int OB_MESH = 1;
+		const int ME_SMOOTH = 1;
+		const BlendStruct &objectType = *blend.structNamed("Object");
+		if (blend.integer(object, objectType.field("type")) != OB_MESH)
+			return true;
+		const BlendStruct &meshType = *blend.structNamed("Mesh");
+		const BlendBlock *meshBlock = blend.find(blend.pointer(object, objectType.field("data")));
+		if (!meshBlock || meshBlock->type != &meshType)
+			return false;
+		const unsigned char *mesh = meshBlock->data;
+
+		// obmat is the object's world matrix, column after column like glm's; Blender is Z up
+		const BlendField *obmat = objectType.field("obmat");
+		glm::mat4 world(1.0f);
+		for (int column = 0; column < 4 && obmat && obmat->count == 16; column++)
+			for (int row = 0; row < 4; row++)
+				world[column][row] = blend.real(object, obmat, column * 4 + row);
+		glm::mat4 yUp(1.0f);
+		yUp[1] = glm::vec4(0.0f, 0.0f, -1.0f, 0.0f);
+		yUp[2] = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+		const glm::mat4 transform = yUp * world;
+		const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+		// a mirroring scale turns the winding around
+		const bool mirrored = glm::determinant(glm::mat3(transform)) < 0.0f;
+
+		const BlendStruct &vertType = *blend.structNamed("MVert");
+		const BlendStruct &polyType = *blend.structNamed("MPoly");
+		const BlendStruct &loopType = *blend.structNamed("MLoop");
+		const BlendStruct *uvType = blend.structNamed("MLoopUV");
+		const BlendField *co = vertType.field("co"), *no = vertType.field("no");
+		const BlendField *loopStart = polyType.field("loopstart"), *loopTotal = polyType.field("totloop");
+		const BlendField *materialNumber = polyType.field("mat_nr"), *polyFlag = polyType.field("flag");
+		const BlendField *loopVertex = loopType.field("v");
+		const BlendField *uv = uvType ? uvType->field("uv") : nullptr;
+		if (!co || co->type != "float" || co->count != 3 || !loopStart || !loopTotal || !loopVertex)
+			return false;
+
+		// every array has to be as long as the mesh says, the loops read from the mapping without further checks
+		const size_t vertexCount = (size_t)std::max(blend.integer(mesh, meshType.field("totvert")), 0);
+		const size_t polyCount = (size_t)std::max(blend.integer(mesh, meshType.field("totpoly")), 0);
+		const size_t loopCount = (size_t)std::max(blend.integer(mesh, meshType.field("totloop")), 0);
+		const BlendBlock *verts = blend.find(blend.pointer(mesh, meshType.field("mvert")));
+		const BlendBlock *polys = blend.find(blend.pointer(mesh, meshType.field("mpoly")));
+		const BlendBlock *loops = blend.find(blend.pointer(mesh, meshType.field("mloop")));
+		const BlendBlock *uvs = blend.find(blend.pointer(mesh, meshType.field("mloopuv")));
+		if (vertexCount == 0 && polyCount == 0)
+			return true;
+		if (!verts || !polys || !loops || verts->size < vertexCount * vertType.size || polys->size < polyCount * polyType.size ||
+			loops->size < loopCount * loopType.size)
+			return false;
+		if (uvs && (!uv || uv->type != "float" || uv->count != 2 || uvs->size < loopCount * uvType->size))
+			uvs = nullptr;
+		const bool haveNormals = no && no->type == "short" && no->count == 3;
+
+		// a mesh per material slot, only the ones a polygon uses are kept
+		const int slotCount = std::max(blend.integer(mesh, meshType.field("totcol")), 1);
+		const BlendBlock *slots = blend.find(blend.pointer(mesh, meshType.field("mat")));
+		std::vector<std::shared_ptr<MeshData> > parts(slotCount);
+
+		// loops share a vertex when they agree on the Blender vertex, the texture coordinate and, for flat
+		// shaded polygons, the polygon; the candidates of every Blender vertex are chained through next
+		struct Corner
 		{
-			aiString str;
-			mat->GetTexture(type, i, &str);
-			// check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-			bool skip = false;
-			for (unsigned int j = 0; j < textures_loaded.size(); j++)
+			int next;
+			int part;
+			unsigned int index;
+			float u, v;
+			int face;
+		};
+		std::vector<int> first(vertexCount, -1);
+		std::vector<Corner> corners;
+		corners.reserve(loopCount);
+		std::vector<unsigned int> polygon;
+
+		for (size_t p = 0; p < polyCount; p++)
+		{
+			const unsigned char *poly = polys->data + p * polyType.size;
+			const int start = blend.integer(poly, loopStart), total = blend.integer(poly, loopTotal);
+			if (start < 0 || total < 3 || (size_t)start + total > loopCount)
+				continue;
+			const int part = std::min(std::max(blend.integer(poly, materialNumber), 0), slotCount - 1);
+			const int face = blend.integer(poly, polyFlag) & ME_SMOOTH ? -1 : (int)p;
+			if (!parts[part])
+				parts[part] = std::make_shared<MeshData>();
+			MeshData &data = *parts[part];
+
+			// Newell's normal holds for any planar (and near enough for slightly bent) polygon
+			glm::vec3 faceNormal(0.0f);
+			if (face >= 0 || !haveNormals)
 			{
-				if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+				for (int k = 0; k < total; k++)
 				{
-					textures.push_back(textures_loaded[j]);
-					skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
+					const unsigned int a = (unsigned int)blend.integer(loops->data + (start + k) * loopType.size, loopVertex);
+					const unsigned int b = (unsigned int)blend.integer(loops->data + (start + (k + 1) % total) * loopType.size, loopVertex);
+					if (a >= vertexCount || b >= vertexCount)
+						continue;
+					glm::vec3 pa, pb;
+					std::memcpy(&pa.x, verts->data + a * vertType.size + co->offset, sizeof(glm::vec3));
+					std::memcpy(&pb.x, verts->data + b * vertType.size + co->offset, sizeof(glm::vec3));
+					faceNormal += glm::vec3((pa.y - pb.y) * (pa.z + pb.z), (pa.z - pb.z) * (pa.x + pb.x), (pa.x - pb.x) * (pa.y + pb.y));
+				}
+				faceNormal = normalMatrix * faceNormal;
+				if (glm::dot(faceNormal, faceNormal) > 0.0f)
+					faceNormal = glm::normalize(faceNormal);
+			}
+
+			polygon.clear();
+			for (int k = 0; k < total; k++)
+			{
+				const unsigned int vertex = (unsigned int)blend.integer(loops->data + (start + k) * loopType.size, loopVertex);
+				if (vertex >= vertexCount)
 					break;
+				float u = 0.0f, v = 0.0f;
+				if (uvs)
+				{
+					const unsigned char *loopUV = uvs->data + (start + k) * uvType->size + uv->offset;
+					std::memcpy(&u, loopUV, sizeof(float));
+					std::memcpy(&v, loopUV + sizeof(float), sizeof(float));
+				}
+				int found = first[vertex];
+				while (found >= 0 && !(corners[found].part == part && corners[found].face == face && corners[found].u == u && corners[found].v == v))
+					found = corners[found].next;
+				if (found >= 0)
+				{
+					polygon.push_back(corners[found].index);
+					continue;
 				}
+
+				const unsigned char *source = verts->data + vertex * vertType.size;
+				glm::vec3 position;
+				std::memcpy(&position.x, source + co->offset, sizeof(glm::vec3));
+				Vertex out;
+				out.Position = glm::vec3(transform * glm::vec4(position, 1.0f));
+				out.Normal = faceNormal;
+				if (face < 0 && haveNormals)
+				{
+					int16_t normal[3];
+					std::memcpy(normal, source + no->offset, sizeof(normal));
+					out.Normal = normalMatrix * glm::vec3(normal[0], normal[1], normal[2]);
+					if (glm::dot(out.Normal, out.Normal) > 0.0f)
+						out.Normal = glm::normalize(out.Normal);
+				}
+				// flipped like aiProcess_FlipUVs does for every other format
+				out.TexCoords = glm::vec2(u, 1.0f - v);
+				out.Tangent = glm::vec3(0.0f);
+				corners.push_back({ first[vertex], part, (unsigned int)data.vertices.size(), u, v, face });
+				first[vertex] = (int)corners.size() - 1;
+				polygon.push_back((unsigned int)data.vertices.size());
+				data.vertices.push_back(out);
 			}
-			if (!skip)
-			{   // if texture hasn't been loaded already, load it
-				Texture texture;
-				texture.id = TextureFromFile(str.C_Str(), directory);
-				texture.type = typeName;
-				texture.path = str.C_Str();
-				textures.push_back(texture);
-				textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+			// a triangle fan, which is only right for convex polygons: what Blender's quads and most ngons are
+			for (size_t k = 1; polygon.size() == (size_t)total && k + 1 < polygon.size(); k++)
+			{
+				data.indices.push_back(polygon[0]);
+				data.indices.push_back(polygon[mirrored ? k + 1 : k]);
+				data.indices.push_back(polygon[mirrored ? k : k + 1]);
 			}
 		}
-		return textures;
+
+		for (int part = 0; part < slotCount; part++)
+		{
+			if (!parts[part] || parts[part]->indices.empty())
+				continue;
+			computeTangents(*parts[part]);
+			if (slots && (size_t)(part + 1) * blend.pointerSize() <= slots->size)
+				readBlendMaterial(blend, blend.pointer(slots->data + part * blend.pointerSize()), parts[part]->textures);
+			converted.push_back(parts[part]);
+		}
+		return true;
+	}
+
+	// image textures of a Blender Internal material, node based (Cycles, 2.8 and up) materials have no texture slots to read
+	static void readBlendMaterial(const BlendFile &blend, uint64_t address, std::vector<TextureRef> &textures)
+	{
+		const int TEX_IMAGE = 8;
+		const int MAP_COL = 1, MAP_NORM = 2, MAP_COLSPEC = 4, MAP_COLMIR = 8, MAP_SPEC = 32;
+		const BlendStruct *materialType = blend.structNamed("Material");
+		const BlendStruct *slotType = blend.structNamed("MTex");
+		const BlendStruct *textureType = blend.structNamed("Tex");
+		const BlendStruct *imageType = blend.structNamed("Image");
+		const BlendBlock *material = blend.find(address);
+		if (!material || material->type != materialType || !slotType || !textureType || !imageType)
+			return;
+		const BlendField *slots = materialType->field("mtex");
+		const BlendField *imagePath = imageType->field("name") ? imageType->field("name") : imageType->field("filepath");
+		for (size_t i = 0; slots && i < slots->count; i++)
+		{
+			const BlendBlock *slot = blend.find(blend.pointer(material->data, slots, i));
+			if (!slot || slot->type != slotType)
+				continue;
+			const BlendBlock *texture = blend.find(blend.pointer(slot->data, slotType->field("tex")));
+			if (!texture || texture->type != textureType || blend.integer(texture->data, textureType->field("type")) != TEX_IMAGE)
+				continue;
+			const BlendBlock *image = blend.find(blend.pointer(texture->data, textureType->field("ima")));
+			if (!image || image->type != imageType)
+				continue;
+			std::string path = blendTexturePath(blend.string(image->data, imagePath));
+			if (path.empty())
+				continue;
+			const int mapTo = blend.integer(slot->data, slotType->field("mapto"));
+			if (mapTo & MAP_COL)
+				textures.push_back({ "texture_diffuse", path });
+			if (mapTo & (MAP_SPEC | MAP_COLSPEC))
+				textures.push_back({ "texture_specular", path });
+			if (mapTo & MAP_COLMIR)
+				textures.push_back({ "texture_reflection", path });
+			if (mapTo & MAP_NORM)
+				textures.push_back({ "texture_normal", path });
+		}
+	}
+
+	// image paths starting with // are relative to the .blend, like the model's textures are to its directory;
+	// absolute ones usually point into the author's machine, so only their file name is kept
+	static std::string blendTexturePath(std::string path)
+	{
+		std::replace(path.begin(), path.end(), '\\', '/');
+		if (path.compare(0, 2, "//") == 0)
+			return path.substr(2);
+		if (!path.empty() && (path[0] == '/' || (path.size() > 1 && path[1] == ':')))
+			return path.substr(path.find_last_of('/') + 1);
+		return path;
+	}
+
+	// per vertex tangents from the triangles' texture coordinate gradients, like aiProcess_CalcTangentSpace
+	static void computeTangents(MeshData &data)
+	{
+		for (size_t i = 0; i + 2 < data.indices.size(); i += 3)
+		{
+			Vertex &a = data.vertices[data.indices[i]], &b = data.vertices[data.indices[i + 1]], &c = data.vertices[data.indices[i + 2]];
+			glm::vec3 edge1 = b.Position - a.Position, edge2 = c.Position - a.Position;
+			glm::vec2 delta1 = b.TexCoords - a.TexCoords, delta2 = c.TexCoords - a.TexCoords;
+			float determinant = delta1.x * delta2.y - delta2.x * delta1.y;
+			if (determinant == 0.0f)
+				continue;
+			glm::vec3 tangent = (edge1 * delta2.y - edge2 * delta1.y) / determinant;
+			a.Tangent += tangent;
+			b.Tangent += tangent;
+			c.Tangent += tangent;
+		}
+		for (Vertex &vertex : data.vertices)
+		{
+			glm::vec3 tangent = vertex.Tangent - vertex.Normal * glm::dot(vertex.Normal, vertex.Tangent);
+			vertex.Tangent = glm::dot(tangent, tangent) > 0.0f ? glm::normalize(tangent) : glm::vec3(0.0f);
+		}
+	}
+
+	// reorders the indices for the post-transform vertex cache and overdraw, then the vertices into fetch order,
+	// see MeshOptimizer.h
+	static void optimizeMesh(MeshData &data, Streaming &s)
+	{
+		size_t triangles = data.indices.size() / 3;
+		if (!triangles)
+			return;
+		Timer timer;
+		s.acmrBefore += VertexCacheACMR(data.indices.data(), data.indices.size(), data.vertices.size()) * triangles;
+
+		OptimizeVertexCache(data.indices.data(), data.indices.size(), data.vertices.size());
+		OptimizeOverdraw(data.indices.data(), data.indices.size(), &data.vertices[0].Position.x, sizeof(Vertex), data.vertices.size());
+		data.vertices.resize(OptimizeVertexFetch(data.vertices.data(), data.vertices.size(), sizeof(Vertex), data.indices.data(), data.indices.size()));
+
+		s.acmrAfter += VertexCacheACMR(data.indices.data(), data.indices.size(), data.vertices.size()) * triangles;
+		s.optimizedTriangles += triangles;
+		s.profile->add(ImportStage::Optimize, timer.elapsedMs(), dataBytes(data));
 	}
 
-	unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma = false)
+	// reorders the indices into meshlets, see MeshletBuilder.h
+	static void buildMeshlets(MeshData &data, Streaming &s)
 	{
-		std::string filename = std::string(path);
-		filename = directory + '/' + filename;
+		if (data.indices.size() < 3 || data.vertices.empty())
+			return;
+		Timer timer;
+		BuildMeshlets(data.indices.data(), data.indices.size(), &data.vertices[0].Position.x, sizeof(Vertex), data.vertices.size(), data.meshlets);
+		s.meshletCount += data.meshlets.size();
+		s.meshletTriangles += data.indices.size() / 3;
+		s.profile->add(ImportStage::Meshlets, timer.elapsedMs(), data.meshlets.size() * sizeof(Meshlet));
+	}
 
-		unsigned int textureID;
-		glGenTextures(1, &textureID);
+	// appends each level of detail to the indices, every one simplified from the previous to about half its
+	// triangles; stops early once a level would shrink by less than a quarter or err by MODEL_LOD_MAX_ERROR
+	static void buildLods(MeshData &data, Streaming &s)
+	{
+		const size_t baseCount = data.indices.size();
+		data.lods.assign(1, { 0, (unsigned int)baseCount, 0.0f });
+		if (baseCount < 3 || data.vertices.empty())
+			return;
+		Timer timer;
+		std::vector<unsigned int> source(data.indices);
+		std::vector<unsigned int> level(baseCount);
+		for (unsigned int lod = 1; lod < MESH_MAX_LODS; lod++)
+		{
+			float error;
+			size_t count = SimplifyMesh(level.data(), source.data(), source.size(), &data.vertices[0].Position.x, sizeof(Vertex),
+				data.vertices.size(), source.size() / 2, MODEL_LOD_MAX_ERROR, &error);
+			if (count == 0 || count > source.size() * 3 / 4)
+				break;
+			OptimizeVertexCache(level.data(), count, data.vertices.size());
+			// each level's error is measured against the one before, add them up for the distance to level 0
+			data.lods.push_back({ (unsigned int)data.indices.size(), (unsigned int)count, data.lods.back().error + error });
+			data.indices.insert(data.indices.end(), level.begin(), level.begin() + count);
+			source.assign(level.begin(), level.begin() + count);
+		}
+		s.profile->add(ImportStage::Lods, timer.elapsedMs(), (data.indices.size() - baseCount) * sizeof(unsigned int));
+	}
 
-		int width, height, nrComponents;
-		unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-		if (data)
+	// interleaves Assimp's separate position, normal, texture coordinate and tangent arrays into Vertex;
+	// missing normals, tangents or texture coordinates come out as zero
+	static void convertVertices(const aiMesh *mesh, Vertex *out)
+	{
+		const unsigned int count = mesh->mNumVertices;
+		const aiVector3D *texCoords = mesh->mTextureCoords[0];
+		unsigned int converted = 0;
+#ifdef MODEL_SSE
+		static_assert(sizeof(aiVector3D) == 12 && sizeof(Vertex) == 44, "vertex conversion assumes packed float streams");
+		if (count > 0 && mesh->mNormals && mesh->mTangents && texCoords)
 		{
-			GLenum format;
-			if (nrComponents == 1)
-				format = GL_RED;
-			else if (nrComponents == 3)
-				format = GL_RGB;
-			else if (nrComponents == 4)
-				format = GL_RGBA;
+			// 16 byte loads and stores over 12 byte fields: each store spills into the field written after it and
+			// the tangent into the next vertex's position, so the last vertex is left to the scalar loop
+			converted = count - 1;
+			for (unsigned int i = 0; i < converted; i++)
+			{
+				float *dst = (float*)&out[i];
+				_mm_storeu_ps(dst + 0, _mm_loadu_ps(&mesh->mVertices[i].x));
+				_mm_storeu_ps(dst + 3, _mm_loadu_ps(&mesh->mNormals[i].x));
+				_mm_storel_pi((__m64*)(dst + 6), _mm_loadu_ps(&texCoords[i].x));
+				_mm_storeu_ps(dst + 8, _mm_loadu_ps(&mesh->mTangents[i].x));
+			}
+		}
+#endif
+		for (unsigned int i = converted; i < count; i++)
+		{
+			Vertex &vertex = out[i];
+			vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+			vertex.Normal = mesh->mNormals ? glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z) : glm::vec3(0.0f);
+			vertex.TexCoords = texCoords ? glm::vec2(texCoords[i].x, texCoords[i].y) : glm::vec2(0.0f);
+			vertex.Tangent = mesh->mTangents ? glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z) : glm::vec3(0.0f);
+		}
+	}
 
-			glBindTexture(GL_TEXTURE_2D, textureID);
-			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-			glGenerateMipmap(GL_TEXTURE_2D);
+	static size_t dataBytes(const MeshData &data)
+	{
+		return data.vertices.size() * sizeof(Vertex) + data.indices.size() * sizeof(unsigned int);
+	}
 
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	static size_t meshBytes(const Mesh &mesh)
+	{
+		return (size_t)mesh.vertexCount * mesh.VertexStride() + (size_t)mesh.indexCount * mesh.IndexSize();
+	}
+
+	// GL half: turns converted mesh data into a Mesh and resolves its textures; owned once the import
+	// thread no longer reads data, its buffers are then taken instead of copied
+	void addMesh(const std::shared_ptr<MeshData> &data, bool owned)
+	{
+		std::vector<Texture> textures;
+		for (const TextureRef &ref : data->textures)
+			textures.push_back(loadTexture(ref.path.c_str(), ref.type));
 
-			stbi_image_free(data);
+		if (!data->packedVertices.empty())
+		{
+			meshes.emplace_back(data->packedVertices.data(), data->packedVertices.size(), data->indices.data(), data->indices.size(),
+				std::move(textures), data->boundsMin, data->boundsMax, data->texCoordMin, data->texCoordMax);
 		}
+		else if (owned)
+			meshes.emplace_back(std::move(data->vertices), std::move(data->indices), std::move(textures));
 		else
+			meshes.emplace_back(data->vertices, data->indices, std::move(textures));
+		meshes.back().boundsMin = data->boundsMin;
+		meshes.back().boundsMax = data->boundsMax;
+		if (!data->lods.empty())
+			meshes.back().lods = data->lods;
+		meshes.back().meshlets = data->meshlets;
+	}
+
+	void addCachedMesh(const MeshCache &cache, const MeshCacheMesh &record)
+	{
+		const MeshCacheTexture *textureRefs = cache.Textures();
+		std::vector<Texture> textures;
+		for (uint32_t t = 0; t < record.textureCount; t++)
+		{
+			const MeshCacheTexture &ref = textureRefs[record.firstTexture + t];
+			textures.push_back(loadTexture(cache.String(ref.pathOffset), cache.String(ref.typeOffset)));
+		}
+		glm::vec3 boundsMin(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+		glm::vec3 boundsMax(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+		if (cache.Header().buildFlags & MESH_BUILD_QUANTIZED)
+		{
+			meshes.emplace_back(cache.PackedVertices() + record.firstVertex, record.vertexCount, cache.Indices() + record.firstIndex, record.indexCount,
+				std::move(textures), boundsMin, boundsMax, glm::vec2(record.texCoordMin[0], record.texCoordMin[1]), glm::vec2(record.texCoordMax[0], record.texCoordMax[1]));
+		}
+		else
+		{
+			meshes.emplace_back(cache.Vertices() + record.firstVertex, record.vertexCount,
+				cache.Indices() + record.firstIndex, record.indexCount, std::move(textures));
+			meshes.back().boundsMin = boundsMin;
+			meshes.back().boundsMax = boundsMax;
+		}
+		if (record.lodCount > 1)
+			meshes.back().lods = MeshCache::Lods(record);
+		if (record.meshletCount)
+			meshes.back().meshlets.assign(cache.Meshlets() + record.firstMeshlet, cache.Meshlets() + record.firstMeshlet + record.meshletCount);
+	}
+
+	// one box per mesh, drawn until the mesh itself is uploaded
+	void buildPlaceholder()
+	{
+		std::vector<std::pair<glm::vec3, glm::vec3> > bounds;
 		{
-			std::cout << "Texture failed to load at path: " << path << std::endl;
-			stbi_image_free(data);
+			std::lock_guard<std::mutex> lock(streaming->mutex);
+			if (streaming->bounds.empty())
+				return;
+			bounds = streaming->bounds;
 		}
 
-		return textureID;
+		static const unsigned int boxIndices[PLACEHOLDER_INDICES] = {
+			0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,  0, 1, 4, 1, 5, 4,
+			2, 6, 3, 3, 6, 7,  0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5
+		};
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		for (const std::pair<glm::vec3, glm::vec3> &box : bounds)
+		{
+			unsigned int base = (unsigned int)vertices.size();
+			glm::vec3 center = (box.first + box.second) * 0.5f;
+			for (int corner = 0; corner < 8; corner++)
+			{
+				Vertex vertex;
+				vertex.Position = glm::vec3(corner & 4 ? box.second.x : box.first.x, corner & 2 ? box.second.y : box.first.y, corner & 1 ? box.second.z : box.first.z);
+				glm::vec3 outward = vertex.Position - center;
+				vertex.Normal = glm::length(outward) > 0.0f ? glm::normalize(outward) : glm::vec3(0.0f, 1.0f, 0.0f);
+				vertex.TexCoords = glm::vec2(0.0f);
+				vertex.Tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+				vertices.push_back(vertex);
+			}
+			for (unsigned int i = 0; i < PLACEHOLDER_INDICES; i++)
+				indices.push_back(base + boxIndices[i]);
+		}
+
+		unsigned int grey = TextureCache::Shared().Placeholder();
+		std::vector<Texture> textures = { { grey, "texture_diffuse", "" }, { grey, "texture_specular", "" } };
+		streaming->placeholder.reset(new Mesh(std::move(vertices), std::move(indices), std::move(textures)));
+		streaming->placeholderCount = bounds.size();
+	}
+
+	// allocates the shared buffers and has every mesh copy its geometry over on the GPU; meshes stream in with
+	// their own buffers first so they can be drawn while the rest is still loading
+	void mergeBuffers()
+	{
+		if (meshes.empty())
+			return;
+		// 32 bit index ranges have to start 4 byte aligned
+		size_t vertexBytes = 0, indexBytes = 0;
+		for (const Mesh &mesh : meshes)
+		{
+			vertexBytes += mesh.vertexCount * mesh.VertexStride();
+			indexBytes = alignIndexOffset(indexBytes) + mesh.indexCount * mesh.IndexSize();
+		}
+
+		glGenVertexArrays(1, &mergedVAO);
+		glGenBuffers(1, &mergedVBO);
+		glGenBuffers(1, &mergedEBO);
+		GLState &state = GLState::Shared();
+		state.BindVertexArray(mergedVAO);
+		state.BindBuffer(GL_ARRAY_BUFFER, mergedVBO);
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes, NULL, GL_STATIC_DRAW);
+		state.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, mergedEBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+		// every mesh of a model has the same layout
+		Mesh::SetupVertexLayout(meshes[0].quantized);
+		state.BindVertexArray(0);
+
+		boundsMin = meshes[0].boundsMin;
+		boundsMax = meshes[0].boundsMax;
+		size_t vertexOffset = 0, indexOffset = 0;
+		for (Mesh &mesh : meshes)
+		{
+			boundsMin = glm::min(boundsMin, mesh.boundsMin);
+			boundsMax = glm::max(boundsMax, mesh.boundsMax);
+			size_t meshVertexBytes = mesh.vertexCount * mesh.VertexStride();
+			size_t meshIndexBytes = mesh.indexCount * mesh.IndexSize();
+			indexOffset = alignIndexOffset(indexOffset);
+			mesh.MoveIntoBuffers(mergedVAO, mergedVBO, vertexOffset, mergedEBO, indexOffset);
+			vertexOffset += meshVertexBytes;
+			indexOffset += meshIndexBytes;
+		}
+		std::cout << "MODEL::MERGE " << modelPath << " " << meshes.size() << " meshes into 1 vertex array, "
+			<< vertexBytes / (1024.0 * 1024.0) << " MB vertices, " << indexBytes / (1024.0 * 1024.0) << " MB indices" << std::endl;
+	}
+
+	static size_t alignIndexOffset(size_t offset)
+	{
+		return (offset + 3) & ~(size_t)3;
+	}
+
+	void reportLods(const Streaming &s) const
+	{
+		size_t triangles[MESH_MAX_LODS] = {};
+		for (const Mesh &mesh : meshes)
+			for (size_t lod = 0; lod < MESH_MAX_LODS; lod++)
+				triangles[lod] += mesh.lods[std::min(lod, mesh.lods.size() - 1)].indexCount / 3;
+		std::cout << "MODEL::LOD " << s.path << " triangles";
+		for (size_t lod = 0; lod < MESH_MAX_LODS; lod++)
+			std::cout << (lod ? " / " : " ") << triangles[lod];
+		if (!s.fromCache)
+			std::cout << " in " << profile.stage(ImportStage::Lods).ms << " ms";
+		std::cout << std::endl;
+	}
+
+	void reportGeometryMemory() const
+	{
+		size_t vertexBytes, indexBytes, wideVertexBytes, wideIndexBytes, shortIndexMeshes;
+		GeometryMemory(vertexBytes, indexBytes, wideVertexBytes, wideIndexBytes, shortIndexMeshes);
+		const double MB = 1024.0 * 1024.0;
+		std::cout << "MODEL::GEOMETRY " << modelPath << " vertices " << vertexBytes / MB << " MB (" << wideVertexBytes / MB << " MB as Vertex), indices "
+			<< indexBytes / MB << " MB (" << wideIndexBytes / MB << " MB as 32 bit), " << shortIndexMeshes << " of " << meshes.size() << " meshes use 16 bit indices" << std::endl;
+	}
+
+	// prints the texture memory once every texture of the model has been uploaded, returns whether it did
+	bool reportTextureMemory()
+	{
+		for (const TextureHandle &handle : textureHandles)
+			if (!handle.get()->loaded)
+				return false;
+
+		size_t resident, uncompressed, compressed;
+		TextureMemory(resident, uncompressed, compressed);
+		const double MB = 1024.0 * 1024.0;
+		std::cout << "MODEL::TEXTURES " << modelPath << " " << textureHandles.size() << " textures (" << compressed << " compressed) "
+			<< resident / MB << " MB, " << (uncompressed - resident) / MB << " MB saved" << std::endl;
+
+		// textures shared with models loaded before count for every one of them
+		for (const TextureHandle &handle : textureHandles)
+		{
+			const TextureCacheEntry &entry = *handle.get();
+			profile.add(ImportStage::TextureDecode, entry.decodeMs, entry.fileBytes);
+			if (entry.mipBytes)
+				profile.add(ImportStage::MipGeneration, entry.mipMs, entry.mipBytes);
+			profile.add(ImportStage::TextureUpload, entry.uploadMs, entry.uploadedBytes);
+		}
+		profile.setTotal(loadTimer.elapsedMs());
+		std::cout << profile.report(modelPath);
+		return true;
+	}
+
+	Texture loadTexture(const char *path, const std::string &typeName)
+	{
+		// check if texture was loaded before and if so, reuse it: skip loading a new texture
+		auto found = loadedLookup.find(path);
+		if (found != loadedLookup.end())
+			return textures_loaded[found->second]; // a texture with the same filepath has already been loaded (optimization)
+
+		// otherwise share it through the process wide cache, which only decodes it if no one else loaded it yet;
+		// new textures show a flat placeholder until their pixels are decoded on the worker pool and uploaded
+		TextureSettings settings;
+		settings.streamed = options.streamTextures;
+		if (typeName == "texture_normal")
+		{
+			settings.normalMap = true;
+			settings.placeholder[0] = 128;
+			settings.placeholder[1] = 128;
+			settings.placeholder[2] = 255;
+		}
+		TextureHandle handle = TextureCache::Shared().Acquire(directory + '/' + path, settings);
+		Texture texture;
+		texture.id = handle.id();
+		texture.type = typeName;
+		texture.path = path;
+		textureHandles.push_back(handle);
+		loadedLookup[texture.path] = textures_loaded.size();
+		textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+		return texture;
 	}
 };
\ No newline at end of file
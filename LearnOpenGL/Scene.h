@@ -0,0 +1,403 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "CubemapLoader.h"
+#include "GLState.h"
+#include "Model.h"
+#include "Shader.h"
+#include "TextureCache.h"
+#include "Utility/Headers/LoadGraph.h"
+#include "Utility/Headers/Timer.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Scene manifest
+// --------------
+// What main.cpp loads and draws, kept in a text file instead of code. One entry per line, '#' starts
+// a comment, paths are relative to the working directory like every other asset path:
+//
+//   shader   <name> <vertex> [<geometry>] <fragment>
+//   block    <shader> <uniform block> <binding point>
+//   texture  <name> <path> [srgb] [normal]
+//   cubemap  <name> <+x> <-x> <+y> <-y> <+z> <-z>   or one cross, .hdr or .ktx file, see CubemapLoader.h
+//   model    <name> <path>
+//   instance <model> <x> <y> <z> [<yaw degrees> [<scale>]]
+//   light    <name> <x> <y> <z> <r> <g> <b> [<ambient> <diffuse> <specular>]
+//
+// Scene::Load turns the entries into a LoadGraph: shaders wait for their source files (read once
+// even when several programs share them), uniform block bindings for their linked program, the
+// texture barrier for every texture. File reads and cubemap decodes run on loader threads as soon
+// as nothing blocks them, compiling, linking and uploading run on the GL context thread. Models
+// are imported asynchronously by Model itself and keep streaming in after the first frame.
+
+struct SceneLight
+{
+	std::string name;
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 color = glm::vec3(1.0f);
+	float ambient = 0.0f;
+	float diffuse = 0.4f;
+	float specular = 2.5f;
+};
+
+struct SceneManifest
+{
+	struct ShaderEntry
+	{
+		std::string name;
+		std::string vertex, geometry, fragment; // geometry may be empty
+	};
+	struct BlockEntry
+	{
+		std::string shader;
+		std::string block;
+		unsigned int binding;
+	};
+	struct TextureEntry
+	{
+		std::string name;
+		std::string path;
+		TextureSettings settings;
+	};
+	struct CubemapEntry
+	{
+		std::string name;
+		std::vector<std::string> faces;
+	};
+	struct ModelEntry
+	{
+		std::string name;
+		std::string path;
+	};
+	struct InstanceEntry
+	{
+		std::string model;
+		glm::mat4 transform;
+	};
+
+	std::string path;
+	std::vector<ShaderEntry> shaders;
+	std::vector<BlockEntry> blocks;
+	std::vector<TextureEntry> textures;
+	std::vector<CubemapEntry> cubemaps;
+	std::vector<ModelEntry> models;
+	std::vector<InstanceEntry> instances;
+	std::vector<SceneLight> lights;
+
+	// false when the file can't be read or a line doesn't parse, every bad line is reported
+	static bool Read(const std::string &path, SceneManifest &manifest)
+	{
+		std::ifstream file(path.c_str());
+		if (!file)
+		{
+			std::cout << "ERROR::SCENE::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+			return false;
+		}
+		manifest = SceneManifest();
+		manifest.path = path;
+		bool ok = true;
+		std::string line;
+		for (int lineNumber = 1; std::getline(file, line); lineNumber++)
+		{
+			size_t comment = line.find('#');
+			if (comment != std::string::npos)
+				line.erase(comment);
+			std::istringstream stream(line);
+			std::vector<std::string> words;
+			std::string word;
+			while (stream >> word)
+				words.push_back(word);
+			if (words.empty())
+				continue;
+			if (!manifest.parseEntry(words))
+			{
+				std::cout << "ERROR::SCENE::PARSE " << path << ":" << lineNumber << " " << line << std::endl;
+				ok = false;
+			}
+		}
+		return ok;
+	}
+
+private:
+	bool parseEntry(const std::vector<std::string> &words)
+	{
+		const std::string &kind = words[0];
+		size_t count = words.size();
+		if (kind == "shader" && (count == 4 || count == 5))
+			shaders.push_back({ words[1], words[2], count == 5 ? words[3] : std::string(), words[count - 1] });
+		else if (kind == "block" && count == 4)
+			blocks.push_back({ words[1], words[2], (unsigned int)std::atoi(words[3].c_str()) });
+		else if (kind == "texture" && count >= 3)
+		{
+			TextureEntry entry;
+			entry.name = words[1];
+			entry.path = words[2];
+			for (size_t i = 3; i < count; i++)
+			{
+				if (words[i] == "srgb")
+					entry.settings.gammaCorrection = true;
+				else if (words[i] == "normal")
+					entry.settings.normalMap = true;
+				else
+					return false;
+			}
+			textures.push_back(entry);
+		}
+		else if (kind == "cubemap" && (count == 3 || count == 8))
+			cubemaps.push_back({ words[1], std::vector<std::string>(words.begin() + 2, words.end()) });
+		else if (kind == "model" && count == 3)
+			models.push_back({ words[1], words[2] });
+		else if (kind == "instance" && count >= 5 && count <= 7)
+		{
+			glm::vec3 position(number(words[2]), number(words[3]), number(words[4]));
+			glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+			if (count > 5)
+				transform = glm::rotate(transform, glm::radians(number(words[5])), glm::vec3(0.0f, 1.0f, 0.0f));
+			if (count > 6)
+				transform = glm::scale(transform, glm::vec3(number(words[6])));
+			instances.push_back({ words[1], transform });
+		}
+		else if (kind == "light" && (count == 8 || count == 11))
+		{
+			SceneLight light;
+			light.name = words[1];
+			light.position = glm::vec3(number(words[2]), number(words[3]), number(words[4]));
+			light.color = glm::vec3(number(words[5]), number(words[6]), number(words[7]));
+			if (count == 11)
+			{
+				light.ambient = number(words[8]);
+				light.diffuse = number(words[9]);
+				light.specular = number(words[10]);
+			}
+			lights.push_back(light);
+		}
+		else
+			return false;
+		return true;
+	}
+
+	static float number(const std::string &word)
+	{
+		return (float)std::atof(word.c_str());
+	}
+};
+
+// a model placed in the scene
+struct SceneObject
+{
+	Model *model;
+	glm::mat4 transform;
+};
+
+class Scene
+{
+public:
+	std::map<std::string, Shader> shaders;
+	std::map<std::string, TextureHandle> textures;
+	std::map<std::string, unsigned int> cubemaps;
+	std::vector<std::unique_ptr<Model> > models; // in manifest order
+	std::map<std::string, Model*> modelsByName;
+	std::vector<SceneObject> objects;
+	std::vector<SceneLight> lights;
+
+	Scene() = default;
+	Scene(const Scene&) = delete;
+	Scene &operator=(const Scene&) = delete;
+	~Scene()
+	{
+		Release();
+	}
+
+	// loads everything the manifest lists and returns once it is ready to draw (models still stream in);
+	// must be called on the GL context thread. parallel = false loads one asset after the other, for comparison
+	bool Load(const SceneManifest &manifest, const ModelOptions &modelOptions, bool parallel = true)
+	{
+		if (!validate(manifest))
+			return false;
+
+		LoadGraph graph;
+		// kept outside the graph's lambdas so the loader threads only ever write to their own, existing slot
+		std::map<std::string, std::string> sources;
+		std::map<std::string, size_t> sourceNodes;
+		std::vector<DecodedCubemap> decodedCubemaps(manifest.cubemaps.size());
+		std::vector<char> cubemapDecoded(manifest.cubemaps.size(), 0);
+		std::map<std::string, size_t> shaderNodes;
+		std::vector<size_t> textureNodes;
+
+		// first, so their import threads are running while everything else loads
+		for (const SceneManifest::ModelEntry &entry : manifest.models)
+		{
+			graph.add("model " + entry.name, LoadGraph::Step(), [this, &entry, &modelOptions]() {
+				models.emplace_back(new Model(entry.path, modelOptions));
+				modelsByName[entry.name] = models.back().get();
+			});
+		}
+
+		for (const SceneManifest::ShaderEntry &entry : manifest.shaders)
+		{
+			std::vector<size_t> dependencies;
+			for (const std::string &path : { entry.vertex, entry.geometry, entry.fragment })
+			{
+				if (path.empty())
+					continue;
+				if (!sourceNodes.count(path))
+				{
+					std::string &code = sources[path];
+					sourceNodes[path] = graph.add("source " + path, [&code, path]() {
+						if (!Shader::ReadSource(path, code))
+							std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+					}, LoadGraph::Step());
+				}
+				dependencies.push_back(sourceNodes[path]);
+			}
+			shaderNodes[entry.name] = graph.add("shader " + entry.name, LoadGraph::Step(), [this, &entry, &sources]() {
+				shaders[entry.name] = Shader::FromSource(sources[entry.vertex], entry.geometry.empty() ? std::string() : sources[entry.geometry], sources[entry.fragment]);
+			}, dependencies);
+		}
+
+		for (const SceneManifest::BlockEntry &entry : manifest.blocks)
+		{
+			graph.add("block " + entry.shader + "." + entry.block, LoadGraph::Step(), [this, &entry]() {
+				unsigned int program = shaders[entry.shader].ID;
+				unsigned int index = glGetUniformBlockIndex(program, entry.block.c_str());
+				if (index == GL_INVALID_INDEX)
+					std::cout << "ERROR::SCENE::UNKNOWN_UNIFORM_BLOCK " << entry.block << " in " << entry.shader << std::endl;
+				else
+					glUniformBlockBinding(program, index, entry.binding);
+			}, { shaderNodes[entry.shader] });
+		}
+
+		// TextureCache decodes on its own worker pool, acquiring only queues the work
+		for (const SceneManifest::TextureEntry &entry : manifest.textures)
+		{
+			textureNodes.push_back(graph.add("texture " + entry.name, LoadGraph::Step(), [this, &entry]() {
+				textures[entry.name] = TextureCache::Shared().Acquire(entry.path, entry.settings);
+			}));
+		}
+
+		for (size_t i = 0; i < manifest.cubemaps.size(); i++)
+		{
+			const SceneManifest::CubemapEntry &entry = manifest.cubemaps[i];
+			DecodedCubemap &decoded = decodedCubemaps[i];
+			char &ok = cubemapDecoded[i];
+			graph.add("cubemap " + entry.name, [&entry, &decoded, &ok]() {
+				ok = DecodeCubemapFiles(entry.faces, decoded);
+			}, [this, &entry, &decoded, &ok]() {
+				if (ok)
+					cubemaps[entry.name] = CreateCubemap(decoded);
+				else
+					std::cout << "ERROR::CUBEMAP::LOAD_FAILED " << entry.name << std::endl;
+				decoded = DecodedCubemap();
+			});
+		}
+
+		// last, the first frame shouldn't show placeholder pixels for the scene's own textures
+		graph.add("textures", LoadGraph::Step(), [this]() {
+			for (auto &texture : textures)
+				TextureCache::Shared().Finish(texture.second);
+		}, textureNodes);
+
+		graph.run(parallel);
+
+		for (const SceneManifest::InstanceEntry &entry : manifest.instances)
+			objects.push_back({ modelsByName[entry.model], entry.transform });
+		lights = manifest.lights;
+		loadMs = graph.elapsedMs();
+
+		const LoadGraph::Node *slowest = nullptr;
+		for (const LoadGraph::Node &node : graph.nodes())
+			if (!slowest || node.workMs + node.finishMs > slowest->workMs + slowest->finishMs)
+				slowest = &node;
+		std::cout << "SCENE::LOAD " << manifest.path << " " << graph.nodes().size() << " assets in " << loadMs << " ms ("
+			<< (parallel ? "parallel" : "sequential") << "), " << graph.workMs() << " ms loading, " << graph.finishMs() << " ms on the GL thread";
+		if (slowest)
+			std::cout << ", slowest " << slowest->name << " " << slowest->workMs + slowest->finishMs << " ms";
+		std::cout << std::endl;
+		return true;
+	}
+
+	// wall clock time Load took
+	double LoadMs() const
+	{
+		return loadMs;
+	}
+
+	// the shader, texture or cubemap the manifest calls name; reports a missing one and hands back an empty stand in
+	Shader &GetShader(const std::string &name)
+	{
+		if (!shaders.count(name))
+			std::cout << "ERROR::SCENE::MISSING_SHADER " << name << std::endl;
+		return shaders[name];
+	}
+	TextureHandle GetTexture(const std::string &name)
+	{
+		if (!textures.count(name))
+			std::cout << "ERROR::SCENE::MISSING_TEXTURE " << name << std::endl;
+		return textures[name];
+	}
+	unsigned int GetCubemap(const std::string &name)
+	{
+		if (!cubemaps.count(name))
+			std::cout << "ERROR::SCENE::MISSING_CUBEMAP " << name << std::endl;
+		return cubemaps[name];
+	}
+
+	// drops every GL object the scene made; textures go away with the last handle to them
+	void Release()
+	{
+		for (auto &shader : shaders)
+			if (shader.second.ID)
+				glDeleteProgram(shader.second.ID);
+		for (auto &cubemap : cubemaps)
+			if (cubemap.second)
+				GLState::Shared().DeleteTexture(cubemap.second);
+		shaders.clear();
+		cubemaps.clear();
+		textures.clear();
+		objects.clear();
+		modelsByName.clear();
+		models.clear();
+	}
+
+private:
+	double loadMs = 0.0;
+
+	// every shader and model an entry refers to has to be declared somewhere in the manifest
+	static bool validate(const SceneManifest &manifest)
+	{
+		bool ok = true;
+		std::map<std::string, bool> shaderNames, modelNames;
+		for (const SceneManifest::ShaderEntry &entry : manifest.shaders)
+			shaderNames[entry.name] = true;
+		for (const SceneManifest::ModelEntry &entry : manifest.models)
+			modelNames[entry.name] = true;
+		for (const SceneManifest::BlockEntry &entry : manifest.blocks)
+		{
+			if (!shaderNames.count(entry.shader))
+			{
+				std::cout << "ERROR::SCENE::UNKNOWN_SHADER " << entry.shader << " in " << manifest.path << std::endl;
+				ok = false;
+			}
+		}
+		for (const SceneManifest::InstanceEntry &entry : manifest.instances)
+		{
+			if (!modelNames.count(entry.model))
+			{
+				std::cout << "ERROR::SCENE::UNKNOWN_MODEL " << entry.model << " in " << manifest.path << std::endl;
+				ok = false;
+			}
+		}
+		return ok;
+	}
+};
@@ -3,15 +3,89 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "GLState.h"
+
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+// how a C++ type is set and which GL uniform types it can set, for Uniform<T>
+template <typename T> struct UniformTraits;
+template <> struct UniformTraits<int>
+{
+	static bool accepts(GLenum type) { return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_CUBE; }
+	static void set(GLint location, const int &value) { glUniform1i(location, value); }
+};
+template <> struct UniformTraits<bool>
+{
+	static bool accepts(GLenum type) { return type == GL_BOOL || type == GL_INT; }
+	static void set(GLint location, const bool &value) { glUniform1i(location, (int)value); }
+};
+template <> struct UniformTraits<float>
+{
+	static bool accepts(GLenum type) { return type == GL_FLOAT; }
+	static void set(GLint location, const float &value) { glUniform1f(location, value); }
+};
+template <> struct UniformTraits<glm::vec2>
+{
+	static bool accepts(GLenum type) { return type == GL_FLOAT_VEC2; }
+	static void set(GLint location, const glm::vec2 &value) { glUniform2fv(location, 1, &value[0]); }
+};
+template <> struct UniformTraits<glm::vec3>
+{
+	static bool accepts(GLenum type) { return type == GL_FLOAT_VEC3; }
+	static void set(GLint location, const glm::vec3 &value) { glUniform3fv(location, 1, &value[0]); }
+};
+template <> struct UniformTraits<glm::vec4>
+{
+	static bool accepts(GLenum type) { return type == GL_FLOAT_VEC4; }
+	static void set(GLint location, const glm::vec4 &value) { glUniform4fv(location, 1, &value[0]); }
+};
+template <> struct UniformTraits<glm::mat3>
+{
+	static bool accepts(GLenum type) { return type == GL_FLOAT_MAT3; }
+	static void set(GLint location, const glm::mat3 &value) { glUniformMatrix3fv(location, 1, GL_FALSE, &value[0][0]); }
+};
+template <> struct UniformTraits<glm::mat4>
+{
+	static bool accepts(GLenum type) { return type == GL_FLOAT_MAT4; }
+	static void set(GLint location, const glm::mat4 &value) { glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]); }
+};
+
+// a uniform of one program resolved by Shader::uniform, meant to be kept rather than looked up every frame;
+// set() writes to whichever program is in use, like Shader's setters. Uniforms the program doesn't have
+// (or that the compiler optimized away) have location -1 and set() does nothing
+template <typename T>
+struct Uniform
+{
+	GLint location = -1;
+
+	void set(const T &value) const
+	{
+		UniformTraits<T>::set(location, value);
+	}
+};
+
+// uniform lookups since the last reset: by name, and those that had to ask GL
+struct UniformLookupStats
+{
+	size_t lookups = 0;
+	size_t glQueries = 0;
+};
 
 class Shader
 {
 public:
 	unsigned int ID;
+	// no program yet, see FromSource
+	Shader() : ID(0)
+	{
+	}
 	// constructor generates the shader on the fly
 	// ------------------------------------------------------------------------
 	Shader(const char* vertexPath, const char* fragmentPath)
@@ -44,30 +118,8 @@ public:
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char * fShaderCode = fragmentCode.c_str();
 		// 2. compile shaders
-		unsigned int vertex, fragment;
-		// vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
-		// fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
-		// shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
-		// delete the shaders as they're linked into our program now and no longer necessery
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-
+		build(vertexCode, std::string(), fragmentCode);
 	}
 
 	Shader(const char* vertexPath, const char* geometryPath, const char* fragmentPath)
@@ -107,105 +159,232 @@ public:
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char* gShaderCode = geometryCode.c_str();
-		const char * fShaderCode = fragmentCode.c_str();
 		// 2. compile shaders
-		unsigned int vertex, geometry, fragment;
-		// vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
-		// geometry shader
-		geometry = glCreateShader(GL_GEOMETRY_SHADER);
-		glShaderSource(geometry, 1, &gShaderCode, NULL);
-		glCompileShader(geometry);
-		checkCompileErrors(geometry, "GEOMETRY");
-		// fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
-		// shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, geometry);
-		glAttachShader(ID, fragment);
-		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
-		// delete the shaders as they're linked into our program now and no longer necessery
-		glDeleteShader(vertex);
-		glDeleteShader(geometry);
-		glDeleteShader(fragment);
+		build(vertexCode, geometryCode, fragmentCode);
+	}
+
+	// compiles and links sources that were already read, e.g. on a loader thread; no geometry shader when geometryCode is empty
+	static Shader FromSource(const std::string &vertexCode, const std::string &geometryCode, const std::string &fragmentCode)
+	{
+		Shader shader;
+		shader.build(vertexCode, geometryCode, fragmentCode);
+		return shader;
+	}
 
+	// whole file into code, false if it can't be read; safe to call from any thread
+	static bool ReadSource(const std::string &path, std::string &code)
+	{
+		std::ifstream file(path.c_str(), std::ios::binary);
+		if (!file)
+			return false;
+		std::stringstream stream;
+		stream << file.rdbuf();
+		code = stream.str();
+		return true;
 	}
+
 	// activate the shader
 	// ------------------------------------------------------------------------
 	void use() const
 	{
-		glUseProgram(ID);
+		GLState::Shared().UseProgram(ID);
+	}
+
+	// location of an active uniform from the table built at link time, -1 for names the program doesn't use;
+	// GL is never asked, so the setters below cost a hash lookup and no driver round trip
+	GLint location(std::string_view name) const
+	{
+		LookupStats().lookups++;
+		if (!uniforms)
+			return -1;
+		auto found = uniforms->lookup.find(name);
+		return found != uniforms->lookup.end() ? found->second.location : -1;
+	}
+
+	// typed handle to resolve once and keep, e.g. Uniform<glm::mat4> model = shader.uniform<glm::mat4>("model");
+	// a handle whose type doesn't match the GLSL declaration is reported and left unresolved
+	template <typename T>
+	Uniform<T> uniform(std::string_view name) const
+	{
+		Uniform<T> handle;
+		if (!uniforms)
+			return handle;
+		auto found = uniforms->lookup.find(name);
+		if (found == uniforms->lookup.end())
+			return handle;
+		if (!UniformTraits<T>::accepts(found->second.type))
+		{
+			std::cout << "ERROR::SHADER::UNIFORM_TYPE " << name << " of program " << ID << std::endl;
+			return handle;
+		}
+		handle.location = found->second.location;
+		return handle;
 	}
+
+	// process wide counters, the main loop shows and resets them every frame
+	static UniformLookupStats &LookupStats()
+	{
+		static UniformLookupStats stats;
+		return stats;
+	}
+
 	// utility uniform functions
 	// ------------------------------------------------------------------------
-	void setBool(const std::string &name, bool value) const
+	void setBool(std::string_view name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		glUniform1i(location(name), (int)value);
 	}
 	// ------------------------------------------------------------------------
-	void setInt(const std::string &name, int value) const
+	void setInt(std::string_view name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1i(location(name), value);
 	}
 	// ------------------------------------------------------------------------
-	void setFloat(const std::string &name, float value) const
+	void setFloat(std::string_view name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1f(location(name), value);
 	}
 	// ------------------------------------------------------------------------
-	void setVec2(const std::string &name, const glm::vec2 &value) const
+	void setVec2(std::string_view name, const glm::vec2 &value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform2fv(location(name), 1, &value[0]);
 	}
-	void setVec2(const std::string &name, float x, float y) const
+	void setVec2(std::string_view name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		glUniform2f(location(name), x, y);
 	}
 	// ------------------------------------------------------------------------
-	void setVec3(const std::string &name, const glm::vec3 &value) const
+	void setVec3(std::string_view name, const glm::vec3 &value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform3fv(location(name), 1, &value[0]);
 	}
-	void setVec3(const std::string &name, float x, float y, float z) const
+	void setVec3(std::string_view name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		glUniform3f(location(name), x, y, z);
 	}
 	// ------------------------------------------------------------------------
-	void setVec4(const std::string &name, const glm::vec4 &value) const
+	void setVec4(std::string_view name, const glm::vec4 &value) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform4fv(location(name), 1, &value[0]);
 	}
-	void setVec4(const std::string &name, float x, float y, float z, float w) const
+	void setVec4(std::string_view name, float x, float y, float z, float w) const
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		glUniform4f(location(name), x, y, z, w);
 	}
 	// ------------------------------------------------------------------------
-	void setMat2(const std::string &name, const glm::mat2 &mat) const
+	void setMat2(std::string_view name, const glm::mat2 &mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
-	void setMat3(const std::string &name, const glm::mat3 &mat) const
+	void setMat3(std::string_view name, const glm::mat3 &mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
-	void setMat4(const std::string &name, const glm::mat4 &mat) const
+	void setMat4(std::string_view name, const glm::mat4 &mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 
 private:
+	struct UniformInfo
+	{
+		GLint location;
+		GLenum type;
+	};
+	// active uniforms by name; the keys view into names, whose strings a deque never moves
+	struct UniformTable
+	{
+		std::deque<std::string> names;
+		std::unordered_map<std::string_view, UniformInfo> lookup;
+
+		void add(std::string name, GLint location, GLenum type)
+		{
+			names.push_back(std::move(name));
+			lookup[names.back()] = { location, type };
+		}
+	};
+	// shared by the copies of a Shader, they all name the same program
+	std::shared_ptr<const UniformTable> uniforms;
+
+	// enumerates the active uniforms of the linked program; arrays are listed by GL as "name[0]" with their
+	// length, each element is added as "name[i]" and the whole array as "name", which GLSL treats as element 0
+	void reflect()
+	{
+		std::shared_ptr<UniformTable> table = std::make_shared<UniformTable>();
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::string name(maxLength > 0 ? maxLength : 1, '\0');
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+			std::string active(name.data(), length);
+			bool array = active.size() > 3 && active.compare(active.size() - 3, 3, "[0]") == 0;
+			std::string base = array ? active.substr(0, active.size() - 3) : active;
+			for (GLint element = 0; element < (array ? size : 1); element++)
+			{
+				std::string elementName = array ? base + "[" + std::to_string(element) + "]" : base;
+				// uniforms of uniform blocks are active too but have no location
+				GLint location = glGetUniformLocation(ID, elementName.c_str());
+				LookupStats().glQueries++;
+				if (location < 0)
+					continue;
+				if (array && element == 0)
+					table->add(base, location, type);
+				table->add(std::move(elementName), location, type);
+			}
+		}
+		uniforms = table;
+	}
+
+
+	// 2. compile shaders
+	// ------------------------------------------------------------------------
+	void build(const std::string &vertexCode, const std::string &geometryCode, const std::string &fragmentCode)
+	{
+		const char* vShaderCode = vertexCode.c_str();
+		const char* gShaderCode = geometryCode.c_str();
+		const char * fShaderCode = fragmentCode.c_str();
+		unsigned int vertex, geometry = 0, fragment;
+		// vertex shader
+		vertex = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(vertex, 1, &vShaderCode, NULL);
+		glCompileShader(vertex);
+		checkCompileErrors(vertex, "VERTEX");
+		// geometry shader
+		if (!geometryCode.empty())
+		{
+			geometry = glCreateShader(GL_GEOMETRY_SHADER);
+			glShaderSource(geometry, 1, &gShaderCode, NULL);
+			glCompileShader(geometry);
+			checkCompileErrors(geometry, "GEOMETRY");
+		}
+		// fragment Shader
+		fragment = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(fragment, 1, &fShaderCode, NULL);
+		glCompileShader(fragment);
+		checkCompileErrors(fragment, "FRAGMENT");
+		// shader Program
+		ID = glCreateProgram();
+		glAttachShader(ID, vertex);
+		if (geometry)
+			glAttachShader(ID, geometry);
+		glAttachShader(ID, fragment);
+		glLinkProgram(ID);
+		checkCompileErrors(ID, "PROGRAM");
+		reflect();
+		// delete the shaders as they're linked into our program now and no longer necessery
+		glDeleteShader(vertex);
+		if (geometry)
+			glDeleteShader(geometry);
+		glDeleteShader(fragment);
+	}
+
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
 	void checkCompileErrors(GLuint shader, std::string type)
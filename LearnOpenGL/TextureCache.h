@@ -0,0 +1,604 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "GLState.h"
+#include "TextureLoader.h"
+#include "UploadRing.h"
+#include "Utility/Headers/ThreadPool.h"
+#include "Utility/Headers/Timer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Process wide texture registry
+// -----------------------------
+// Every 2D texture loaded from disk goes through here, keyed by its normalized path plus the
+// sampler and gamma settings, so models (and main.cpp) that share an image share one GL texture.
+// Users hold a TextureHandle; the GL texture is deleted when the last handle goes away.
+// New textures hold a 1x1 placeholder pixel until their image (or its cooked DDS) has been read
+// on the worker pool and uploaded by LoadPending/Finish (blocking) or Update (per frame budget).
+// The workers also build the mip chain, capped by the TextureQuality tier.
+// Pixels are staged through UploadRing::Shared(); Update also caps the bytes it uploads per frame
+// and waits for a later frame rather than stall when the ring is still busy.
+// Streamed textures (TextureSettings::streamed) start out at a small mip and keep their decoded chain
+// on the CPU: every frame users report how many screen pixels each one covers (RequestDetail), Update
+// moves them to the level that resolution needs and drops finer levels again, least needed first,
+// while the textures would exceed the memory budget.
+// All calls must be made from the GL context thread.
+
+struct TextureSettings
+{
+	bool gammaCorrection = false;
+	GLenum wrap = GL_REPEAT;
+	GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+	GLenum magFilter = GL_LINEAR;
+	// mips renormalize the xyz of the texels instead of just averaging them
+	bool normalMap = false;
+	// mip streaming: starts at a small level and follows RequestDetail under the memory budget
+	bool streamed = false;
+	// shown until the real image is uploaded, not part of the cache key
+	unsigned char placeholder[4] = { 128, 128, 128, 255 };
+};
+
+// applies to textures decoded after it is set
+struct TextureQuality
+{
+	int maxTextureSize = 0; // larger textures lose their top mips before upload, 0 keeps full resolution
+	MipFilter mipFilter = MipFilter::Box;
+};
+
+// texture uploads of one frame, i.e. between two Update calls, including blocking loads
+struct TextureUploadStats
+{
+	size_t textures = 0;
+	size_t bytes = 0;
+	size_t stagedBytes = 0; // the part that went through the upload ring
+	double ms = 0.0; // GL thread time spent copying and issuing the uploads
+
+	double MBPerSecond() const
+	{
+		return ms > 0.0 ? bytes / (1024.0 * 1024.0) / (ms / 1000.0) : 0.0;
+	}
+};
+
+struct TextureCacheEntry
+{
+	unsigned int id;
+	int refCount;
+	std::string key;
+	std::string path;
+	TextureSettings settings;
+	size_t bytes; // estimated GPU footprint once uploaded
+	size_t uncompressedBytes; // footprint had it not come from a compressed DDS
+	bool compressed;
+	bool loaded; // upload attempted, whether or not the image could be read
+
+	// import profile, see ImportProfiler.h
+	size_t fileBytes = 0;
+	double decodeMs = 0.0;
+	size_t mipBytes = 0; // of a chain built on the CPU
+	double mipMs = 0.0;
+	size_t uploadedBytes = 0;
+	double uploadMs = 0.0;
+
+	// mip streaming, source holds the whole decoded chain while levels from residentLevel on are on the GPU
+	DecodedImage source;
+	int residentLevel = 0;
+	int targetLevel = 0;
+	float requestedPixels = 0.0f; // this frame
+	float lastRequestedPixels = 0.0f;
+	unsigned int lastRequestFrame = 0;
+	size_t fullUncompressedBytes = 0;
+};
+
+class TextureHandle
+{
+public:
+	TextureHandle() : entry(nullptr) {}
+	TextureHandle(const TextureHandle &other) : entry(other.entry) { retain(); }
+	TextureHandle(TextureHandle &&other) : entry(other.entry) { other.entry = nullptr; }
+	TextureHandle &operator=(TextureHandle other)
+	{
+		std::swap(entry, other.entry);
+		return *this;
+	}
+	~TextureHandle() { release(); }
+
+	unsigned int id() const { return entry ? entry->id : 0; }
+	bool valid() const { return entry != nullptr; }
+	const TextureCacheEntry *get() const { return entry; }
+
+private:
+	friend class TextureCache;
+	explicit TextureHandle(TextureCacheEntry *entry) : entry(entry) { retain(); }
+
+	void retain()
+	{
+		if (entry)
+			entry->refCount++;
+	}
+	inline void release();
+
+	TextureCacheEntry *entry;
+};
+
+class TextureCache
+{
+public:
+	static TextureCache &Shared()
+	{
+		static TextureCache cache;
+		return cache;
+	}
+
+	static std::string NormalizePath(const std::string &path)
+	{
+		std::vector<std::string> parts;
+		std::string part;
+		std::string unified = path + '/';
+		for (char c : unified)
+		{
+			if (c != '/' && c != '\\')
+			{
+				part += c;
+				continue;
+			}
+			if (part == "..")
+			{
+				if (!parts.empty() && parts.back() != "..")
+					parts.pop_back();
+				else
+					parts.push_back(part);
+			}
+			else if (!part.empty() && part != ".")
+				parts.push_back(part);
+			part.clear();
+		}
+
+		std::string normalized = (!path.empty() && (path[0] == '/' || path[0] == '\\')) ? "/" : "";
+		for (size_t i = 0; i < parts.size(); i++)
+			normalized += (i ? "/" : "") + parts[i];
+#ifdef _WIN32
+		// the file system is case insensitive
+		std::transform(normalized.begin(), normalized.end(), normalized.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+#endif
+		return normalized;
+	}
+
+	// returns the shared texture for path, reserving a GL name and queueing the decode if it isn't loaded yet;
+	// queued textures get their pixels on the next LoadPending
+	TextureHandle Acquire(const std::string &path, const TextureSettings &settings = TextureSettings())
+	{
+		std::string key = NormalizePath(path) + '|' + (settings.gammaCorrection ? 's' : 'l') + '|' +
+			std::to_string(settings.wrap) + '|' + std::to_string(settings.minFilter) + '|' + std::to_string(settings.magFilter) +
+			(settings.normalMap ? "|n" : "") + (settings.streamed ? "|m" : "");
+
+		auto found = entries.find(key);
+		if (found != entries.end())
+			return TextureHandle(&found->second);
+
+		TextureCacheEntry &entry = entries[key];
+		glGenTextures(1, &entry.id);
+		entry.refCount = 0;
+		entry.key = key;
+		entry.path = path;
+		entry.settings = settings;
+		entry.bytes = 0;
+		entry.uncompressedBytes = 0;
+		entry.compressed = false;
+		entry.loaded = false;
+
+		GLState::Shared().BindTexture(GL_TEXTURE_2D, entry.id);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, settings.placeholder);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		pending.push_back(key);
+		return TextureHandle(&entry);
+	}
+
+	// blocks until every queued texture is decoded and uploaded
+	void LoadPending()
+	{
+		submitPending();
+		while (!inFlight.empty())
+		{
+			InFlight job = std::move(inFlight.front());
+			inFlight.pop_front();
+			if (!job.decoded)
+				job.decodedImage = job.image.get();
+			upload(job.key, job.decodedImage);
+		}
+	}
+
+	// blocks until this one texture is uploaded, other queued textures keep decoding in the background
+	void Finish(const TextureHandle &handle)
+	{
+		if (!handle.valid())
+			return;
+		submitPending();
+		for (auto job = inFlight.begin(); job != inFlight.end(); ++job)
+		{
+			if (job->key != handle.get()->key)
+				continue;
+			if (!job->decoded)
+				job->decodedImage = job->image.get();
+			upload(job->key, job->decodedImage);
+			inFlight.erase(job);
+			return;
+		}
+	}
+
+	// uploads whatever finished decoding without waiting on the workers, stops once budgetMs or the per frame
+	// byte budget is used up; call once per frame, it also starts a new frame for UploadStats
+	void Update(double budgetMs)
+	{
+		lastFrameStats = frameStats;
+		frameStats = TextureUploadStats();
+		submitPending();
+		Timer timer;
+		for (auto job = inFlight.begin(); job != inFlight.end() && timer.elapsedMs() < budgetMs;)
+		{
+			if (!job->decoded)
+			{
+				if (job->image.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				{
+					++job;
+					continue;
+				}
+				job->decodedImage = job->image.get();
+				job->decoded = true;
+			}
+			// the first upload of a frame always goes, so a texture larger than the budget still gets its turn
+			size_t bytes = UploadBytes(job->decodedImage);
+			if (frameStats.bytes > 0 && frameStats.bytes + bytes > uploadBudget)
+				break;
+			if (UploadRing::Shared().Busy(bytes))
+				break;
+			upload(job->key, job->decodedImage);
+			job = inFlight.erase(job);
+		}
+		streamLevels();
+	}
+
+	// mip streaming: the streamed texture covers about pixels screen pixels across this frame (scaled by how
+	// often it repeats), Update picks the level that resolution needs; call between Update calls
+	void RequestDetail(const TextureHandle &handle, float pixels)
+	{
+		if (!handle.valid())
+			return;
+		TextureCacheEntry *entry = handle.entry;
+		entry->requestedPixels = std::max(entry->requestedPixels, pixels);
+	}
+
+	// GPU bytes all textures together may take, streamed ones drop detail to stay below it
+	void SetMemoryBudget(size_t bytes)
+	{
+		memoryBudget = bytes;
+	}
+	size_t MemoryBudget() const
+	{
+		return memoryBudget;
+	}
+
+	// GPU bytes now, and what the textures would take at the levels their usage asks for
+	void StreamingMemory(size_t &resident, size_t &requested) const
+	{
+		resident = ResidentBytes();
+		requested = requestedBytes;
+	}
+
+	// bytes Update may upload per frame
+	void SetUploadBudget(size_t bytesPerFrame)
+	{
+		uploadBudget = bytesPerFrame;
+	}
+
+	// uploads done during the previous frame
+	const TextureUploadStats &UploadStats() const
+	{
+		return lastFrameStats;
+	}
+
+	// 1x1 grey texture for geometry that has no material yet
+	unsigned int Placeholder()
+	{
+		if (!placeholderID)
+		{
+			const unsigned char grey[4] = { 128, 128, 128, 255 };
+			glGenTextures(1, &placeholderID);
+			GLState::Shared().BindTexture(GL_TEXTURE_2D, placeholderID);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		}
+		return placeholderID;
+	}
+
+	void SetQuality(const TextureQuality &tier)
+	{
+		quality = tier;
+	}
+	const TextureQuality &Quality() const
+	{
+		return quality;
+	}
+
+	size_t PendingCount() const { return pending.size() + inFlight.size(); }
+
+	// deletes every GL texture, call before the context goes away; handles released afterwards only drop bookkeeping
+	void ReleaseAll()
+	{
+		for (auto &entry : entries)
+		{
+			GLState::Shared().DeleteTexture(entry.second.id);
+			FreeImage(entry.second.source);
+		}
+		if (placeholderID)
+			GLState::Shared().DeleteTexture(placeholderID);
+		placeholderID = 0;
+		for (InFlight &job : inFlight)
+			if (job.decoded)
+				FreeImage(job.decodedImage);
+		UploadRing::Shared().Release();
+		contextAlive = false;
+	}
+
+	size_t Count() const { return entries.size(); }
+
+	size_t ResidentBytes() const
+	{
+		size_t bytes = 0;
+		for (const auto &entry : entries)
+			bytes += entry.second.bytes;
+		return bytes;
+	}
+
+	size_t UncompressedBytes() const
+	{
+		size_t bytes = 0;
+		for (const auto &entry : entries)
+			bytes += entry.second.uncompressedBytes;
+		return bytes;
+	}
+
+private:
+	friend class TextureHandle;
+
+	struct InFlight
+	{
+		std::string key;
+		std::future<DecodedImage> image;
+		// taken out of the future but held back by the upload budget or a busy ring
+		bool decoded = false;
+		DecodedImage decodedImage;
+	};
+
+	std::unordered_map<std::string, TextureCacheEntry> entries;
+	std::vector<std::string> pending; // not yet handed to the workers
+	std::deque<InFlight> inFlight;
+	unsigned int placeholderID = 0;
+	bool contextAlive = true;
+	TextureQuality quality;
+	size_t uploadBudget = 16 * 1024 * 1024;
+	TextureUploadStats frameStats;
+	TextureUploadStats lastFrameStats;
+	// mip streaming
+	size_t memoryBudget = 512 * 1024 * 1024;
+	size_t requestedBytes = 0;
+	unsigned int frame = 0;
+	// streamed textures start at the level no larger than this
+	static const int STREAM_START_SIZE = 64;
+
+	void submitPending()
+	{
+		ThreadPool &pool = ThreadPool::Shared();
+		for (const std::string &key : pending)
+		{
+			auto found = entries.find(key);
+			if (found == entries.end()) // released before it got its pixels
+				continue;
+			std::string path = found->second.path;
+			MipOptions mipOptions;
+			mipOptions.filter = quality.mipFilter;
+			mipOptions.srgb = found->second.settings.gammaCorrection;
+			mipOptions.normalMap = found->second.settings.normalMap;
+			mipOptions.maxSize = quality.maxTextureSize;
+			inFlight.push_back({ key, pool.submit([path, mipOptions]() { return DecodeImage(path, mipOptions); }) });
+		}
+		pending.clear();
+	}
+
+	void upload(const std::string &key, DecodedImage &image)
+	{
+		auto found = entries.find(key);
+		if (found != entries.end())
+		{
+			TextureCacheEntry &entry = found->second;
+			entry.loaded = true;
+			entry.fileBytes = image.fileBytes;
+			entry.decodeMs = image.decodeMs;
+			entry.mipBytes = image.mips.empty() ? 0 : ImageBytes(image);
+			entry.mipMs = image.mipMs;
+			// only CPU built or cooked chains can be streamed, an image whose mips GL generates goes up whole
+			int firstLevel = 0;
+			if (entry.settings.streamed && !image.data && LevelCount(image) > 1)
+			{
+				firstLevel = LevelCount(image) - 1;
+				while (firstLevel > 0 && LevelSize(image, firstLevel - 1) <= STREAM_START_SIZE)
+					firstLevel--;
+			}
+			if (uploadLevels(entry, image, firstLevel))
+			{
+				entry.uncompressedBytes = UncompressedImageBytes(image);
+				entry.fullUncompressedBytes = entry.uncompressedBytes;
+				entry.compressed = image.isCompressed;
+				if (entry.settings.streamed && !image.data && LevelCount(image) > 1)
+				{
+					entry.targetLevel = firstLevel;
+					entry.uncompressedBytes = scaledUncompressedBytes(entry, image);
+					entry.source = std::move(image);
+					image = DecodedImage();
+					return;
+				}
+			}
+		}
+		FreeImage(image);
+	}
+
+	// (re)specifies the texture with image's chain from firstLevel on and updates the entry's footprint
+	bool uploadLevels(TextureCacheEntry &entry, const DecodedImage &image, int firstLevel)
+	{
+		Timer timer;
+		size_t staged = UploadRing::Shared().StagedTotal();
+		bool uploaded = UploadImage(entry.id, image, entry.settings.gammaCorrection, &UploadRing::Shared(), firstLevel);
+		double ms = timer.elapsedMs();
+		size_t bytes = UploadBytes(image, firstLevel);
+		frameStats.textures++;
+		frameStats.bytes += bytes;
+		frameStats.stagedBytes += UploadRing::Shared().StagedTotal() - staged;
+		frameStats.ms += ms;
+		entry.uploadedBytes += bytes;
+		entry.uploadMs += ms;
+		if (!uploaded)
+			return false;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, entry.settings.wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, entry.settings.wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, entry.settings.minFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, entry.settings.magFilter);
+		entry.bytes = ImageBytes(image, firstLevel);
+		entry.residentLevel = firstLevel;
+		return true;
+	}
+
+	// the uncompressed estimate shrinks along with the resident levels
+	static size_t scaledUncompressedBytes(const TextureCacheEntry &entry, const DecodedImage &image)
+	{
+		size_t full = ImageBytes(image);
+		return full ? (size_t)((double)entry.fullUncompressedBytes * entry.bytes / full) : entry.fullUncompressedBytes;
+	}
+
+	static bool isStreaming(const TextureCacheEntry &entry)
+	{
+		return LevelCount(entry.source) > 1 && (entry.source.isCompressed || !entry.source.mips.empty());
+	}
+
+	// finest level that still has at least pixels texels across
+	static int levelFor(const DecodedImage &image, float pixels)
+	{
+		int level = 0;
+		while (level + 1 < LevelCount(image) && LevelSize(image, level + 1) >= pixels)
+			level++;
+		return level;
+	}
+
+	// picks every streamed texture's level from last frame's requests, coarsens the least needed ones until
+	// everything fits the memory budget, then drops and adds levels; finer levels only within the upload budget
+	void streamLevels()
+	{
+		frame++;
+		std::vector<TextureCacheEntry*> streamed;
+		size_t total = 0;
+		requestedBytes = 0;
+		for (auto &item : entries)
+		{
+			TextureCacheEntry &entry = item.second;
+			if (!isStreaming(entry))
+			{
+				total += entry.bytes;
+				requestedBytes += entry.bytes;
+				continue;
+			}
+			if (entry.requestedPixels > 0.0f)
+			{
+				entry.lastRequestedPixels = entry.requestedPixels;
+				entry.lastRequestFrame = frame;
+			}
+			entry.requestedPixels = 0.0f;
+			entry.targetLevel = levelFor(entry.source, entry.lastRequestedPixels);
+			size_t bytes = ImageBytes(entry.source, entry.targetLevel);
+			total += bytes;
+			requestedBytes += bytes;
+			streamed.push_back(&entry);
+		}
+		if (streamed.empty())
+			return;
+
+		// over budget: drop a level from whichever texture has the most texels per requested pixel, textures
+		// nobody asked for this frame first
+		while (total > memoryBudget)
+		{
+			TextureCacheEntry *coarsest = nullptr;
+			float worst = -1.0f;
+			for (TextureCacheEntry *entry : streamed)
+			{
+				if (entry->targetLevel + 1 >= LevelCount(entry->source))
+					continue;
+				float wanted = entry->lastRequestFrame == frame ? std::max(entry->lastRequestedPixels, 1.0f) : 1.0f;
+				float excess = LevelSize(entry->source, entry->targetLevel) / wanted;
+				if (excess > worst)
+				{
+					worst = excess;
+					coarsest = entry;
+				}
+			}
+			if (!coarsest)
+				break;
+			total -= ImageBytes(coarsest->source, coarsest->targetLevel) - ImageBytes(coarsest->source, coarsest->targetLevel + 1);
+			coarsest->targetLevel++;
+		}
+
+		// evictions free memory and are small, they always go through
+		for (TextureCacheEntry *entry : streamed)
+			if (entry->targetLevel > entry->residentLevel)
+				restream(*entry);
+
+		// most undersampled first
+		std::vector<TextureCacheEntry*> finer;
+		for (TextureCacheEntry *entry : streamed)
+			if (entry->targetLevel < entry->residentLevel)
+				finer.push_back(entry);
+		std::sort(finer.begin(), finer.end(), [](const TextureCacheEntry *a, const TextureCacheEntry *b) {
+			return LevelSize(a->source, a->residentLevel) / std::max(a->lastRequestedPixels, 1.0f) <
+				LevelSize(b->source, b->residentLevel) / std::max(b->lastRequestedPixels, 1.0f);
+		});
+		for (TextureCacheEntry *entry : finer)
+		{
+			size_t bytes = UploadBytes(entry->source, entry->targetLevel);
+			if (frameStats.bytes > 0 && frameStats.bytes + bytes > uploadBudget)
+				break;
+			if (UploadRing::Shared().Busy(bytes))
+				break;
+			restream(*entry);
+		}
+	}
+
+	void restream(TextureCacheEntry &entry)
+	{
+		if (uploadLevels(entry, entry.source, entry.targetLevel))
+			entry.uncompressedBytes = scaledUncompressedBytes(entry, entry.source);
+	}
+
+	void release(TextureCacheEntry *entry)
+	{
+		if (--entry->refCount > 0)
+			return;
+		if (contextAlive)
+			GLState::Shared().DeleteTexture(entry->id);
+		FreeImage(entry->source);
+		std::string key = entry->key;
+		entries.erase(key);
+	}
+};
+
+inline void TextureHandle::release()
+{
+	if (entry)
+		TextureCache::Shared().release(entry);
+	entry = nullptr;
+}
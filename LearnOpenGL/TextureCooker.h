@@ -0,0 +1,207 @@
+#pragma once
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include "stb_image.h"
+#include "DDSFile.h"
+#include "Utility/Headers/BlockCompression.h"
+#include "Utility/Headers/MappedFile.h"
+#include "Utility/Headers/MipBuilder.h"
+#include "Utility/Headers/ThreadPool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+// Offline texture cooker
+// ----------------------
+// Run as "LearnOpenGL --cook <model file or directory> ...". Every image gets a pre-mipped,
+// block compressed DDS in the AssetCache which DecodeImage picks up instead of the image:
+//   normal maps           BC5 (XY, the shader rebuilds Z)
+//   one channel           BC4
+//   two channels          BC5
+//   RGB / opaque RGBA     BC1
+//   RGBA with alpha       BC3
+// A model is cooked through its materials so normal maps are known from their texture type,
+// a directory by file name ("normal", "_nrm", "_ddn" mark normal maps).
+// Mips use the Kaiser filter, in linear space for color textures and renormalized for normal maps.
+// Cooked textures count against the cache's size limit like any other entry; one that was
+// evicted is decoded from its image again until the next --cook.
+
+// cooks the image into the AssetCache unless it is there already; false if the image can't be read or written
+inline bool CookTexture(const std::string &path, bool normalMap)
+{
+	AssetCache &cache = AssetCache::Shared();
+	std::string key = CookedTextureKey(path, normalMap);
+	if (key.empty())
+	{
+		std::cout << "ERROR::COOK::MISSING " << path << std::endl;
+		return false;
+	}
+	if (!cache.find(key).empty())
+		return true;
+
+	int width, height, components;
+	unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &components, 4);
+	if (!pixels)
+	{
+		std::cout << "ERROR::COOK::DECODE " << path << std::endl;
+		return false;
+	}
+	std::vector<unsigned char> rgba(pixels, pixels + (size_t)width * height * 4);
+	stbi_image_free(pixels);
+
+	DDSImage image;
+	image.width = width;
+	image.height = height;
+	if (normalMap || components == 2)
+		image.format = BlockFormat::BC5;
+	else if (components == 1)
+		image.format = BlockFormat::BC4;
+	else
+	{
+		bool hasAlpha = false;
+		for (size_t i = 3; i < rgba.size() && !hasAlpha; i += 4)
+			hasAlpha = rgba[i] != 255;
+		image.format = hasAlpha ? BlockFormat::BC3 : BlockFormat::BC1;
+	}
+	if (components == 2)
+	{
+		// grey + alpha goes up as GL_RG uncompressed, keep alpha in green
+		for (size_t i = 0; i < rgba.size(); i += 4)
+			rgba[i + 1] = rgba[i + 3];
+	}
+
+	MipOptions mipOptions;
+	mipOptions.filter = MipFilter::Kaiser;
+	mipOptions.srgb = image.format == BlockFormat::BC1 || image.format == BlockFormat::BC3;
+	mipOptions.normalMap = normalMap;
+	std::vector<MipLevel> mips;
+	BuildMipChain(rgba.data(), width, height, 4, mipOptions, mips);
+
+	std::vector<unsigned char> blocks;
+	for (const MipLevel &mip : mips)
+	{
+		CompressImage(image.format, mip.pixels.data(), mip.width, mip.height, blocks);
+		image.levels.push_back({ mip.width, mip.height, image.data.size(), blocks.size() });
+		image.data.insert(image.data.end(), blocks.begin(), blocks.end());
+	}
+
+	std::string staging = cache.stagingPath(key);
+	if (!WriteDDS(staging, image))
+	{
+		std::cout << "ERROR::COOK::WRITE " << staging << std::endl;
+		cache.discard(staging);
+		return false;
+	}
+	if (!cache.commit(staging, key))
+		return false;
+	static const char *formatNames[] = { "BC1", "BC3", "BC4", "BC5" };
+	std::cout << "COOK::TEXTURE " << path << " " << width << "x" << height << " " << formatNames[(int)image.format] << " "
+		<< image.levels.size() << " levels, " << (size_t)width * height * components * 4 / 3 / 1024 << " KB -> " << image.data.size() / 1024 << " KB of VRAM" << std::endl;
+	return true;
+}
+
+// cooks a batch of textures on the worker pool, returns how many failed
+inline int CookTextures(const std::vector<std::pair<std::string, bool> > &textures)
+{
+	std::vector<std::future<bool> > jobs;
+	for (const auto &texture : textures)
+		jobs.push_back(ThreadPool::Shared().submit([texture]() { return CookTexture(texture.first, texture.second); }));
+	int failed = 0;
+	for (std::future<bool> &job : jobs)
+		failed += job.get() ? 0 : 1;
+	return failed;
+}
+
+// cooks every texture a model's materials reference, the same way Model resolves them
+inline int CookModel(const std::string &path)
+{
+	Assimp::Importer importer;
+	const aiScene *scene = importer.ReadFile(path, 0);
+	if (!scene)
+	{
+		std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+		return 1;
+	}
+	std::string directory = path.substr(0, path.find_last_of('/'));
+
+	// Model loads aiTextureType_HEIGHT as texture_normal
+	const aiTextureType types[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_AMBIENT, aiTextureType_HEIGHT };
+	std::set<std::string> seen;
+	std::vector<std::pair<std::string, bool> > textures;
+	for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+	{
+		for (aiTextureType type : types)
+		{
+			for (unsigned int i = 0; i < scene->mMaterials[m]->GetTextureCount(type); i++)
+			{
+				aiString str;
+				scene->mMaterials[m]->GetTexture(type, i, &str);
+				std::string texturePath = directory + '/' + str.C_Str();
+				if (seen.insert(texturePath).second)
+					textures.push_back({ texturePath, type == aiTextureType_HEIGHT });
+			}
+		}
+	}
+	return CookTextures(textures);
+}
+
+inline int CookDirectory(const std::string &path)
+{
+	static const char *imageExtensions[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp" };
+	static const char *normalMarkers[] = { "normal", "_nrm", "_ddn", "_norm" };
+
+	std::vector<std::pair<std::string, bool> > textures;
+	for (const auto &file : std::filesystem::recursive_directory_iterator(path))
+	{
+		if (!file.is_regular_file())
+			continue;
+		std::string extension = file.path().extension().string();
+		std::string name = file.path().filename().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		if (std::find(std::begin(imageExtensions), std::end(imageExtensions), extension) == std::end(imageExtensions))
+			continue;
+
+		bool normalMap = false;
+		for (const char *marker : normalMarkers)
+			normalMap = normalMap || name.find(marker) != std::string::npos;
+		textures.push_back({ file.path().generic_string(), normalMap });
+	}
+	return CookTextures(textures);
+}
+
+// entry point for --cook, returns the process exit code
+inline int CookAssets(const std::vector<std::string> &paths)
+{
+	int failed = 0;
+	for (const std::string &path : paths)
+	{
+		std::error_code error;
+		failed += std::filesystem::is_directory(path, error) ? CookDirectory(path) : CookModel(path);
+	}
+	std::cout << "COOK::DONE " << failed << " failed" << std::endl;
+	return failed ? 1 : 0;
+}
+
+// entry point for --bench-mips
+inline int BenchmarkMips(const std::string &path)
+{
+	int width, height, components;
+	unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &components, 0);
+	if (!pixels)
+	{
+		std::cout << "ERROR::BENCH::DECODE " << path << std::endl;
+		return 1;
+	}
+	BenchmarkMipBuilder(pixels, width, height, components);
+	stbi_image_free(pixels);
+	return 0;
+}
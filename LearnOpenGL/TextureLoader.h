@@ -0,0 +1,340 @@
+#pragma once
+
+#include <glad/glad.h>
+#include "stb_image.h"
+
+#include "DDSFile.h"
+#include "GLState.h"
+#include "UploadRing.h"
+#include "Utility/Headers/MappedFile.h"
+#include "Utility/Headers/MipBuilder.h"
+#include "Utility/Headers/Timer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <vector>
+
+// Texture loading is split in two halves so the expensive part can run on worker threads:
+// DecodeImage only touches the file system and stb_image, UploadImage needs the GL context.
+// When the texture cooker left a compressed "<image>.dds" next to the image that is read
+// instead and uploaded as is, with its precomputed mip chain. Given MipOptions the decode
+// also builds the mip chain on the CPU and drops the levels above the max texture size.
+// Given an UploadRing the pixels are staged in its pixel unpack buffer instead of handed to
+// GL as client memory.
+
+// not every glad build exposes the S3TC extension enums, the values are fixed
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+struct DecodedImage
+{
+	unsigned char *data = nullptr;
+	int width = 0;
+	int height = 0;
+	int components = 0;
+	std::string path;
+
+	// set when a cooked DDS was loaded instead of the image, data stays null then
+	bool isCompressed = false;
+	DDSImage compressed;
+
+	// set when the mips were built on the CPU, replaces data; width and height are those of mips[0]
+	std::vector<MipLevel> mips;
+
+	// for the import profile: bytes read from disk, time to read and decode them and to build the mips
+	size_t fileBytes = 0;
+	double decodeMs = 0.0;
+	double mipMs = 0.0;
+};
+
+inline DecodedImage DecodeImage(const std::string &path, bool normalMap)
+{
+	DecodedImage image;
+	image.path = path;
+
+	// a cooked texture is used if one was cooked from exactly this image
+	std::string cookedPath = AssetCache::Shared().find(CookedTextureKey(path, normalMap));
+	uint64_t cookedSize, sourceSize;
+	int64_t cookedTime, sourceTime;
+	if (!cookedPath.empty() && GetFileStamp(cookedPath.c_str(), cookedSize, cookedTime))
+	{
+		if (ReadDDS(cookedPath, image.compressed))
+		{
+			image.fileBytes = (size_t)cookedSize;
+			image.isCompressed = true;
+			image.width = image.compressed.width;
+			image.height = image.compressed.height;
+			return image;
+		}
+		std::cout << "ERROR::TEXTURE::DDS_INVALID " << cookedPath << std::endl;
+		image.compressed = DDSImage();
+	}
+
+	image.data = stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0);
+	if (image.data && GetFileStamp(path.c_str(), sourceSize, sourceTime))
+		image.fileBytes = (size_t)sourceSize;
+	return image;
+}
+
+inline DecodedImage DecodeImage(const std::string &path, const MipOptions &mipOptions)
+{
+	Timer timer;
+	DecodedImage image = DecodeImage(path, mipOptions.normalMap);
+	image.decodeMs = timer.elapsedMs();
+	if (image.isCompressed)
+	{
+		// the chain is precomputed, the quality tier only skips its top levels
+		std::vector<DDSLevel> &levels = image.compressed.levels;
+		size_t first = 0;
+		while (mipOptions.maxSize > 0 && first + 1 < levels.size() && std::max(levels[first].width, levels[first].height) > mipOptions.maxSize)
+			first++;
+		levels.erase(levels.begin(), levels.begin() + first);
+		image.width = levels[0].width;
+		image.height = levels[0].height;
+	}
+	else if (image.data)
+	{
+		MipOptions options = mipOptions;
+		options.srgb = options.srgb && image.components >= 3;
+		timer.reset();
+		BuildMipChain(image.data, image.width, image.height, image.components, options, image.mips);
+		image.mipMs = timer.elapsedMs();
+		stbi_image_free(image.data);
+		image.data = nullptr;
+		image.width = image.mips[0].width;
+		image.height = image.mips[0].height;
+	}
+	return image;
+}
+
+inline void FreeImage(DecodedImage &image)
+{
+	stbi_image_free(image.data);
+	image.data = nullptr;
+	image.compressed = DDSImage();
+	image.mips.clear();
+}
+
+inline GLenum CompressedInternalFormat(BlockFormat format, bool gammaCorrection)
+{
+	switch (format)
+	{
+	case BlockFormat::BC1: return gammaCorrection ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BlockFormat::BC3: return gammaCorrection ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+	default: return GL_COMPRESSED_RG_RGTC2; // normal maps are never gamma corrected
+	}
+}
+
+// mip levels the decode produced, 1 when GL generates them
+inline int LevelCount(const DecodedImage &image)
+{
+	if (image.isCompressed)
+		return (int)image.compressed.levels.size();
+	return image.mips.empty() ? 1 : (int)image.mips.size();
+}
+
+// larger side of a level, the resolution mip streaming compares against screen coverage
+inline int LevelSize(const DecodedImage &image, int level)
+{
+	if (image.isCompressed)
+		return std::max(image.compressed.levels[level].width, image.compressed.levels[level].height);
+	if (!image.mips.empty())
+		return std::max(image.mips[level].width, image.mips[level].height);
+	return std::max(image.width, image.height);
+}
+
+// GPU bytes of the uploaded image including its mip chain, from firstLevel on
+inline size_t ImageBytes(const DecodedImage &image, int firstLevel = 0)
+{
+	size_t bytes = 0;
+	if (!image.isCompressed && !image.mips.empty())
+	{
+		for (size_t i = firstLevel; i < image.mips.size(); i++)
+			bytes += image.mips[i].pixels.size();
+		return bytes;
+	}
+	if (!image.isCompressed)
+		return (size_t)image.width * image.height * image.components * 4 / 3;
+	for (size_t i = firstLevel; i < image.compressed.levels.size(); i++)
+		bytes += image.compressed.levels[i].size;
+	return bytes;
+}
+
+// what the same image would take uploaded through stb, used to report what compression saves;
+// BC5 holds normal maps, which used to go up as RGB
+inline size_t UncompressedImageBytes(const DecodedImage &image)
+{
+	if (!image.isCompressed)
+		return ImageBytes(image);
+	static const int components[] = { 3, 4, 1, 3 };
+	size_t bytes = (size_t)image.width * image.height * components[(int)image.compressed.format] * 4 / 3;
+	return std::max(bytes, ImageBytes(image)); // tiny images can come out larger as whole blocks
+}
+
+// exact bytes UploadImage hands to GL, what a staging ring has to hold for it
+inline size_t UploadBytes(const DecodedImage &image, int firstLevel = 0)
+{
+	size_t bytes = 0;
+	if (image.isCompressed || !image.mips.empty())
+		bytes = ImageBytes(image, firstLevel);
+	else if (image.data)
+		bytes = (size_t)image.width * image.height * image.components;
+	return bytes;
+}
+
+// where glTexImage2D reads each level from: the ring's buffer when it has room (then bound until
+// finishStaging), the levels' own memory otherwise
+struct StagedLevels
+{
+	std::vector<const void*> sources;
+	UploadRing *ring = nullptr;
+};
+
+inline void stageLevels(UploadRing *ring, const std::vector<std::pair<const void*, size_t> > &levels, StagedLevels &staged)
+{
+	size_t total = 0;
+	for (const auto &level : levels)
+		total += level.second;
+
+	UploadRegion region;
+	if (ring && ring->Allocate(total, region))
+	{
+		size_t offset = 0;
+		for (const auto &level : levels)
+		{
+			std::memcpy(region.data + offset, level.first, level.second);
+			staged.sources.push_back(UploadRing::Pointer(region, offset));
+			offset += level.second;
+		}
+		ring->Commit(region);
+		ring->Bind();
+		staged.ring = ring;
+		return;
+	}
+	for (const auto &level : levels)
+		staged.sources.push_back(level.first);
+}
+
+inline void finishStaging(StagedLevels &staged)
+{
+	if (!staged.ring)
+		return;
+	staged.ring->Unbind();
+	staged.ring->Fence();
+}
+
+inline bool uploadCompressedImage(unsigned int textureID, const DecodedImage &image, bool gammaCorrection, UploadRing *ring, int firstLevel)
+{
+	const DDSImage &dds = image.compressed;
+	GLenum internalFormat = CompressedInternalFormat(dds.format, gammaCorrection);
+	const size_t levelCount = dds.levels.size() - firstLevel;
+
+	std::vector<std::pair<const void*, size_t> > levels;
+	for (size_t i = firstLevel; i < dds.levels.size(); i++)
+		levels.push_back({ dds.data.data() + dds.levels[i].offset, dds.levels[i].size });
+	StagedLevels staged;
+	stageLevels(ring, levels, staged);
+
+	GLState::Shared().BindTexture(GL_TEXTURE_2D, textureID);
+	for (size_t i = 0; i < levelCount; i++)
+	{
+		const DDSLevel &level = dds.levels[firstLevel + i];
+		glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, internalFormat, level.width, level.height, 0, (GLsizei)level.size, staged.sources[i]);
+	}
+	finishStaging(staged);
+	// a chain that stops early is still complete up to here
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelCount - 1);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return true;
+}
+
+// uploads a decoded image into an already generated texture object, with its CPU built mips or else glGenerateMipmap;
+// pixels go through ring when one is given and it has room. A firstLevel above 0 (re)specifies the texture
+// with the chain from that level on, i.e. smaller, which is how mip streaming adds and drops detail.
+inline bool UploadImage(unsigned int textureID, const DecodedImage &image, bool gammaCorrection, UploadRing *ring = nullptr, int firstLevel = 0)
+{
+	firstLevel = std::min(std::max(firstLevel, 0), LevelCount(image) - 1);
+	if (image.isCompressed)
+		return uploadCompressedImage(textureID, image, gammaCorrection, ring, firstLevel);
+	if (!image.data && image.mips.empty())
+	{
+		std::cout << "Texture failed to load at path: " << image.path << std::endl;
+		return false;
+	}
+
+	GLenum internalFormat;
+	GLenum dataFormat;
+	if (image.components == 1)
+	{
+		internalFormat = dataFormat = GL_RED;
+	}
+	else if (image.components == 2)
+	{
+		internalFormat = dataFormat = GL_RG;
+	}
+	else if (image.components == 3)
+	{
+		internalFormat = gammaCorrection ? GL_SRGB : GL_RGB;
+		dataFormat = GL_RGB;
+	}
+	else
+	{
+		internalFormat = gammaCorrection ? GL_SRGB_ALPHA : GL_RGBA;
+		dataFormat = GL_RGBA;
+	}
+
+	std::vector<std::pair<const void*, size_t> > levels;
+	if (image.mips.empty())
+		levels.push_back({ image.data, UploadBytes(image) });
+	for (size_t i = firstLevel; i < image.mips.size(); i++)
+		levels.push_back({ image.mips[i].pixels.data(), image.mips[i].pixels.size() });
+	StagedLevels staged;
+	stageLevels(ring, levels, staged);
+
+	// stb and the mip builder both pack rows tightly, which for most widths isn't a multiple of 4 bytes
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	GLState::Shared().BindTexture(GL_TEXTURE_2D, textureID);
+	if (image.mips.empty())
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, dataFormat, GL_UNSIGNED_BYTE, staged.sources[0]);
+		finishStaging(staged);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	else
+	{
+		const size_t levelCount = image.mips.size() - firstLevel;
+		for (size_t i = 0; i < levelCount; i++)
+		{
+			const MipLevel &level = image.mips[firstLevel + i];
+			glTexImage2D(GL_TEXTURE_2D, (GLint)i, internalFormat, level.width, level.height, 0, dataFormat, GL_UNSIGNED_BYTE, staged.sources[i]);
+		}
+		finishStaging(staged);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelCount - 1);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return true;
+}
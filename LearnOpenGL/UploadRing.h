@@ -0,0 +1,239 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "GLState.h"
+
+#include <cstring>
+#include <deque>
+#include <iostream>
+
+// Pixel unpack staging ring
+// -------------------------
+// One GL_PIXEL_UNPACK_BUFFER used as a ring of staging memory for texture uploads: pixels are
+// copied into it and glTexImage2D sources them from there, so the driver can DMA them to the
+// texture later instead of copying client memory synchronously inside the call. Each upload is
+// followed by a fence; its bytes are only reused once the fence signaled, which is polled, never
+// waited on. When the ring is full Allocate fails and the caller either retries next frame or
+// falls back to client memory.
+// With GL 4.4 (ARB_buffer_storage) the buffer is persistently and coherently mapped, otherwise
+// every allocation maps its own range unsynchronized, which is safe because of the fences.
+// All calls must be made from the GL context thread.
+
+struct UploadRegion
+{
+	size_t offset = 0; // into the buffer, pass Pointer() as the pixel pointer while Bind() is in effect
+	size_t size = 0;
+	unsigned char *data = nullptr; // write the pixels here, then Commit
+};
+
+class UploadRing
+{
+public:
+	static const size_t DEFAULT_CAPACITY = 64 * 1024 * 1024;
+
+	static UploadRing &Shared()
+	{
+		static UploadRing ring;
+		return ring;
+	}
+
+	// reserves size bytes of staging memory; false while earlier uploads still occupy the room it needs,
+	// and always for requests larger than the whole ring
+	bool Allocate(size_t size, UploadRegion &region)
+	{
+		if (!init() || size == 0 || size > capacity)
+			return false;
+		retire();
+		size_t offset;
+		if (!findRoom(size, offset))
+			return false;
+
+		// the skipped end of the buffer after a wrap, or the alignment gap, is freed along with this allocation
+		unfencedBytes += offset < head ? capacity - head : offset - head;
+		head = offset + size;
+		unfencedBytes += size;
+		used = usedBytes();
+		stagedTotal += size;
+
+		region.offset = offset;
+		region.size = size;
+		if (mapped)
+			region.data = mapped + offset;
+		else
+		{
+			GLState::Shared().BindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+			region.data = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			GLState::Shared().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		return region.data != nullptr;
+	}
+
+	// makes the bytes written to region visible to GL
+	void Commit(const UploadRegion &region)
+	{
+		if (mapped)
+			return; // coherent
+		GLState::Shared().BindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		GLState::Shared().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	// texture uploads source the bound buffer while bound, so unbind before uploading client memory again
+	void Bind() const
+	{
+		GLState::Shared().BindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+	}
+	void Unbind() const
+	{
+		GLState::Shared().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	static const void *Pointer(const UploadRegion &region, size_t offset = 0)
+	{
+		return (const void*)(region.offset + offset);
+	}
+
+	// call after the GL commands that read the committed regions, their bytes are free again once it signals
+	void Fence()
+	{
+		if (!unfencedBytes)
+			return;
+		fences.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), unfencedBytes, head });
+		unfencedBytes = 0;
+	}
+
+	// true while in-flight uploads occupy the room an allocation of size needs; requests larger than the
+	// whole ring are never staged, so they are never busy either
+	bool Busy(size_t size)
+	{
+		if (!init() || size > capacity)
+			return false;
+		retire();
+		size_t offset;
+		return !findRoom(size, offset);
+	}
+
+	bool Persistent() const { return mapped != nullptr; }
+	size_t Capacity() const { return capacity; }
+	size_t Used() const { return used; }
+	// bytes allocated over the ring's lifetime
+	size_t StagedTotal() const { return stagedTotal; }
+
+	// frees the buffer and fences, call before the context goes away
+	void Release()
+	{
+		for (const InFlight &fence : fences)
+			glDeleteSync(fence.sync);
+		fences.clear();
+		if (buffer)
+		{
+			if (mapped)
+			{
+				GLState::Shared().BindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				GLState::Shared().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			}
+			GLState::Shared().DeleteBuffer(buffer);
+		}
+		buffer = 0;
+		mapped = nullptr;
+		head = tail = unfencedBytes = used = 0;
+		released = true;
+	}
+
+private:
+	struct InFlight
+	{
+		GLsync sync;
+		size_t bytes; // including the skipped end of the buffer when the allocations wrapped
+		size_t end;   // head when the fence was inserted
+	};
+
+	unsigned int buffer = 0;
+	unsigned char *mapped = nullptr;
+	size_t capacity = DEFAULT_CAPACITY;
+	// allocations run from tail to head, wrapping around; fenced ones are in fences, newer ones in unfencedBytes
+	size_t head = 0;
+	size_t tail = 0;
+	size_t unfencedBytes = 0;
+	size_t used = 0;
+	size_t stagedTotal = 0;
+	std::deque<InFlight> fences;
+	bool released = false;
+
+	UploadRing() {}
+
+	// the buffer is created on first use, TextureCache::Shared() and with it the ring exist before the context does
+	bool init()
+	{
+		if (buffer)
+			return true;
+		if (released)
+			return false;
+		glGenBuffers(1, &buffer);
+		GLState::Shared().BindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+#if defined(GL_VERSION_4_4)
+		if (GLAD_GL_VERSION_4_4)
+		{
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, capacity, NULL, flags);
+			mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, capacity, flags);
+		}
+#endif
+		if (!mapped)
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+		GLState::Shared().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		std::cout << "UPLOADRING::CREATED " << capacity / (1024 * 1024) << " MB " << (mapped ? "persistently mapped" : "mapped per upload") << std::endl;
+		return true;
+	}
+
+	size_t usedBytes() const
+	{
+		size_t bytes = unfencedBytes;
+		for (const InFlight &fence : fences)
+			bytes += fence.bytes;
+		return bytes;
+	}
+
+	// drops the fences the GPU is done with, without waiting for the others
+	void retire()
+	{
+		while (!fences.empty())
+		{
+			GLenum status = glClientWaitSync(fences.front().sync, 0, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+				break;
+			glDeleteSync(fences.front().sync);
+			tail = fences.front().end;
+			fences.pop_front();
+		}
+		used = usedBytes();
+		if (used == 0)
+			head = tail = 0; // empty, start over at the front for the largest contiguous room
+	}
+
+	// contiguous free bytes for size starting at head, or at the front of the buffer if the end is too short
+	bool findRoom(size_t size, size_t &offset) const
+	{
+		const size_t aligned = (head + 255) & ~(size_t)255;
+		if (used == 0)
+		{
+			offset = 0;
+			return size <= capacity;
+		}
+		if (head > tail)
+		{
+			if (aligned + size <= capacity)
+			{
+				offset = aligned;
+				return true;
+			}
+			offset = 0;
+			return size <= tail;
+		}
+		// head wrapped behind tail (or the ring is full when they meet)
+		offset = aligned;
+		return head < tail && aligned + size <= tail;
+	}
+};
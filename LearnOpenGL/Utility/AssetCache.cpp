@@ -0,0 +1,212 @@
+//AssetCache.cpp
+#include "Headers/AssetCache.h"
+#include "Headers/MappedFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+	const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+	const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+	const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+
+	// staging files this old were left behind by a process that died while writing
+	const std::chrono::hours STALE_STAGING(1);
+
+	uint64_t rotl(uint64_t value, int bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	uint64_t mixRound(uint64_t lane, uint64_t word)
+	{
+		return rotl(lane + word * PRIME2, 31) * PRIME1;
+	}
+
+	uint64_t avalanche(uint64_t hash)
+	{
+		hash ^= hash >> 33;
+		hash *= PRIME2;
+		hash ^= hash >> 29;
+		hash *= PRIME3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+	// four independent lanes over 8 byte words keep the multiplies pipelined, about memory speed
+	uint64_t hashBytes(const unsigned char* data, size_t size)
+	{
+		uint64_t lanes[4] = { PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1 };
+		size_t offset = 0;
+		for (; offset + 32 <= size; offset += 32)
+		{
+			for (int lane = 0; lane < 4; lane++)
+			{
+				uint64_t word;
+				std::memcpy(&word, data + offset + lane * 8, 8);
+				lanes[lane] = mixRound(lanes[lane], word);
+			}
+		}
+		uint64_t hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18) + size;
+		for (; offset + 8 <= size; offset += 8)
+		{
+			uint64_t word;
+			std::memcpy(&word, data + offset, 8);
+			hash = rotl(hash ^ mixRound(0, word), 27) * PRIME1 + PRIME3;
+		}
+		for (; offset < size; offset++)
+			hash = rotl(hash ^ (data[offset] * PRIME3), 11) * PRIME1;
+		return avalanche(hash);
+	}
+
+	uint64_t combine(uint64_t hash, uint64_t value)
+	{
+		return avalanche(hash ^ mixRound(PRIME3, value));
+	}
+}
+
+AssetCache::AssetCache(const std::string& directory, uint64_t limitBytes) : m_directory(directory), m_limit(limitBytes)
+{
+}
+
+AssetCache& AssetCache::Shared()
+{
+	static AssetCache cache;
+	return cache;
+}
+
+uint64_t AssetCache::HashFile(const char* path)
+{
+	MappedFile file;
+	if (!file.open(path))
+		return 0;
+	// 0 is reserved for unreadable files
+	return std::max<uint64_t>(hashBytes(file.data(), file.size()), 1);
+}
+
+uint64_t AssetCache::HashFiles(const std::vector<std::string>& paths)
+{
+	if (paths.empty())
+		return 0;
+	uint64_t hash = PRIME2;
+	for (const std::string& path : paths)
+		hash = combine(combine(hash, hashBytes((const unsigned char*)path.data(), path.size())), HashFile(path.c_str()));
+	return hash;
+}
+
+std::string AssetCache::key(const std::string& sourcePath, const char* kind, uint64_t flags, uint32_t version, uint64_t* sourceHash,
+	uint64_t dependencyHash) const
+{
+	uint64_t content = HashFile(sourcePath.c_str());
+	if (sourceHash)
+		*sourceHash = content;
+	if (!content)
+		return std::string();
+	uint64_t hash = combine(combine(combine(content, hashBytes((const unsigned char*)kind, std::strlen(kind))), flags), version);
+	if (dependencyHash)
+		hash = combine(hash, dependencyHash);
+	char name[17];
+	for (int i = 0; i < 16; i++)
+		name[i] = "0123456789abcdef"[(hash >> (60 - i * 4)) & 0xF];
+	name[16] = 0;
+	return std::string(name) + '.' + kind;
+}
+
+std::string AssetCache::find(const std::string& key) const
+{
+	if (key.empty())
+		return std::string();
+	std::error_code error;
+	std::filesystem::path path = std::filesystem::path(m_directory) / key;
+	if (!std::filesystem::is_regular_file(path, error))
+		return std::string();
+	// the modification time doubles as the last use, what evict() goes by
+	std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+	return path.generic_string();
+}
+
+std::string AssetCache::stagingPath(const std::string& key)
+{
+	std::error_code error;
+	std::filesystem::create_directories(m_directory, error);
+	// unique across the threads of this process through the counter, across processes through the clock
+	uint64_t unique = combine((uint64_t)std::chrono::steady_clock::now().time_since_epoch().count(), m_staged++);
+	return (std::filesystem::path(m_directory) / (key + ".staging" + std::to_string(unique % 1000000007))).generic_string();
+}
+
+bool AssetCache::commit(const std::string& stagingPath, const std::string& key)
+{
+	std::error_code error;
+	std::filesystem::rename(stagingPath, std::filesystem::path(m_directory) / key, error);
+	if (error)
+	{
+		std::cout << "ERROR::ASSETCACHE::COMMIT " << key << " " << error.message() << std::endl;
+		discard(stagingPath);
+		return false;
+	}
+	evict();
+	return true;
+}
+
+void AssetCache::discard(const std::string& stagingPath)
+{
+	std::error_code error;
+	std::filesystem::remove(stagingPath, error);
+}
+
+void AssetCache::evict()
+{
+	std::lock_guard<std::mutex> lock(m_evictMutex);
+	struct Entry
+	{
+		std::filesystem::file_time_type used;
+		uint64_t size;
+		std::filesystem::path path;
+	};
+	std::vector<Entry> entries;
+	uint64_t total = 0;
+	std::error_code error;
+	const std::filesystem::file_time_type now = std::filesystem::file_time_type::clock::now();
+	for (std::filesystem::directory_iterator it(m_directory, error), end; !error && it != end; it.increment(error))
+	{
+		std::error_code entryError;
+		if (!it->is_regular_file(entryError))
+			continue;
+		Entry entry = { it->last_write_time(entryError), it->file_size(entryError), it->path() };
+		if (entryError)
+			continue;
+		if (entry.path.filename().string().find(".staging") != std::string::npos)
+		{
+			if (now - entry.used > STALE_STAGING)
+				std::filesystem::remove(entry.path, entryError);
+			continue;
+		}
+		total += entry.size;
+		entries.push_back(entry);
+	}
+	if (total <= m_limit)
+		return;
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+	size_t evicted = 0;
+	uint64_t evictedBytes = 0;
+	for (const Entry& entry : entries)
+	{
+		if (total <= m_limit)
+			break;
+		// an entry still mapped by a reader can't be deleted on Windows, it goes on a later pass
+		if (!std::filesystem::remove(entry.path, error))
+			continue;
+		total -= entry.size;
+		evicted++;
+		evictedBytes += entry.size;
+	}
+	std::cout << "ASSETCACHE::EVICT " << evicted << " entries, " << evictedBytes / (1024.0 * 1024.0) << " MB, "
+		<< total / (1024.0 * 1024.0) << " MB left in " << m_directory << std::endl;
+}
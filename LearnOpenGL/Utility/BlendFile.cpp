@@ -0,0 +1,318 @@
+//BlendFile.cpp
+#include "Headers/BlendFile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	const size_t HEADER_SIZE = 12;
+
+	uint32_t readU32(const unsigned char* p)
+	{
+		uint32_t value;
+		std::memcpy(&value, p, 4);
+		return value;
+	}
+
+	uint16_t readU16(const unsigned char* p)
+	{
+		uint16_t value;
+		std::memcpy(&value, p, 2);
+		return value;
+	}
+
+	uint64_t readPointer(const unsigned char* p, size_t pointerSize)
+	{
+		if (pointerSize == 4)
+			return readU32(p);
+		uint64_t value;
+		std::memcpy(&value, p, 8);
+		return value;
+	}
+
+	// the DNA1 lists are padded so every one starts 4 byte aligned
+	size_t align4(size_t offset)
+	{
+		return (offset + 3) & ~(size_t)3;
+	}
+
+	bool expect(const unsigned char* data, size_t size, size_t& cursor, const char* tag)
+	{
+		if (cursor + 4 > size || std::memcmp(data + cursor, tag, 4) != 0)
+			return false;
+		cursor += 4;
+		return true;
+	}
+
+	// reads count zero terminated strings
+	bool readStrings(const unsigned char* data, size_t size, size_t& cursor, std::vector<std::string>& strings)
+	{
+		if (cursor + 4 > size)
+			return false;
+		uint32_t count = readU32(data + cursor);
+		cursor += 4;
+		strings.reserve(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const unsigned char* end = (const unsigned char*)std::memchr(data + cursor, 0, size - cursor);
+			if (!end)
+				return false;
+			strings.push_back(std::string((const char*)data + cursor, end - (data + cursor)));
+			cursor = end - data + 1;
+		}
+		cursor = align4(cursor);
+		return true;
+	}
+
+	// "*next", "co[3]", "(*func)()", "mtex[18]", "uv[4][2]": whether it's a pointer, the bare name and the array length
+	void parseFieldName(const std::string& sdnaName, BlendField& field)
+	{
+		field.pointer = !sdnaName.empty() && (sdnaName[0] == '*' || sdnaName[0] == '(');
+		field.count = 1;
+		field.name.clear();
+		for (size_t i = 0; i < sdnaName.size(); i++)
+		{
+			char c = sdnaName[i];
+			if (c == '[')
+			{
+				field.count *= (size_t)std::max(std::atoi(sdnaName.c_str() + i + 1), 1);
+				i = sdnaName.find(']', i);
+				if (i == std::string::npos)
+					break;
+			}
+			else if (c == '(')
+				continue;
+			else if (c == ')')
+				break; // function pointer, the rest is its argument list
+			else if (c != '*')
+				field.name += c;
+		}
+	}
+}
+
+const BlendField* BlendStruct::field(const char* name) const
+{
+	for (const BlendField& f : fields)
+		if (f.name == name)
+			return &f;
+	return nullptr;
+}
+
+bool BlendFile::open(const char* path)
+{
+	close();
+	if (!m_file.open(path))
+	{
+		std::cout << "ERROR::BLEND::OPEN " << path << std::endl;
+		return false;
+	}
+	const unsigned char* data = m_file.data();
+	const size_t size = m_file.size();
+
+	// "BLENDER", '_' for 4 byte or '-' for 8 byte pointers, 'v' little or 'V' big endian, then "279"
+	if (size < HEADER_SIZE || std::memcmp(data, "BLENDER", 7) != 0 || (data[7] != '_' && data[7] != '-'))
+	{
+		std::cout << "ERROR::BLEND::HEADER not a .blend file (compressed files have to be saved uncompressed) " << path << std::endl;
+		close();
+		return false;
+	}
+	if (data[8] != 'v')
+	{
+		std::cout << "ERROR::BLEND::BIG_ENDIAN " << path << std::endl;
+		close();
+		return false;
+	}
+	m_pointerSize = data[7] == '_' ? 4 : 8;
+	m_version = std::atoi(std::string((const char*)data + 9, 3).c_str());
+
+	// code, size, old address, SDNA index, count
+	const size_t blockHeader = 16 + m_pointerSize;
+	std::vector<uint32_t> sdnaIndices;
+	const BlendBlock* dna = nullptr;
+	size_t cursor = HEADER_SIZE;
+	while (cursor + blockHeader <= size)
+	{
+		BlendBlock block;
+		std::memcpy(block.code, data + cursor, 4);
+		block.size = readU32(data + cursor + 4);
+		block.address = readPointer(data + cursor + 8, m_pointerSize);
+		sdnaIndices.push_back(readU32(data + cursor + 8 + m_pointerSize));
+		block.count = readU32(data + cursor + 12 + m_pointerSize);
+		block.type = nullptr;
+		block.data = data + cursor + blockHeader;
+		if (std::memcmp(block.code, "ENDB", 4) == 0)
+			break;
+		if (cursor + blockHeader + block.size > size)
+		{
+			std::cout << "ERROR::BLEND::TRUNCATED " << path << std::endl;
+			close();
+			return false;
+		}
+		m_blocks.push_back(block);
+		cursor += blockHeader + block.size;
+	}
+	for (const BlendBlock& block : m_blocks)
+		if (std::memcmp(block.code, "DNA1", 4) == 0)
+			dna = &block;
+	if (!dna || !readDna(dna->data, dna->size))
+	{
+		std::cout << "ERROR::BLEND::DNA " << path << std::endl;
+		close();
+		return false;
+	}
+
+	for (size_t i = 0; i < m_blocks.size(); i++)
+	{
+		if (sdnaIndices[i] < m_structs.size())
+			m_blocks[i].type = &m_structs[sdnaIndices[i]];
+		if (m_blocks[i].address)
+			m_byAddress.push_back(i);
+	}
+	std::sort(m_byAddress.begin(), m_byAddress.end(), [this](size_t a, size_t b) { return m_blocks[a].address < m_blocks[b].address; });
+	return true;
+}
+
+void BlendFile::close()
+{
+	m_file.close();
+	m_version = 0;
+	m_pointerSize = 0;
+	m_blocks.clear();
+	m_structs.clear();
+	m_structLookup.clear();
+	m_byAddress.clear();
+}
+
+// "SDNA", then the field names, the type names, the size of every type and the structs, each a list tagged NAME, TYPE, TLEN and STRC
+bool BlendFile::readDna(const unsigned char* data, size_t size)
+{
+	size_t cursor = 0;
+	std::vector<std::string> names, types;
+	if (!expect(data, size, cursor, "SDNA") || !expect(data, size, cursor, "NAME") || !readStrings(data, size, cursor, names) ||
+		!expect(data, size, cursor, "TYPE") || !readStrings(data, size, cursor, types) || !expect(data, size, cursor, "TLEN"))
+		return false;
+	if (cursor + types.size() * 2 > size)
+		return false;
+	std::vector<size_t> lengths(types.size());
+	for (size_t i = 0; i < types.size(); i++, cursor += 2)
+		lengths[i] = readU16(data + cursor);
+	cursor = align4(cursor);
+	if (!expect(data, size, cursor, "STRC") || cursor + 4 > size)
+		return false;
+
+	uint32_t structCount = readU32(data + cursor);
+	cursor += 4;
+	m_structs.resize(structCount);
+	for (uint32_t s = 0; s < structCount; s++)
+	{
+		if (cursor + 4 > size)
+			return false;
+		uint16_t type = readU16(data + cursor);
+		uint16_t fieldCount = readU16(data + cursor + 2);
+		cursor += 4;
+		if (type >= types.size() || cursor + fieldCount * 4 > size)
+			return false;
+
+		BlendStruct& structure = m_structs[s];
+		structure.type = types[type];
+		structure.size = lengths[type];
+		structure.fields.resize(fieldCount);
+		// fields are packed one after another, any padding is spelled out as fields of its own
+		size_t offset = 0;
+		for (uint16_t f = 0; f < fieldCount; f++, cursor += 4)
+		{
+			uint16_t fieldType = readU16(data + cursor);
+			uint16_t fieldName = readU16(data + cursor + 2);
+			if (fieldType >= types.size() || fieldName >= names.size())
+				return false;
+			BlendField& field = structure.fields[f];
+			field.type = types[fieldType];
+			parseFieldName(names[fieldName], field);
+			field.offset = offset;
+			field.size = (field.pointer ? m_pointerSize : lengths[fieldType]) * field.count;
+			offset += field.size;
+		}
+		m_structLookup[structure.type] = s;
+	}
+	return true;
+}
+
+const BlendStruct* BlendFile::structNamed(const std::string& type) const
+{
+	auto found = m_structLookup.find(type);
+	return found == m_structLookup.end() ? nullptr : &m_structs[found->second];
+}
+
+const BlendBlock* BlendFile::find(uint64_t address) const
+{
+	if (!address)
+		return nullptr;
+	auto after = std::upper_bound(m_byAddress.begin(), m_byAddress.end(), address,
+		[this](uint64_t value, size_t block) { return value < m_blocks[block].address; });
+	if (after == m_byAddress.begin())
+		return nullptr;
+	const BlendBlock& block = m_blocks[*(after - 1)];
+	return address < block.address + std::max<size_t>(block.size, 1) ? &block : nullptr;
+}
+
+uint64_t BlendFile::pointer(const unsigned char* data, const BlendField* field, size_t index) const
+{
+	if (!field || !field->pointer || index >= field->count)
+		return 0;
+	return readPointer(data + field->offset + index * m_pointerSize, m_pointerSize);
+}
+
+int BlendFile::integer(const unsigned char* data, const BlendField* field, size_t index) const
+{
+	if (!field || field->pointer || index >= field->count)
+		return 0;
+	const unsigned char* p = data + field->offset + index * (field->size / field->count);
+	const std::string& type = field->type;
+	if (type == "char" || type == "uchar")
+		return type == "char" ? (int)(signed char)*p : (int)*p;
+	if (type == "short")
+		return (int)(int16_t)readU16(p);
+	if (type == "ushort")
+		return (int)readU16(p);
+	if (type == "int")
+		return (int)readU32(p);
+	if (type == "float" || type == "double")
+		return (int)real(data, field, index);
+	return 0;
+}
+
+float BlendFile::real(const unsigned char* data, const BlendField* field, size_t index) const
+{
+	if (!field || field->pointer || index >= field->count)
+		return 0.0f;
+	const unsigned char* p = data + field->offset + index * (field->size / field->count);
+	if (field->type == "float")
+	{
+		float value;
+		std::memcpy(&value, p, 4);
+		return value;
+	}
+	if (field->type == "double")
+	{
+		double value;
+		std::memcpy(&value, p, 8);
+		return (float)value;
+	}
+	return (float)integer(data, field, index);
+}
+
+uint64_t BlendFile::pointer(const unsigned char* data) const
+{
+	return readPointer(data, m_pointerSize);
+}
+
+std::string BlendFile::string(const unsigned char* data, const BlendField* field) const
+{
+	if (!field || field->pointer || field->type != "char")
+		return std::string();
+	const char* text = (const char*)data + field->offset;
+	return std::string(text, strnlen(text, field->size));
+}
@@ -0,0 +1,224 @@
+//BlockCompression.cpp
+#include "Headers/BlockCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace
+{
+	unsigned short packRGB565(const float color[3])
+	{
+		int r = std::min(31, std::max(0, (int)std::lround(color[0] * 31.0f / 255.0f)));
+		int g = std::min(63, std::max(0, (int)std::lround(color[1] * 63.0f / 255.0f)));
+		int b = std::min(31, std::max(0, (int)std::lround(color[2] * 31.0f / 255.0f)));
+		return (unsigned short)((r << 11) | (g << 5) | b);
+	}
+
+	void unpackRGB565(unsigned short packed, int color[3])
+	{
+		int r = (packed >> 11) & 31;
+		int g = (packed >> 5) & 63;
+		int b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+}
+
+size_t BlockBytes(BlockFormat format)
+{
+	return (format == BlockFormat::BC1 || format == BlockFormat::BC4) ? 8 : 16;
+}
+
+size_t CompressedSize(BlockFormat format, int width, int height)
+{
+	size_t blocksX = (size_t)std::max(1, (width + 3) / 4);
+	size_t blocksY = (size_t)std::max(1, (height + 3) / 4);
+	return blocksX * blocksY * BlockBytes(format);
+}
+
+void CompressBC1Block(const unsigned char* rgba, unsigned char* out)
+{
+	// principal axis of the block colors through their mean
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++)
+			mean[c] += rgba[i * 4 + c] / 16.0f;
+
+	float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }; // xx xy xz yy yz zz
+	for (int i = 0; i < 16; i++)
+	{
+		float r = rgba[i * 4 + 0] - mean[0];
+		float g = rgba[i * 4 + 1] - mean[1];
+		float b = rgba[i * 4 + 2] - mean[2];
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 4; iteration++)
+	{
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float largest = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+		if (largest < 1e-6f)
+			break;
+		axis[0] = x / largest; axis[1] = y / largest; axis[2] = z / largest;
+	}
+	float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	for (int c = 0; c < 3; c++)
+		axis[c] /= length;
+
+	float minT = 0.0f, maxT = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = (rgba[i * 4 + 0] - mean[0]) * axis[0] + (rgba[i * 4 + 1] - mean[1]) * axis[1] + (rgba[i * 4 + 2] - mean[2]) * axis[2];
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+
+	// inset the endpoints a little, the extremes are rarely worth a whole palette entry
+	float inset = (maxT - minT) / 16.0f;
+	float high[3], low[3];
+	for (int c = 0; c < 3; c++)
+	{
+		high[c] = mean[c] + axis[c] * (maxT - inset);
+		low[c] = mean[c] + axis[c] * (minT + inset);
+	}
+
+	unsigned short color0 = packRGB565(high);
+	unsigned short color1 = packRGB565(low);
+	// color0 > color1 selects the four color mode, which is the only mode BC3 has
+	if (color0 < color1)
+		std::swap(color0, color1);
+
+	uint32_t indices = 0;
+	if (color0 != color1)
+	{
+		int palette[4][3];
+		unpackRGB565(color0, palette[0]);
+		unpackRGB565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			int bestError = 1 << 30;
+			for (int p = 0; p < 4; p++)
+			{
+				int dr = rgba[i * 4 + 0] - palette[p][0];
+				int dg = rgba[i * 4 + 1] - palette[p][1];
+				int db = rgba[i * 4 + 2] - palette[p][2];
+				int error = dr * dr + dg * dg + db * db;
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint32_t)best << (i * 2);
+		}
+	}
+
+	out[0] = (unsigned char)(color0 & 0xFF);
+	out[1] = (unsigned char)(color0 >> 8);
+	out[2] = (unsigned char)(color1 & 0xFF);
+	out[3] = (unsigned char)(color1 >> 8);
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+void CompressBC4Block(const unsigned char* values, int stride, unsigned char* out)
+{
+	int low = 255, high = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		low = std::min(low, (int)values[i * stride]);
+		high = std::max(high, (int)values[i * stride]);
+	}
+
+	// high > low selects the eight value mode
+	out[0] = (unsigned char)high;
+	out[1] = (unsigned char)low;
+
+	uint64_t indices = 0;
+	if (high != low)
+	{
+		int palette[8];
+		palette[0] = high;
+		palette[1] = low;
+		for (int p = 2; p < 8; p++)
+			palette[p] = ((8 - p) * high + (p - 1) * low + 3) / 7;
+
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			int bestError = 256;
+			for (int p = 0; p < 8; p++)
+			{
+				int error = std::abs(values[i * stride] - palette[p]);
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint64_t)best << (i * 3);
+		}
+	}
+
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+void CompressImage(BlockFormat format, const unsigned char* rgba, int width, int height, std::vector<unsigned char>& out)
+{
+	const int blocksX = std::max(1, (width + 3) / 4);
+	const int blocksY = std::max(1, (height + 3) / 4);
+	const size_t blockBytes = BlockBytes(format);
+	out.resize((size_t)blocksX * blocksY * blockBytes);
+
+	unsigned char block[64];
+	unsigned char* dst = out.data();
+	for (int by = 0; by < blocksY; by++)
+	{
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			for (int y = 0; y < 4; y++)
+			{
+				int sy = std::min(by * 4 + y, height - 1);
+				for (int x = 0; x < 4; x++)
+				{
+					int sx = std::min(bx * 4 + x, width - 1);
+					const unsigned char* texel = rgba + ((size_t)sy * width + sx) * 4;
+					std::copy(texel, texel + 4, block + (y * 4 + x) * 4);
+				}
+			}
+
+			switch (format)
+			{
+			case BlockFormat::BC1:
+				CompressBC1Block(block, dst);
+				break;
+			case BlockFormat::BC3:
+				CompressBC4Block(block + 3, 4, dst);
+				CompressBC1Block(block, dst + 8);
+				break;
+			case BlockFormat::BC4:
+				CompressBC4Block(block, 4, dst);
+				break;
+			case BlockFormat::BC5:
+				CompressBC4Block(block + 0, 4, dst);
+				CompressBC4Block(block + 1, 4, dst + 8);
+				break;
+			}
+			dst += blockBytes;
+		}
+	}
+}
@@ -0,0 +1,56 @@
+//AssetCache.h
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Content addressed directory of derived data: processed meshes, cooked textures. An entry is
+// named after a hash of the source file's contents, the kind of entry, the flags it was derived
+// with and the version of the code that derived it, so an edited source (or a newer importer)
+// misses instead of being served stale data, and what nobody asks for any more ages out.
+// Entries are written to a staging file and renamed into place, readers never see half written
+// ones. A hit refreshes the entry's modification time; once the directory grows past its limit
+// the entries used least recently are deleted.
+class AssetCache
+{
+public:
+	explicit AssetCache(const std::string& directory = "cache", uint64_t limitBytes = 1024ull * 1024 * 1024);
+
+	// the process wide cache, "cache" in the working directory
+	static AssetCache& Shared();
+
+	// 64 bit hash of a file's contents, 0 when it can't be read
+	static uint64_t HashFile(const char* path);
+	// one hash over the names and contents of several files, e.g. the ones a model pulls in; 0 for none
+	static uint64_t HashFiles(const std::vector<std::string>& paths);
+
+	void setDirectory(const std::string& directory) { m_directory = directory; }
+	void setLimit(uint64_t limitBytes) { m_limit = limitBytes; }
+	const std::string& directory() const { return m_directory; }
+
+	// name of the entry derived from sourcePath, e.g. "9f0c2d6a1b3e4f57.mesh"; empty if the source can't be read.
+	// dependencyHash folds in the files the source refers to, see HashFiles
+	std::string key(const std::string& sourcePath, const char* kind, uint64_t flags, uint32_t version, uint64_t* sourceHash = nullptr,
+		uint64_t dependencyHash = 0) const;
+	// path of the entry if it exists, marked as just used; empty on a miss
+	std::string find(const std::string& key) const;
+
+	// a file of its own to write the entry to, then commit() it or discard() it
+	std::string stagingPath(const std::string& key);
+	// moves the staged file into place and evicts if the cache grew past its limit
+	bool commit(const std::string& stagingPath, const std::string& key);
+	void discard(const std::string& stagingPath);
+
+	// deletes entries, least recently used first, until the cache fits its limit
+	void evict();
+
+private:
+	std::string m_directory;
+	uint64_t m_limit;
+	std::atomic<unsigned int> m_staged{ 0 };
+	std::mutex m_evictMutex;
+};
+#endif
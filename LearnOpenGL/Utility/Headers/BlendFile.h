@@ -0,0 +1,89 @@
+//BlendFile.h
+#ifndef BLENDFILE_H
+#define BLENDFILE_H
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Native reader for Blender's .blend files, read in place from a memory mapping. A .blend is a header
+// followed by file blocks: a code, the size, the address the data had in Blender's memory, the SDNA
+// struct the data is an array of, the array length, then the data itself, up to an ENDB block.
+// One of the blocks, DNA1, describes every struct the others can hold; dna.txt is a dump of it
+// (type, name, offset and size of each field). Fields are looked up by name in the file's own DNA1,
+// so the offsets of whichever Blender version saved the file are used rather than ones hard coded
+// from dna.txt. Pointers stored in the data are those old addresses and are resolved with find().
+// Only little endian files are read, which is every file saved on x86 and ARM.
+
+struct BlendField
+{
+	std::string type;	// "float", "MVert", ...
+	std::string name;	// without the stars and array sizes of the SDNA name, "co" for "co[3]"
+	size_t offset;
+	size_t size;		// of the whole field, every array element together
+	size_t count;		// array elements, 1 for a plain field
+	bool pointer;
+};
+
+struct BlendStruct
+{
+	std::string type;
+	size_t size;
+	std::vector<BlendField> fields;
+
+	// nullptr when this version of the struct has no such field
+	const BlendField* field(const char* name) const;
+};
+
+struct BlendBlock
+{
+	char code[4];				// "ME\0\0", "OB\0\0", "DATA", ...
+	uint64_t address;			// where the data was in memory when the file was saved
+	const BlendStruct* type;	// what the data is an array of, unreliable for untyped DATA blocks
+	uint32_t count;
+	size_t size;
+	const unsigned char* data;	// points into the mapped file
+};
+
+class BlendFile
+{
+public:
+	// maps the file and indexes its blocks and DNA, false (with the reason printed) if it can't be read
+	bool open(const char* path);
+	void close();
+
+	// 279 for 2.79, ...
+	int version() const { return m_version; }
+	size_t pointerSize() const { return m_pointerSize; }
+	size_t size() const { return m_file.size(); }
+	const std::vector<BlendBlock>& blocks() const { return m_blocks; }
+	const std::vector<BlendStruct>& structs() const { return m_structs; }
+	const BlendStruct* structNamed(const std::string& type) const;
+
+	// the block an old address points into, nullptr for null or dangling pointers
+	const BlendBlock* find(uint64_t address) const;
+
+	// field readers over struct data; missing fields and elements read as 0 or an empty string
+	uint64_t pointer(const unsigned char* data, const BlendField* field, size_t index = 0) const;
+	int integer(const unsigned char* data, const BlendField* field, size_t index = 0) const;
+	float real(const unsigned char* data, const BlendField* field, size_t index = 0) const;
+	std::string string(const unsigned char* data, const BlendField* field) const;
+	// a bare pointer, for arrays of them like the material slots of a Mesh
+	uint64_t pointer(const unsigned char* data) const;
+
+private:
+	bool readDna(const unsigned char* data, size_t size);
+
+	MappedFile m_file;
+	int m_version = 0;
+	size_t m_pointerSize = 0;
+	std::vector<BlendBlock> m_blocks;
+	std::vector<BlendStruct> m_structs;
+	std::unordered_map<std::string, size_t> m_structLookup;
+	// blocks sorted by old address, for find()
+	std::vector<size_t> m_byAddress;
+};
+
+#endif
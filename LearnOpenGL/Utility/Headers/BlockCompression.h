@@ -0,0 +1,31 @@
+//BlockCompression.h
+#ifndef BLOCKCOMPRESSION_H
+#define BLOCKCOMPRESSION_H
+#include <cstddef>
+#include <vector>
+
+// CPU encoders for the GPU block compressed formats, used when cooking textures offline.
+// Every format stores 4x4 texel blocks; the encoders do a range fit along the principal
+// axis of the block which is fast and close enough for diffuse, specular and normal maps.
+enum class BlockFormat
+{
+	BC1, // RGB, 8 bytes per block
+	BC3, // RGBA, BC4 alpha + BC1 color, 16 bytes per block
+	BC4, // single channel, 8 bytes per block
+	BC5  // two channels (normal map XY), two BC4 blocks, 16 bytes per block
+};
+
+size_t BlockBytes(BlockFormat format);
+// bytes of one compressed mip level
+size_t CompressedSize(BlockFormat format, int width, int height);
+
+// rgba holds 16 texels of 4 bytes in row order
+void CompressBC1Block(const unsigned char* rgba, unsigned char* out);
+// values holds 16 single channel texels read with the given stride in bytes
+void CompressBC4Block(const unsigned char* values, int stride, unsigned char* out);
+
+// compresses a tightly packed RGBA8 image, edge blocks repeat the last row and column;
+// BC4 reads the red channel, BC5 red and green
+void CompressImage(BlockFormat format, const unsigned char* rgba, int width, int height, std::vector<unsigned char>& out);
+
+#endif
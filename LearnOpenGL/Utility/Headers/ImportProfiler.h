@@ -0,0 +1,58 @@
+//ImportProfiler.h
+#ifndef IMPORTPROFILER_H
+#define IMPORTPROFILER_H
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+// Where the time of loading a model goes: wall time, bytes and a count per stage of the import.
+// Stages are added to from whichever thread they run on, those running at the same time on
+// different threads overlap so the stages can add up to more than the whole load took.
+
+enum class ImportStage
+{
+	Parse,			// reading the source file, with Assimp or the native .blend reader
+	Nodes,			// walking the scene graph for its meshes, counts nodes
+	Convert,		// importer meshes into MeshData, bytes of the vertices and indices
+	Optimize,
+	Lods,
+	Meshlets,
+	Quantize,
+	SourceHash,		// hashing the source file for its AssetCache entry
+	CacheRead,		// mapping a warm start's mesh cache
+	CacheWrite,
+	MeshUpload,		// GL buffers of the meshes
+	TextureDecode,	// images or cooked DDS files read and decompressed on the worker pool, bytes read from disk
+	MipGeneration,	// CPU built mip chains, on the worker pool
+	TextureUpload,	// GL thread, mips GL generates itself included
+	Count
+};
+
+struct ImportStageStats
+{
+	double ms = 0.0;
+	size_t bytes = 0;
+	size_t count = 0;
+};
+
+class ImportProfiler
+{
+public:
+	static const char* StageName(ImportStage stage);
+
+	void add(ImportStage stage, double ms, size_t bytes, size_t count = 1);
+	ImportStageStats stage(ImportStage stage) const;
+	// wall time from the start of the load until the last texture was uploaded
+	void setTotal(double ms);
+	double total() const;
+
+	// a line per stage that ran, and the same as one JSON object
+	std::string report(const std::string& name) const;
+	std::string json(const std::string& name) const;
+
+private:
+	mutable std::mutex m_mutex;
+	ImportStageStats m_stages[(size_t)ImportStage::Count];
+	double m_totalMs = 0.0;
+};
+#endif
@@ -0,0 +1,44 @@
+//LoadGraph.h
+#ifndef LOADGRAPH_H
+#define LOADGRAPH_H
+#include <functional>
+#include <string>
+#include <vector>
+
+// Assets that depend on each other, loaded with as much overlap as the dependencies allow.
+// A node has up to two halves: work runs on a thread of its own as soon as every dependency
+// of the node has finished, then finish runs on the thread that called run(), the one holding
+// the GL context. Dependencies have to be added before the nodes that need them, so the graph
+// can't have cycles and insertion order is always a valid sequential order.
+class LoadGraph
+{
+public:
+	typedef std::function<void()> Step;
+
+	struct Node
+	{
+		std::string name;
+		Step work;   // any thread, must not touch OpenGL
+		Step finish; // the thread calling run()
+		std::vector<size_t> dependencies;
+		double workMs;
+		double finishMs;
+	};
+
+	// returns the id later nodes depend on; either half may be empty
+	size_t add(const std::string& name, Step work, Step finish, const std::vector<size_t>& dependencies = std::vector<size_t>());
+
+	// blocks until every node has finished; parallel = false runs them one after another in insertion order
+	void run(bool parallel = true);
+
+	const std::vector<Node>& nodes() const { return m_nodes; }
+	// wall clock time of the last run, and the time all work and finish halves added up to
+	double elapsedMs() const { return m_elapsedMs; }
+	double workMs() const;
+	double finishMs() const;
+
+private:
+	std::vector<Node> m_nodes;
+	double m_elapsedMs = 0.0;
+};
+#endif
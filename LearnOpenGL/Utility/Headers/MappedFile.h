@@ -0,0 +1,37 @@
+//MappedFile.h
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+#include <cstddef>
+#include <cstdint>
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+private:
+	const unsigned char* m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#else
+	int m_fd;
+#endif
+
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const char* path);
+	void close();
+
+	bool isOpen() const { return m_data != nullptr; }
+	const unsigned char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+};
+
+// Size and last modification time of a file, used to detect stale derived data.
+bool GetFileStamp(const char* path, uint64_t& size, int64_t& modifiedTime);
+
+#endif
@@ -0,0 +1,25 @@
+//MeshOptimizer.h
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+#include <cstddef>
+
+// Import time reordering of indexed triangle lists, run in this order:
+//   OptimizeVertexCache  triangle order for the post-transform vertex cache (Tipsify)
+//   OptimizeOverdraw     reorders the resulting clusters so outward facing ones draw first
+//   OptimizeVertexFetch  vertex order for memory locality, drops unreferenced vertices
+// The index buffer is rewritten in place; vertices are opaque blobs of vertexSize bytes.
+
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// average cache miss ratio: transformed vertices per triangle with a FIFO cache, 0.5 is ideal, 3 is worst
+float VertexCacheACMR(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+void OptimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// positions are 3 floats found every positionStride bytes; clusters may lose up to threshold times their ACMR
+void OptimizeOverdraw(unsigned int* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount, float threshold = 1.05f);
+
+// returns the new vertex count
+size_t OptimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexSize, unsigned int* indices, size_t indexCount);
+
+#endif
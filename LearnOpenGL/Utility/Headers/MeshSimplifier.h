@@ -0,0 +1,18 @@
+//MeshSimplifier.h
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+#include <cstddef>
+
+// Import time level of detail generation for indexed triangle lists.
+// Edges are collapsed by quadric error (Garland and Heckbert 1997) into one of their endpoints,
+// so the result indexes the same vertex buffer as the input and every level of a mesh can share
+// it. Vertices on open borders and on attribute seams (several vertices at one position) never
+// move, which keeps silhouettes closed and texture coordinates intact.
+
+// writes the simplified index list to destination (room for indexCount indices) and returns its length;
+// stops at targetIndexCount or once a collapse would move the surface by more than targetError, both
+// errors relative to the bounding box diagonal; resultError receives the largest error introduced
+size_t SimplifyMesh(unsigned int* destination, const unsigned int* indices, size_t indexCount, const float* positions, size_t positionStride,
+	size_t vertexCount, size_t targetIndexCount, float targetError, float* resultError = nullptr);
+
+#endif
@@ -0,0 +1,32 @@
+//MeshletBuilder.h
+#ifndef MESHLETBUILDER_H
+#define MESHLETBUILDER_H
+#include <cstddef>
+#include <vector>
+
+// Import time clustering of indexed triangle lists into meshlets: small, spatially compact runs
+// of triangles that can be culled one by one before drawing. The index buffer is reordered so
+// every meshlet is one contiguous range and a multi-draw can submit whatever survives culling.
+
+const size_t MESHLET_MAX_VERTICES = 96;
+const size_t MESHLET_MAX_TRIANGLES = 128;
+
+// laid out to be stored in the mesh cache as is
+struct Meshlet
+{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	// bounding sphere
+	float center[3];
+	float radius;
+	// normal cone: with d = center - camera, every triangle faces away while
+	// dot(d, coneAxis) >= coneCutoff * length(d) + radius; coneCutoff is above 1 when the cone can't cull
+	float coneAxis[3];
+	float coneCutoff;
+};
+
+// rewrites indices in meshlet order and appends the meshlets; positions are 3 floats found every positionStride bytes
+void BuildMeshlets(unsigned int* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount,
+	std::vector<Meshlet>& meshlets, size_t maxVertices = MESHLET_MAX_VERTICES, size_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+#endif
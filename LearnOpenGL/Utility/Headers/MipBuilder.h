@@ -0,0 +1,55 @@
+//MipBuilder.h
+#ifndef MIPBUILDER_H
+#define MIPBUILDER_H
+#include <vector>
+
+// CPU mip chain generation for 8 bit images with 1-4 interleaved channels, so mips can be
+// built on worker threads (and offline by the texture cooker) instead of by glGenerateMipmap.
+// Filtering runs in float with SSE2 or AVX2 kernels picked at runtime; the scalar kernel is
+// the reference the SIMD ones are benchmarked and checked against.
+enum class MipFilter
+{
+	Box,   // 2x2 average
+	Kaiser // 8 tap Kaiser windowed sinc, keeps more detail in the smaller levels
+};
+
+enum class MipKernel
+{
+	Scalar,
+	SSE2,
+	AVX2
+};
+
+// fastest kernel this CPU supports
+MipKernel BestMipKernel();
+const char* MipKernelName(MipKernel kernel);
+
+struct MipOptions
+{
+	MipFilter filter = MipFilter::Box;
+	// color channels are sRGB encoded and filtered in linear space, alpha always stays linear
+	bool srgb = false;
+	// xyz is a [0,1] encoded normal and gets renormalized after filtering
+	bool normalMap = false;
+	// quality tier, levels wider or taller than this are dropped from the chain, 0 keeps everything
+	int maxSize = 0;
+	MipKernel kernel = BestMipKernel();
+};
+
+struct MipLevel
+{
+	int width;
+	int height;
+	std::vector<unsigned char> pixels; // tightly packed rows
+};
+
+// halves the image, odd sizes round down
+void DownsampleImage(const unsigned char* src, int width, int height, int components, const MipOptions& options, MipLevel& dst);
+
+// every level from the image itself down to 1x1, minus the ones maxSize drops
+void BuildMipChain(const unsigned char* src, int width, int height, int components, const MipOptions& options, std::vector<MipLevel>& levels);
+
+// times every supported kernel against the scalar one for both filters and prints the results
+void BenchmarkMipBuilder(const unsigned char* src, int width, int height, int components);
+
+#endif
@@ -0,0 +1,66 @@
+//RenderQueue.h
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Per frame list of draws, each a 64 bit sort key and what to draw, sorted with an LSD radix sort
+// before they are submitted. From the most significant bits down the key holds:
+//   pass          4 bits  shadow, opaque, sky, ... in the order they are rendered
+//   program      10 bits  so each program is switched to once per pass
+//   depth bucket  3 bits  coarse front to back, the near draws fill the depth buffer first
+//   material     14 bits  hash of the bound textures
+//   vertex array 12 bits
+//   depth        21 bits  fine front to back among draws sharing all of the above
+// The sort moves {key, index} pairs through 11 bit digits and the items themselves only once, at the end.
+// Program, material and vertex array only need to be equal for equal state; the ids are folded into
+// their bits, a collision merely puts two states in one run.
+
+struct RenderItem
+{
+	uint64_t key;
+	uint32_t object;	// whose draw this is, e.g. an index into the scene's objects
+	uint32_t part;		// which part of it, e.g. a mesh of the object's model
+};
+
+class RenderQueue
+{
+public:
+	static const unsigned int PASS_COUNT = 16;
+
+	// depth is normalized to [0, 1], see NormalizeDepth
+	static uint64_t MakeKey(unsigned int pass, unsigned int program, unsigned int material, unsigned int vertexArray, float depth);
+	static unsigned int Pass(uint64_t key) { return (unsigned int)(key >> 60); }
+	// logarithmic in the distance from the eye, which spends the bits where they tell draws apart
+	static float NormalizeDepth(float distance, float nearPlane, float farPlane);
+
+	void clear() { m_items.clear(); }
+	void push(uint64_t key, uint32_t object, uint32_t part) { m_items.push_back({ key, object, part }); }
+	size_t size() const { return m_items.size(); }
+	const std::vector<RenderItem>& items() const { return m_items; }
+
+	// stable, by key; returns how many of the 6 digit passes weren't skipped for being the same in every key
+	int sort();
+	// the sorted items of one pass, [first, last)
+	void passRange(unsigned int pass, const RenderItem*& first, const RenderItem*& last) const;
+
+private:
+	// what the sort moves instead of an item
+	struct SortPair
+	{
+		uint64_t key;
+		uint32_t index;
+	};
+
+	std::vector<RenderItem> m_items;
+	std::vector<RenderItem> m_scratch;
+	std::vector<SortPair> m_pairs;
+	std::vector<SortPair> m_pairScratch;
+	std::vector<uint32_t> m_counts;
+};
+
+// entry point for --bench-sort: radix sort against std::sort on count items with scene-like keys
+void BenchmarkRenderQueue(size_t count);
+
+#endif
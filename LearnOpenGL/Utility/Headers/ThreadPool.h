@@ -0,0 +1,51 @@
+//ThreadPool.h
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling tasks from a shared queue.
+// Tasks must not touch OpenGL, the context only lives on the main thread.
+class ThreadPool
+{
+private:
+	std::vector<std::thread> m_workers;
+	std::queue<std::function<void()> > m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stopping;
+
+	void workerLoop();
+
+public:
+	explicit ThreadPool(unsigned int threadCount);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// process wide pool sized to leave one core for the render thread
+	static ThreadPool& Shared();
+
+	unsigned int size() const { return static_cast<unsigned int>(m_workers.size()); }
+
+	template<class F>
+	auto submit(F task) -> std::future<decltype(task())>
+	{
+		typedef decltype(task()) result_t;
+		std::shared_ptr<std::packaged_task<result_t()> > job = std::make_shared<std::packaged_task<result_t()> >(std::move(task));
+		std::future<result_t> result = job->get_future();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.push([job]() { (*job)(); });
+		}
+		m_wake.notify_one();
+		return result;
+	}
+};
+#endif
@@ -1,16 +1,21 @@
 //Timer.h
 #ifndef TIMER
 #define TIMER
+#include <chrono>
+
 class Timer
 {
 private:
+	// Type aliases to make accessing nested type easier
+	using clock_t = std::chrono::high_resolution_clock;
+	using second_t = std::chrono::duration<double, std::ratio<1> >;
+
+	std::chrono::time_point<clock_t> m_beg;
 
 public:
 	Timer();
 	void reset();
 	double elapsed() const;
+	double elapsedMs() const;
 };
 #endif
-
-
-
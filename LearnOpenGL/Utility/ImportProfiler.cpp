@@ -0,0 +1,109 @@
+//ImportProfiler.cpp
+#include "Headers/ImportProfiler.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+	std::string escapeJson(const std::string& text)
+	{
+		std::string escaped;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				escaped += '\\';
+			if ((unsigned char)c < 0x20)
+				continue;
+			escaped += c;
+		}
+		return escaped;
+	}
+}
+
+const char* ImportProfiler::StageName(ImportStage stage)
+{
+	switch (stage)
+	{
+	case ImportStage::Parse: return "parse";
+	case ImportStage::Nodes: return "nodes";
+	case ImportStage::Convert: return "convert";
+	case ImportStage::Optimize: return "optimize";
+	case ImportStage::Lods: return "lods";
+	case ImportStage::Meshlets: return "meshlets";
+	case ImportStage::Quantize: return "quantize";
+	case ImportStage::SourceHash: return "source_hash";
+	case ImportStage::CacheRead: return "cache_read";
+	case ImportStage::CacheWrite: return "cache_write";
+	case ImportStage::MeshUpload: return "mesh_upload";
+	case ImportStage::TextureDecode: return "texture_decode";
+	case ImportStage::MipGeneration: return "mip_generation";
+	case ImportStage::TextureUpload: return "texture_upload";
+	default: return "unknown";
+	}
+}
+
+void ImportProfiler::add(ImportStage stage, double ms, size_t bytes, size_t count)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	ImportStageStats& stats = m_stages[(size_t)stage];
+	stats.ms += ms;
+	stats.bytes += bytes;
+	stats.count += count;
+}
+
+ImportStageStats ImportProfiler::stage(ImportStage stage) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stages[(size_t)stage];
+}
+
+void ImportProfiler::setTotal(double ms)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_totalMs = ms;
+}
+
+double ImportProfiler::total() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_totalMs;
+}
+
+std::string ImportProfiler::report(const std::string& name) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::ostringstream out;
+	out << "MODEL::PROFILE " << name << " " << m_totalMs << " ms until the last texture\n";
+	out << std::fixed;
+	for (size_t i = 0; i < (size_t)ImportStage::Count; i++)
+	{
+		const ImportStageStats& stats = m_stages[i];
+		if (!stats.count)
+			continue;
+		out << "  " << std::left << std::setw(16) << StageName((ImportStage)i) << std::right
+			<< std::setprecision(2) << std::setw(10) << stats.ms << " ms"
+			<< std::setprecision(2) << std::setw(10) << stats.bytes / (1024.0 * 1024.0) << " MB"
+			<< std::setw(8) << stats.count << "\n";
+	}
+	return out.str();
+}
+
+std::string ImportProfiler::json(const std::string& name) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::ostringstream out;
+	out << "{\"model\":\"" << escapeJson(name) << "\",\"totalMs\":" << m_totalMs << ",\"stages\":{";
+	bool first = true;
+	for (size_t i = 0; i < (size_t)ImportStage::Count; i++)
+	{
+		const ImportStageStats& stats = m_stages[i];
+		if (!stats.count)
+			continue;
+		out << (first ? "" : ",") << "\"" << StageName((ImportStage)i) << "\":{\"ms\":" << stats.ms << ",\"bytes\":" << stats.bytes
+			<< ",\"count\":" << stats.count << "}";
+		first = false;
+	}
+	out << "}}";
+	return out.str();
+}
@@ -0,0 +1,128 @@
+//LoadGraph.cpp
+#include "Headers/LoadGraph.h"
+#include "Headers/Timer.h"
+
+#include <chrono>
+#include <future>
+
+namespace
+{
+	enum class NodeState { Waiting, Working, Finishing, Done };
+
+	double timed(const LoadGraph::Step& step)
+	{
+		if (!step)
+			return 0.0;
+		Timer timer;
+		step();
+		return timer.elapsedMs();
+	}
+}
+
+size_t LoadGraph::add(const std::string& name, Step work, Step finish, const std::vector<size_t>& dependencies)
+{
+	Node node;
+	node.name = name;
+	node.work = std::move(work);
+	node.finish = std::move(finish);
+	for (size_t dependency : dependencies)
+		if (dependency < m_nodes.size())
+			node.dependencies.push_back(dependency);
+	node.workMs = node.finishMs = 0.0;
+	m_nodes.push_back(std::move(node));
+	return m_nodes.size() - 1;
+}
+
+void LoadGraph::run(bool parallel)
+{
+	Timer timer;
+	if (!parallel)
+	{
+		for (Node& node : m_nodes)
+		{
+			node.workMs = timed(node.work);
+			node.finishMs = timed(node.finish);
+		}
+		m_elapsedMs = timer.elapsedMs();
+		return;
+	}
+
+	const size_t count = m_nodes.size();
+	std::vector<NodeState> state(count, NodeState::Waiting);
+	std::vector<size_t> blockedBy(count, 0);
+	std::vector<std::vector<size_t> > dependents(count);
+	std::vector<std::future<double> > working(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		blockedBy[i] = m_nodes[i].dependencies.size();
+		for (size_t dependency : m_nodes[i].dependencies)
+			dependents[dependency].push_back(i);
+	}
+
+	// a thread per node rather than the shared pool: work like a cubemap decode fans out to the pool and waits on it
+	auto start = [&](size_t i)
+	{
+		if (m_nodes[i].work)
+		{
+			const Step& work = m_nodes[i].work;
+			working[i] = std::async(std::launch::async, [&work]() { return timed(work); });
+			state[i] = NodeState::Working;
+		}
+		else
+			state[i] = NodeState::Finishing;
+	};
+	for (size_t i = 0; i < count; i++)
+		if (!blockedBy[i])
+			start(i);
+
+	size_t done = 0;
+	while (done < count)
+	{
+		bool progressed = false;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (state[i] == NodeState::Working && working[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			{
+				m_nodes[i].workMs = working[i].get();
+				state[i] = NodeState::Finishing;
+			}
+			if (state[i] != NodeState::Finishing)
+				continue;
+			m_nodes[i].finishMs = timed(m_nodes[i].finish);
+			state[i] = NodeState::Done;
+			done++;
+			progressed = true;
+			for (size_t dependent : dependents[i])
+				if (--blockedBy[dependent] == 0)
+					start(dependent);
+		}
+		if (progressed)
+			continue;
+		// nothing to finish yet, sleep on the oldest node still working
+		for (size_t i = 0; i < count; i++)
+		{
+			if (state[i] == NodeState::Working)
+			{
+				working[i].wait_for(std::chrono::milliseconds(1));
+				break;
+			}
+		}
+	}
+	m_elapsedMs = timer.elapsedMs();
+}
+
+double LoadGraph::workMs() const
+{
+	double total = 0.0;
+	for (const Node& node : m_nodes)
+		total += node.workMs;
+	return total;
+}
+
+double LoadGraph::finishMs() const
+{
+	double total = 0.0;
+	for (const Node& node : m_nodes)
+		total += node.finishMs;
+	return total;
+}
@@ -0,0 +1,110 @@
+//MappedFile.cpp
+#include "Headers/MappedFile.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : m_data(nullptr), m_size(0)
+#ifdef _WIN32
+	, m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+#else
+	, m_fd(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char* path)
+{
+	close();
+#ifdef _WIN32
+	m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!m_mapping)
+	{
+		close();
+		return false;
+	}
+	m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	m_fd = ::open(path, O_RDONLY);
+	if (m_fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(m_fd, &st) != 0 || st.st_size == 0)
+	{
+		close();
+		return false;
+	}
+	void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, m_fd, 0);
+	m_data = mapping == MAP_FAILED ? nullptr : static_cast<const unsigned char*>(mapping);
+	m_size = static_cast<size_t>(st.st_size);
+#endif
+	if (!m_data)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_data)
+		munmap(const_cast<unsigned char*>(m_data), m_size);
+	if (m_fd >= 0)
+		::close(m_fd);
+	m_fd = -1;
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
+
+bool GetFileStamp(const char* path, uint64_t& size, int64_t& modifiedTime)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(path, &st) != 0)
+		return false;
+#else
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return false;
+#endif
+	size = static_cast<uint64_t>(st.st_size);
+	modifiedTime = static_cast<int64_t>(st.st_mtime);
+	return true;
+}
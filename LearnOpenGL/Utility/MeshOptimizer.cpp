@@ -0,0 +1,260 @@
+//MeshOptimizer.cpp
+#include "Headers/MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	// FIFO cache where a vertex is resident while fewer than cacheSize others were inserted after it;
+	// invalidate() empties it without touching every vertex
+	class CacheSimulation
+	{
+	private:
+		std::vector<unsigned int> m_inserted;
+		unsigned int m_time;
+		unsigned int m_cacheSize;
+
+	public:
+		CacheSimulation(size_t vertexCount, unsigned int cacheSize)
+			: m_inserted(vertexCount, 0), m_time(cacheSize + 1), m_cacheSize(cacheSize)
+		{
+		}
+
+		// true on a miss
+		bool access(unsigned int vertex)
+		{
+			if (m_time - m_inserted[vertex] <= m_cacheSize)
+				return false;
+			m_inserted[vertex] = m_time++;
+			return true;
+		}
+
+		int triangleMisses(const unsigned int* triangle)
+		{
+			return (int)access(triangle[0]) + (int)access(triangle[1]) + (int)access(triangle[2]);
+		}
+
+		void invalidate()
+		{
+			m_time += m_cacheSize + 1;
+		}
+	};
+
+	struct Cluster
+	{
+		size_t firstTriangle;
+		size_t triangleCount;
+		float sortKey;
+	};
+}
+
+float VertexCacheACMR(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return 0.0f;
+	CacheSimulation cache(vertexCount, cacheSize);
+	size_t misses = 0;
+	for (size_t t = 0; t < triangleCount; t++)
+		misses += cache.triangleMisses(indices + t * 3);
+	return (float)misses / triangleCount;
+}
+
+// Tipsify, Sander et al. 2007: fan around the current vertex, then move on to the candidate that is still
+// live and stays in the cache longest, falling back to recently used vertices and then to the input order
+void OptimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0 || vertexCount == 0)
+		return;
+
+	// vertex -> triangles adjacency, packed
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		liveTriangles[indices[i]]++;
+	std::vector<size_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + liveTriangles[v];
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	{
+		std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			adjacency[cursor[indices[i]]++] = (unsigned int)(i / 3);
+	}
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> result;
+	deadEnd.reserve(triangleCount * 3);
+	result.reserve(triangleCount * 3);
+
+	unsigned int time = cacheSize + 1;
+	size_t inputCursor = 0;
+	long long fanning = indices[0];
+	while (fanning >= 0)
+	{
+		candidates.clear();
+		for (size_t a = offsets[(size_t)fanning]; a < offsets[(size_t)fanning + 1]; a++)
+		{
+			unsigned int triangle = adjacency[a];
+			if (emitted[triangle])
+				continue;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[triangle * 3 + k];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[triangle] = true;
+		}
+
+		long long next = -1;
+		long long bestPriority = -1;
+		for (unsigned int v : candidates)
+		{
+			if (liveTriangles[v] == 0)
+				continue;
+			// fanning v costs up to 2 new vertices per live triangle, prefer the oldest one that survives that
+			long long priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+				priority = time - cacheTime[v];
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+		while (next < 0 && !deadEnd.empty())
+		{
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0)
+				next = v;
+		}
+		while (next < 0 && inputCursor < vertexCount)
+		{
+			if (liveTriangles[inputCursor] > 0)
+				next = (long long)inputCursor;
+			inputCursor++;
+		}
+		fanning = next;
+	}
+
+	std::copy(result.begin(), result.end(), indices);
+}
+
+// after Sander et al. 2007: cut the cache optimized order into clusters that cost little ACMR when
+// drawn in isolation, then draw the clusters facing away from the mesh center first
+void OptimizeOverdraw(unsigned int* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount, float threshold)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+		return;
+
+	// hard boundaries, where a triangle misses all three vertices the cache starts over anyway
+	std::vector<size_t> hard;
+	{
+		CacheSimulation cache(vertexCount, VERTEX_CACHE_SIZE);
+		for (size_t t = 0; t < triangleCount; t++)
+			if (cache.triangleMisses(indices + t * 3) == 3 || t == 0)
+				hard.push_back(t);
+		hard.push_back(triangleCount);
+	}
+
+	// soft boundaries, split a cluster as soon as the part so far is about as cache friendly as the whole
+	std::vector<Cluster> clusters;
+	CacheSimulation cache(vertexCount, VERTEX_CACHE_SIZE);
+	for (size_t h = 0; h + 1 < hard.size(); h++)
+	{
+		size_t begin = hard[h], end = hard[h + 1];
+		cache.invalidate();
+		size_t misses = 0;
+		for (size_t t = begin; t < end; t++)
+			misses += cache.triangleMisses(indices + t * 3);
+		float acmr = (float)misses / (end - begin);
+
+		cache.invalidate();
+		size_t start = begin, runMisses = 0;
+		for (size_t t = begin; t < end; t++)
+		{
+			runMisses += cache.triangleMisses(indices + t * 3);
+			if (t + 1 == end || runMisses <= threshold * acmr * (t + 1 - start))
+			{
+				clusters.push_back({ start, t + 1 - start, 0.0f });
+				start = t + 1;
+				runMisses = 0;
+				cache.invalidate();
+			}
+		}
+	}
+
+	auto position = [&](unsigned int v) { return (const float*)((const char*)positions + v * positionStride); };
+	float meshCenter[3] = { 0.0f, 0.0f, 0.0f };
+	for (size_t v = 0; v < vertexCount; v++)
+		for (int c = 0; c < 3; c++)
+			meshCenter[c] += position((unsigned int)v)[c] / vertexCount;
+
+	for (Cluster &cluster : clusters)
+	{
+		float center[3] = { 0.0f, 0.0f, 0.0f };
+		float normal[3] = { 0.0f, 0.0f, 0.0f };
+		float area = 0.0f;
+		for (size_t t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount; t++)
+		{
+			const float *a = position(indices[t * 3]), *b = position(indices[t * 3 + 1]), *c = position(indices[t * 3 + 2]);
+			float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+			float triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int i = 0; i < 3; i++)
+			{
+				center[i] += (a[i] + b[i] + c[i]) / 3.0f * triangleArea;
+				normal[i] += n[i];
+			}
+			area += triangleArea;
+		}
+		float normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (area <= 0.0f || normalLength <= 0.0f)
+			continue;
+		for (int i = 0; i < 3; i++)
+			cluster.sortKey += (center[i] / area - meshCenter[i]) * normal[i] / normalLength;
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+	std::vector<unsigned int> result;
+	result.reserve(triangleCount * 3);
+	for (const Cluster &cluster : clusters)
+		result.insert(result.end(), indices + cluster.firstTriangle * 3, indices + (cluster.firstTriangle + cluster.triangleCount) * 3);
+	std::copy(result.begin(), result.end(), indices);
+}
+
+size_t OptimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexSize, unsigned int* indices, size_t indexCount)
+{
+	const unsigned int UNUSED = ~0u;
+	std::vector<unsigned int> remap(vertexCount, UNUSED);
+	unsigned int next = 0;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		unsigned int &target = remap[indices[i]];
+		if (target == UNUSED)
+			target = next++;
+		indices[i] = target;
+	}
+
+	unsigned char* data = (unsigned char*)vertices;
+	std::vector<unsigned char> original(data, data + vertexCount * vertexSize);
+	for (size_t v = 0; v < vertexCount; v++)
+		if (remap[v] != UNUSED)
+			std::memcpy(data + remap[v] * vertexSize, original.data() + v * vertexSize, vertexSize);
+	return next;
+}
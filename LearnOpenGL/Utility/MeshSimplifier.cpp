@@ -0,0 +1,265 @@
+//MeshSimplifier.cpp
+#include "Headers/MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+	struct Vector3
+	{
+		double x, y, z;
+	};
+
+	// sum of squared distances to a set of planes, as the symmetric matrix A, the vector b and c
+	struct Quadric
+	{
+		double a00, a11, a22, a01, a02, a12;
+		double b0, b1, b2;
+		double c;
+
+		void addPlane(double nx, double ny, double nz, double d)
+		{
+			a00 += nx * nx; a11 += ny * ny; a22 += nz * nz;
+			a01 += nx * ny; a02 += nx * nz; a12 += ny * nz;
+			b0 += nx * d; b1 += ny * d; b2 += nz * d;
+			c += d * d;
+		}
+
+		void add(const Quadric& q)
+		{
+			a00 += q.a00; a11 += q.a11; a22 += q.a22;
+			a01 += q.a01; a02 += q.a02; a12 += q.a12;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+		}
+
+		double error(const Vector3& v) const
+		{
+			double rx = a00 * v.x + a01 * v.y + a02 * v.z;
+			double ry = a01 * v.x + a11 * v.y + a12 * v.z;
+			double rz = a02 * v.x + a12 * v.y + a22 * v.z;
+			double e = rx * v.x + ry * v.y + rz * v.z + 2.0 * (b0 * v.x + b1 * v.y + b2 * v.z) + c;
+			return e < 0.0 ? 0.0 : e;
+		}
+	};
+
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double error;
+	};
+
+	Vector3 subtract(const Vector3& a, const Vector3& b)
+	{
+		return { a.x - b.x, a.y - b.y, a.z - b.z };
+	}
+
+	Vector3 cross(const Vector3& a, const Vector3& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	double dot(const Vector3& a, const Vector3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	uint64_t edgeKey(unsigned int a, unsigned int b)
+	{
+		return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+}
+
+size_t SimplifyMesh(unsigned int* destination, const unsigned int* indices, size_t indexCount, const float* positions, size_t positionStride,
+	size_t vertexCount, size_t targetIndexCount, float targetError, float* resultError)
+{
+	if (resultError)
+		*resultError = 0.0f;
+	indexCount -= indexCount % 3;
+	std::vector<unsigned int> result(indices, indices + indexCount);
+	if (indexCount == 0 || vertexCount == 0)
+	{
+		std::copy(result.begin(), result.end(), destination);
+		return result.size();
+	}
+
+	// positions relative to the bounding box, scaled so the diagonal is 1 and errors don't depend on the model's units
+	std::vector<Vector3> points(vertexCount);
+	Vector3 lower = { 1e30, 1e30, 1e30 }, upper = { -1e30, -1e30, -1e30 };
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		const float* p = (const float*)((const char*)positions + v * positionStride);
+		points[v] = { p[0], p[1], p[2] };
+		lower = { std::min(lower.x, points[v].x), std::min(lower.y, points[v].y), std::min(lower.z, points[v].z) };
+		upper = { std::max(upper.x, points[v].x), std::max(upper.y, points[v].y), std::max(upper.z, points[v].z) };
+	}
+	Vector3 extent = subtract(upper, lower);
+	double diagonal = std::sqrt(dot(extent, extent));
+	double scale = diagonal > 0.0 ? 1.0 / diagonal : 1.0;
+	for (Vector3& point : points)
+		point = { (point.x - lower.x) * scale, (point.y - lower.y) * scale, (point.z - lower.z) * scale };
+
+	// vertices sharing a position are split along a seam, they and open borders stay where they are
+	std::vector<unsigned int> weld(vertexCount);
+	std::vector<bool> locked(vertexCount, false);
+	{
+		std::unordered_map<uint64_t, unsigned int> firstAt;
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			const float* p = (const float*)((const char*)positions + v * positionStride);
+			uint32_t bits[3];
+			std::memcpy(bits, p, sizeof(bits));
+			uint64_t hash = ((uint64_t)bits[0] * 73856093u) ^ ((uint64_t)bits[1] * 19349663u << 16) ^ ((uint64_t)bits[2] * 83492791u << 32);
+			auto found = firstAt.find(hash);
+			if (found != firstAt.end() && std::memcmp((const char*)positions + found->second * positionStride, p, sizeof(bits)) == 0)
+			{
+				weld[v] = found->second;
+				locked[v] = locked[found->second] = true;
+			}
+			else
+			{
+				weld[v] = (unsigned int)v;
+				firstAt.emplace(hash, (unsigned int)v);
+			}
+		}
+		std::unordered_map<uint64_t, int> edgeUses;
+		for (size_t i = 0; i < indexCount; i += 3)
+			for (int k = 0; k < 3; k++)
+				edgeUses[edgeKey(weld[result[i + k]], weld[result[i + (k + 1) % 3]])]++;
+		for (size_t i = 0; i < indexCount; i += 3)
+			for (int k = 0; k < 3; k++)
+				if (edgeUses[edgeKey(weld[result[i + k]], weld[result[i + (k + 1) % 3]])] == 1)
+					locked[result[i + k]] = locked[result[i + (k + 1) % 3]] = true;
+	}
+
+	std::vector<Quadric> quadrics(vertexCount, Quadric());
+	for (size_t i = 0; i < indexCount; i += 3)
+	{
+		const Vector3 &a = points[result[i]], &b = points[result[i + 1]], &c = points[result[i + 2]];
+		Vector3 normal = cross(subtract(b, a), subtract(c, a));
+		double length = std::sqrt(dot(normal, normal));
+		if (length <= 0.0)
+			continue;
+		normal = { normal.x / length, normal.y / length, normal.z / length };
+		Quadric plane = Quadric();
+		plane.addPlane(normal.x, normal.y, normal.z, -dot(normal, a));
+		for (int k = 0; k < 3; k++)
+			quadrics[result[i + k]].add(plane);
+	}
+
+	const double errorLimit = (double)targetError * targetError;
+	double worst = 0.0;
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<unsigned int> triangleOffsets(vertexCount + 1);
+	std::vector<unsigned int> adjacency;
+	std::vector<Collapse> collapses;
+	while (result.size() > targetIndexCount)
+	{
+		// vertex -> triangles
+		std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+		for (unsigned int index : result)
+			triangleOffsets[index + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			triangleOffsets[v + 1] += triangleOffsets[v];
+		adjacency.resize(result.size());
+		{
+			std::vector<unsigned int> cursor(triangleOffsets.begin(), triangleOffsets.end() - 1);
+			for (size_t i = 0; i < result.size(); i++)
+				adjacency[cursor[result[i]]++] = (unsigned int)(i / 3);
+		}
+
+		// the cheaper direction of every edge whose vertices may move
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int a = result[i + k], b = result[i + (k + 1) % 3];
+				if (a > b || (locked[a] && locked[b]))
+					continue; // every interior edge is seen from both triangles, keep one
+				Quadric merged = quadrics[a];
+				merged.add(quadrics[b]);
+				double toB = locked[a] ? 1e30 : merged.error(points[b]);
+				double toA = locked[b] ? 1e30 : merged.error(points[a]);
+				if (toB <= toA)
+					collapses.push_back({ a, b, toB });
+				else
+					collapses.push_back({ b, a, toA });
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+		// greedy pass, each collapse removes about two triangles; vertices around a collapse wait for the next pass
+		for (size_t v = 0; v < vertexCount; v++)
+			remap[v] = (unsigned int)v;
+		std::fill(touched.begin(), touched.end(), false);
+		size_t trianglesLeft = result.size() / 3;
+		size_t applied = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (trianglesLeft * 3 <= targetIndexCount || collapse.error > errorLimit)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			// reject collapses that flip a triangle or squash it to nothing
+			bool valid = true;
+			int removed = 0;
+			for (unsigned int a = triangleOffsets[collapse.from]; a < triangleOffsets[collapse.from + 1] && valid; a++)
+			{
+				const unsigned int* triangle = &result[adjacency[a] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+				{
+					removed++;
+					continue;
+				}
+				Vector3 corners[3], moved[3];
+				for (int k = 0; k < 3; k++)
+				{
+					corners[k] = points[triangle[k]];
+					moved[k] = triangle[k] == collapse.from ? points[collapse.to] : corners[k];
+				}
+				Vector3 before = cross(subtract(corners[1], corners[0]), subtract(corners[2], corners[0]));
+				Vector3 after = cross(subtract(moved[1], moved[0]), subtract(moved[2], moved[0]));
+				valid = dot(before, after) > 0.25 * std::sqrt(dot(before, before) * dot(after, after));
+			}
+			if (!valid)
+				continue;
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			for (unsigned int a = triangleOffsets[collapse.from]; a < triangleOffsets[collapse.from + 1]; a++)
+				for (int k = 0; k < 3; k++)
+					touched[result[adjacency[a] * 3 + k]] = true;
+			trianglesLeft -= removed;
+			worst = std::max(worst, collapse.error);
+			applied++;
+		}
+		if (!applied)
+			break;
+
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	if (resultError)
+		*resultError = (float)std::sqrt(worst);
+	std::copy(result.begin(), result.end(), destination);
+	return result.size();
+}
@@ -0,0 +1,170 @@
+//MeshletBuilder.cpp
+#include "Headers/MeshletBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const float* position(const float* positions, size_t stride, unsigned int v)
+	{
+		return (const float*)((const char*)positions + v * stride);
+	}
+
+	// bounding sphere around the box of the triangles' corners, and the cone around their normals
+	void computeBounds(Meshlet& meshlet, const unsigned int* indices, const float* positions, size_t stride)
+	{
+		float lower[3] = { 1e30f, 1e30f, 1e30f }, upper[3] = { -1e30f, -1e30f, -1e30f };
+		for (unsigned int i = 0; i < meshlet.indexCount; i++)
+		{
+			const float* p = position(positions, stride, indices[meshlet.firstIndex + i]);
+			for (int c = 0; c < 3; c++)
+			{
+				lower[c] = std::min(lower[c], p[c]);
+				upper[c] = std::max(upper[c], p[c]);
+			}
+		}
+		float radiusSquared = 0.0f;
+		for (int c = 0; c < 3; c++)
+			meshlet.center[c] = (lower[c] + upper[c]) * 0.5f;
+		for (unsigned int i = 0; i < meshlet.indexCount; i++)
+		{
+			const float* p = position(positions, stride, indices[meshlet.firstIndex + i]);
+			float dx = p[0] - meshlet.center[0], dy = p[1] - meshlet.center[1], dz = p[2] - meshlet.center[2];
+			radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+		}
+		meshlet.radius = std::sqrt(radiusSquared);
+
+		std::vector<float> normals;
+		float axis[3] = { 0.0f, 0.0f, 0.0f };
+		for (unsigned int i = 0; i < meshlet.indexCount; i += 3)
+		{
+			const float* a = position(positions, stride, indices[meshlet.firstIndex + i]);
+			const float* b = position(positions, stride, indices[meshlet.firstIndex + i + 1]);
+			const float* c = position(positions, stride, indices[meshlet.firstIndex + i + 2]);
+			float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (length <= 0.0f)
+				continue;
+			for (int k = 0; k < 3; k++)
+			{
+				normals.push_back(n[k] / length);
+				axis[k] += n[k] / length;
+			}
+		}
+		float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		meshlet.coneAxis[0] = meshlet.coneAxis[1] = meshlet.coneAxis[2] = 0.0f;
+		meshlet.coneCutoff = 2.0f;
+		if (axisLength <= 0.0f || normals.empty())
+			return;
+		for (int k = 0; k < 3; k++)
+			meshlet.coneAxis[k] = axis[k] / axisLength;
+
+		float minimumDot = 1.0f;
+		for (size_t i = 0; i < normals.size(); i += 3)
+			minimumDot = std::min(minimumDot, normals[i] * meshlet.coneAxis[0] + normals[i + 1] * meshlet.coneAxis[1] + normals[i + 2] * meshlet.coneAxis[2]);
+		// normals spread over more than a hemisphere (minus a margin) leave no direction to cull from
+		if (minimumDot > 0.1f)
+			meshlet.coneCutoff = std::sqrt(1.0f - minimumDot * minimumDot);
+	}
+}
+
+// greedy: seed a meshlet with the first unused triangle in the (cache optimized) input order, then keep adding
+// the neighbouring triangle that brings the fewest new vertices until either limit is reached
+void BuildMeshlets(unsigned int* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount,
+	std::vector<Meshlet>& meshlets, size_t maxVertices, size_t maxTriangles)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0 || vertexCount == 0)
+		return;
+	maxVertices = std::max<size_t>(maxVertices, 3);
+	maxTriangles = std::max<size_t>(maxTriangles, 1);
+
+	// vertex -> triangles adjacency, packed
+	std::vector<size_t> offsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		offsets[indices[i] + 1]++;
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] += offsets[v];
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	{
+		std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			adjacency[cursor[indices[i]]++] = (unsigned int)(i / 3);
+	}
+
+	const size_t firstMeshlet = meshlets.size();
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<size_t> inMeshlet(vertexCount, 0); // number (from 1) of the meshlet the vertex was last added to
+	std::vector<unsigned int> order;
+	std::vector<unsigned int> candidates;
+	order.reserve(triangleCount);
+	size_t seedCursor = 0;
+	size_t meshletNumber = 0;
+
+	while (order.size() < triangleCount)
+	{
+		while (emitted[seedCursor])
+			seedCursor++;
+		meshletNumber++;
+		size_t firstTriangle = order.size();
+		size_t vertices = 0;
+		candidates.clear();
+		unsigned int next = (unsigned int)seedCursor;
+		for (;;)
+		{
+			emitted[next] = true;
+			order.push_back(next);
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[next * 3 + k];
+				if (inMeshlet[v] == meshletNumber)
+					continue;
+				inMeshlet[v] = meshletNumber;
+				vertices++;
+				for (size_t a = offsets[v]; a < offsets[v + 1]; a++)
+					if (!emitted[adjacency[a]])
+						candidates.push_back(adjacency[a]);
+			}
+			if (order.size() - firstTriangle >= maxTriangles)
+				break;
+
+			int bestNew = 4;
+			size_t write = 0;
+			for (size_t c = 0; c < candidates.size(); c++)
+			{
+				unsigned int triangle = candidates[c];
+				if (emitted[triangle])
+					continue;
+				candidates[write++] = triangle;
+				int added = 0;
+				for (int k = 0; k < 3; k++)
+					added += inMeshlet[indices[triangle * 3 + k]] == meshletNumber ? 0 : 1;
+				if (added < bestNew && vertices + added <= maxVertices)
+				{
+					bestNew = added;
+					next = triangle;
+				}
+			}
+			candidates.resize(write);
+			if (bestNew == 4)
+				break;
+		}
+
+		Meshlet meshlet;
+		meshlet.firstIndex = (unsigned int)(firstTriangle * 3);
+		meshlet.indexCount = (unsigned int)((order.size() - firstTriangle) * 3);
+		meshlets.push_back(meshlet);
+	}
+
+	std::vector<unsigned int> reordered;
+	reordered.reserve(triangleCount * 3);
+	for (unsigned int triangle : order)
+		reordered.insert(reordered.end(), indices + triangle * 3, indices + triangle * 3 + 3);
+	std::copy(reordered.begin(), reordered.end(), indices);
+
+	for (size_t m = firstMeshlet; m < meshlets.size(); m++)
+		computeBounds(meshlets[m], indices, positions, positionStride);
+}
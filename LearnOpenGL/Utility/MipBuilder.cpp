@@ -0,0 +1,537 @@
+//MipBuilder.cpp
+#include "Headers/MipBuilder.h"
+#include "Headers/Timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MIP_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MIP_TARGET_AVX2
+#else
+#define MIP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+	const int KAISER_TAPS = 8;   // source texels 2x-3 .. 2x+4 for destination texel x
+	const int PAD = 4;           // replicated edge texels on each side of a converted row
+	const float KAISER_ALPHA = 4.0f;
+
+	struct Tables
+	{
+		float srgbToLinear[256];
+		unsigned char linearToSrgb[4096];
+		float kaiser[KAISER_TAPS];
+
+		Tables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i < 4096; i++)
+			{
+				float l = i / 4095.0f;
+				float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+				linearToSrgb[i] = (unsigned char)std::lround(c * 255.0f);
+			}
+
+			// sinc at half the source rate windowed by a Kaiser window reaching zero 4 source texels out;
+			// the destination texel sits between source texels 2x and 2x+1
+			const double pi = 3.14159265358979323846;
+			double sum = 0.0;
+			double weights[KAISER_TAPS];
+			for (int k = 0; k < KAISER_TAPS; k++)
+			{
+				double d = k - 3.5;
+				double x = d / 2.0;
+				double sinc = std::sin(pi * x) / (pi * x);
+				double t = d / 4.0;
+				double window = bessel0(KAISER_ALPHA * std::sqrt(1.0 - t * t)) / bessel0(KAISER_ALPHA);
+				weights[k] = sinc * window;
+				sum += weights[k];
+			}
+			for (int k = 0; k < KAISER_TAPS; k++)
+				kaiser[k] = (float)(weights[k] / sum);
+		}
+
+		static double bessel0(double x)
+		{
+			double sum = 1.0, term = 1.0;
+			for (int k = 1; k < 24; k++)
+			{
+				double f = x / (2.0 * k);
+				term *= f * f;
+				sum += term;
+			}
+			return sum;
+		}
+	};
+
+	const Tables& tables()
+	{
+		static const Tables instance;
+		return instance;
+	}
+
+#ifdef MIP_X86
+	// linear RGBA8 <-> float conversion four texels at a time, returns how many texels were done
+	int loadRGBA8SSE2(const unsigned char* in, int width, float* out)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+		int x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128i bytes = _mm_loadu_si128((const __m128i*)(in + x * 4));
+			__m128i low = _mm_unpacklo_epi8(bytes, zero);
+			__m128i high = _mm_unpackhi_epi8(bytes, zero);
+			_mm_storeu_ps(out + x * 4 + 0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)), scale));
+			_mm_storeu_ps(out + x * 4 + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)), scale));
+			_mm_storeu_ps(out + x * 4 + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)), scale));
+			_mm_storeu_ps(out + x * 4 + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)), scale));
+		}
+		return x;
+	}
+
+	int storeRGBA8SSE2(const float* in, int width, unsigned char* out)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 scale = _mm_set1_ps(255.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		__m128i texels[4];
+		int x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			// same clamp and round half up as the scalar path
+			for (int i = 0; i < 4; i++)
+			{
+				__m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + (x + i) * 4), zero), one);
+				texels[i] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+			}
+			__m128i words = _mm_packs_epi32(texels[0], texels[1]);
+			__m128i words2 = _mm_packs_epi32(texels[2], texels[3]);
+			_mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(words, words2));
+		}
+		return x;
+	}
+#endif
+
+	// source rows converted to RGBA float with PAD replicated texels on both ends, the last few are kept around
+	// since neighbouring destination rows share most of their source rows
+	class RowCache
+	{
+	private:
+		const unsigned char* m_src;
+		int m_width, m_height, m_components;
+		bool m_srgb;
+		int m_slots;
+		bool m_simd;
+		std::vector<float> m_rows;
+		std::vector<int> m_rowIndex;
+
+	public:
+		RowCache(const unsigned char* src, int width, int height, int components, bool srgb, int slots, MipKernel kernel)
+			: m_src(src), m_width(width), m_height(height), m_components(components), m_srgb(srgb && components >= 3), m_slots(slots),
+			m_simd(kernel != MipKernel::Scalar && components == 4 && !m_srgb), m_rows((size_t)slots * stride()), m_rowIndex(slots, -1)
+		{
+		}
+
+		size_t stride() const { return (size_t)(m_width + PAD * 2) * 4; }
+
+		// first real texel of row y, clamped to the image
+		const float* row(int y)
+		{
+			y = std::min(std::max(y, 0), m_height - 1);
+			int slot = y % m_slots;
+			float* base = &m_rows[slot * stride()];
+			if (m_rowIndex[slot] != y)
+			{
+				const Tables& t = tables();
+				const unsigned char* in = m_src + (size_t)y * m_width * m_components;
+				float* out = base + PAD * 4;
+				int x = 0;
+#ifdef MIP_X86
+				if (m_simd)
+					x = loadRGBA8SSE2(in, m_width, out);
+#endif
+				for (; x < m_width; x++)
+				{
+					for (int c = 0; c < 4; c++)
+					{
+						float v = 0.0f;
+						if (c < m_components)
+						{
+							unsigned char b = in[x * m_components + c];
+							v = (m_srgb && c < 3) ? t.srgbToLinear[b] : b / 255.0f;
+						}
+						out[x * 4 + c] = v;
+					}
+				}
+				for (int p = 0; p < PAD; p++)
+				{
+					std::memcpy(base + p * 4, out, 4 * sizeof(float));
+					std::memcpy(out + (m_width + p) * 4, out + (m_width - 1) * 4, 4 * sizeof(float));
+				}
+				m_rowIndex[slot] = y;
+			}
+			return base + PAD * 4;
+		}
+	};
+
+	void storeRow(const float* in, int width, int components, const MipOptions& options, MipKernel kernel, unsigned char* out)
+	{
+		const Tables& t = tables();
+		bool srgb = options.srgb && components >= 3;
+		int x = 0;
+#ifdef MIP_X86
+		if (kernel != MipKernel::Scalar && components == 4 && !srgb && !options.normalMap)
+			x = storeRGBA8SSE2(in, width, out);
+#endif
+		for (; x < width; x++)
+		{
+			float texel[4] = { in[x * 4 + 0], in[x * 4 + 1], in[x * 4 + 2], in[x * 4 + 3] };
+			if (options.normalMap && components >= 3)
+			{
+				float n[3] = { texel[0] * 2.0f - 1.0f, texel[1] * 2.0f - 1.0f, texel[2] * 2.0f - 1.0f };
+				float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length > 1e-4f)
+					for (int c = 0; c < 3; c++)
+						texel[c] = (n[c] / length) * 0.5f + 0.5f;
+			}
+			for (int c = 0; c < components; c++)
+			{
+				float v = std::min(std::max(texel[c], 0.0f), 1.0f); // the Kaiser lobes over and undershoot
+				out[x * components + c] = (srgb && c < 3) ? t.linearToSrgb[(int)(v * 4095.0f + 0.5f)] : (unsigned char)(v * 255.0f + 0.5f);
+			}
+		}
+	}
+
+	// Box: out[x] = average of the 2x2 block at 2x, 2y
+	// --------------------------------------------------
+	void boxScalar(const float* row0, const float* row1, int dstWidth, float* out)
+	{
+		for (int x = 0; x < dstWidth; x++)
+			for (int c = 0; c < 4; c++)
+				out[x * 4 + c] = (row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] + row1[x * 8 + 4 + c]) * 0.25f;
+	}
+
+	// Kaiser: separable, vertical into a padded full width row, then horizontal decimation
+	// ----------------------------------------------------------------------------------
+	void kaiserVerticalScalar(const float* const* rows, const float* weights, size_t floats, float* out)
+	{
+		for (size_t i = 0; i < floats; i++)
+		{
+			float sum = 0.0f;
+			for (int k = 0; k < KAISER_TAPS; k++)
+				sum += rows[k][i] * weights[k];
+			out[i] = sum;
+		}
+	}
+
+	void kaiserHorizontalScalar(const float* row, const float* weights, int dstWidth, float* out)
+	{
+		for (int x = 0; x < dstWidth; x++)
+		{
+			const float* first = row + (x * 2 - 3) * 4;
+			for (int c = 0; c < 4; c++)
+			{
+				float sum = 0.0f;
+				for (int k = 0; k < KAISER_TAPS; k++)
+					sum += first[k * 4 + c] * weights[k];
+				out[x * 4 + c] = sum;
+			}
+		}
+	}
+
+#ifdef MIP_X86
+	// one RGBA texel per register
+	void boxSSE2(const float* row0, const float* row1, int dstWidth, float* out)
+	{
+		const __m128 quarter = _mm_set1_ps(0.25f);
+		for (int x = 0; x < dstWidth; x++)
+		{
+			__m128 top = _mm_add_ps(_mm_loadu_ps(row0 + x * 8), _mm_loadu_ps(row0 + x * 8 + 4));
+			__m128 bottom = _mm_add_ps(_mm_loadu_ps(row1 + x * 8), _mm_loadu_ps(row1 + x * 8 + 4));
+			_mm_storeu_ps(out + x * 4, _mm_mul_ps(_mm_add_ps(top, bottom), quarter));
+		}
+	}
+
+	void kaiserVerticalSSE2(const float* const* rows, const float* weights, size_t floats, float* out)
+	{
+		__m128 w[KAISER_TAPS];
+		for (int k = 0; k < KAISER_TAPS; k++)
+			w[k] = _mm_set1_ps(weights[k]);
+		for (size_t i = 0; i < floats; i += 4) // padded rows are a multiple of 4 floats
+		{
+			__m128 sum = _mm_mul_ps(_mm_loadu_ps(rows[0] + i), w[0]);
+			for (int k = 1; k < KAISER_TAPS; k++)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), w[k]));
+			_mm_storeu_ps(out + i, sum);
+		}
+	}
+
+	void kaiserHorizontalSSE2(const float* row, const float* weights, int dstWidth, float* out)
+	{
+		__m128 w[KAISER_TAPS];
+		for (int k = 0; k < KAISER_TAPS; k++)
+			w[k] = _mm_set1_ps(weights[k]);
+		for (int x = 0; x < dstWidth; x++)
+		{
+			const float* first = row + (x * 2 - 3) * 4;
+			__m128 sum = _mm_mul_ps(_mm_loadu_ps(first), w[0]);
+			for (int k = 1; k < KAISER_TAPS; k++)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(first + k * 4), w[k]));
+			_mm_storeu_ps(out + x * 4, sum);
+		}
+	}
+
+	// two RGBA texels per register
+	MIP_TARGET_AVX2 void boxAVX2(const float* row0, const float* row1, int dstWidth, float* out)
+	{
+		const __m256 quarter = _mm256_set1_ps(0.25f);
+		int x = 0;
+		for (; x + 2 <= dstWidth; x += 2)
+		{
+			// [p0 p1] [p2 p3] -> [p0 p2] + [p1 p3]
+			__m256 a0 = _mm256_loadu_ps(row0 + x * 8), b0 = _mm256_loadu_ps(row0 + x * 8 + 8);
+			__m256 a1 = _mm256_loadu_ps(row1 + x * 8), b1 = _mm256_loadu_ps(row1 + x * 8 + 8);
+			__m256 top = _mm256_add_ps(_mm256_permute2f128_ps(a0, b0, 0x20), _mm256_permute2f128_ps(a0, b0, 0x31));
+			__m256 bottom = _mm256_add_ps(_mm256_permute2f128_ps(a1, b1, 0x20), _mm256_permute2f128_ps(a1, b1, 0x31));
+			_mm256_storeu_ps(out + x * 4, _mm256_mul_ps(_mm256_add_ps(top, bottom), quarter));
+		}
+		if (x < dstWidth)
+			boxSSE2(row0 + x * 8, row1 + x * 8, dstWidth - x, out + x * 4);
+	}
+
+	MIP_TARGET_AVX2 void kaiserVerticalAVX2(const float* const* rows, const float* weights, size_t floats, float* out)
+	{
+		__m256 w[KAISER_TAPS];
+		for (int k = 0; k < KAISER_TAPS; k++)
+			w[k] = _mm256_set1_ps(weights[k]);
+		size_t i = 0;
+		for (; i + 8 <= floats; i += 8)
+		{
+			__m256 sum = _mm256_mul_ps(_mm256_loadu_ps(rows[0] + i), w[0]);
+			for (int k = 1; k < KAISER_TAPS; k++)
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(rows[k] + i), w[k]));
+			_mm256_storeu_ps(out + i, sum);
+		}
+		if (i < floats)
+		{
+			const float* rest[KAISER_TAPS];
+			for (int k = 0; k < KAISER_TAPS; k++)
+				rest[k] = rows[k] + i;
+			kaiserVerticalSSE2(rest, weights, floats - i, out + i);
+		}
+	}
+
+	MIP_TARGET_AVX2 void kaiserHorizontalAVX2(const float* row, const float* weights, int dstWidth, float* out)
+	{
+		__m256 w[KAISER_TAPS];
+		for (int k = 0; k < KAISER_TAPS; k++)
+			w[k] = _mm256_set1_ps(weights[k]);
+		int x = 0;
+		for (; x + 2 <= dstWidth; x += 2)
+		{
+			// texels x and x+1 are two source texels apart
+			const float* first = row + (x * 2 - 3) * 4;
+			__m256 sum = _mm256_setzero_ps();
+			for (int k = 0; k < KAISER_TAPS; k++)
+			{
+				__m256 taps = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(first + k * 4)), _mm_loadu_ps(first + k * 4 + 8), 1);
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(taps, w[k]));
+			}
+			_mm256_storeu_ps(out + x * 4, sum);
+		}
+		if (x < dstWidth)
+			kaiserHorizontalSSE2(row + x * 8, weights, dstWidth - x, out + x * 4);
+	}
+#endif
+
+	MipKernel detectKernel()
+	{
+#ifdef MIP_X86
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] >= 7)
+		{
+			__cpuid(info, 1);
+			bool osAVX = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+			__cpuidex(info, 7, 0);
+			if (osAVX && (info[1] & (1 << 5)))
+				return MipKernel::AVX2;
+		}
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return MipKernel::AVX2;
+#endif
+		return MipKernel::SSE2;
+#else
+		return MipKernel::Scalar;
+#endif
+	}
+}
+
+MipKernel BestMipKernel()
+{
+	static const MipKernel best = detectKernel();
+	return best;
+}
+
+const char* MipKernelName(MipKernel kernel)
+{
+	switch (kernel)
+	{
+	case MipKernel::SSE2: return "SSE2";
+	case MipKernel::AVX2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+void DownsampleImage(const unsigned char* src, int width, int height, int components, const MipOptions& options, MipLevel& dst)
+{
+	dst.width = std::max(1, width / 2);
+	dst.height = std::max(1, height / 2);
+	dst.pixels.resize((size_t)dst.width * dst.height * components);
+
+	MipKernel kernel = std::min(options.kernel, BestMipKernel());
+	std::vector<float> filtered((size_t)dst.width * 4);
+
+	if (options.filter == MipFilter::Box)
+	{
+		RowCache cache(src, width, height, components, options.srgb, 2, kernel);
+		for (int y = 0; y < dst.height; y++)
+		{
+			const float* row0 = cache.row(y * 2);
+			const float* row1 = cache.row(y * 2 + 1);
+			switch (kernel)
+			{
+#ifdef MIP_X86
+			case MipKernel::AVX2: boxAVX2(row0, row1, dst.width, filtered.data()); break;
+			case MipKernel::SSE2: boxSSE2(row0, row1, dst.width, filtered.data()); break;
+#endif
+			default: boxScalar(row0, row1, dst.width, filtered.data()); break;
+			}
+			storeRow(filtered.data(), dst.width, components, options, kernel, &dst.pixels[(size_t)y * dst.width * components]);
+		}
+		return;
+	}
+
+	const float* weights = tables().kaiser;
+	RowCache cache(src, width, height, components, options.srgb, KAISER_TAPS, kernel);
+	std::vector<float> vertical(cache.stride());
+	for (int y = 0; y < dst.height; y++)
+	{
+		// padded rows, so the horizontal pass can read past both edges
+		const float* rows[KAISER_TAPS];
+		for (int k = 0; k < KAISER_TAPS; k++)
+			rows[k] = cache.row(y * 2 - 3 + k) - PAD * 4;
+		float* row = vertical.data() + PAD * 4;
+		switch (kernel)
+		{
+#ifdef MIP_X86
+		case MipKernel::AVX2:
+			kaiserVerticalAVX2(rows, weights, vertical.size(), vertical.data());
+			kaiserHorizontalAVX2(row, weights, dst.width, filtered.data());
+			break;
+		case MipKernel::SSE2:
+			kaiserVerticalSSE2(rows, weights, vertical.size(), vertical.data());
+			kaiserHorizontalSSE2(row, weights, dst.width, filtered.data());
+			break;
+#endif
+		default:
+			kaiserVerticalScalar(rows, weights, vertical.size(), vertical.data());
+			kaiserHorizontalScalar(row, weights, dst.width, filtered.data());
+			break;
+		}
+		storeRow(filtered.data(), dst.width, components, options, kernel, &dst.pixels[(size_t)y * dst.width * components]);
+	}
+}
+
+void BuildMipChain(const unsigned char* src, int width, int height, int components, const MipOptions& options, std::vector<MipLevel>& levels)
+{
+	levels.clear();
+	if (options.maxSize <= 0 || std::max(width, height) <= options.maxSize)
+		levels.push_back({ width, height, std::vector<unsigned char>(src, src + (size_t)width * height * components) });
+
+	MipLevel level;
+	const unsigned char* pixels = src;
+	while (width > 1 || height > 1)
+	{
+		MipLevel next;
+		DownsampleImage(pixels, width, height, components, options, next);
+		width = next.width;
+		height = next.height;
+		if (options.maxSize <= 0 || std::max(width, height) <= options.maxSize)
+		{
+			levels.push_back(std::move(next));
+			pixels = levels.back().pixels.data();
+		}
+		else
+		{
+			// too big to upload, only kept as the source of the next level
+			level = std::move(next);
+			pixels = level.pixels.data();
+		}
+	}
+}
+
+void BenchmarkMipBuilder(const unsigned char* src, int width, int height, int components)
+{
+	const MipFilter filters[] = { MipFilter::Box, MipFilter::Kaiser };
+	const MipKernel kernels[] = { MipKernel::Scalar, MipKernel::SSE2, MipKernel::AVX2 };
+	const int iterations = std::max(3, (int)(16 * 1024 * 1024 / ((size_t)width * height)));
+
+	std::cout << "MIPS::BENCH " << width << "x" << height << "x" << components << ", " << iterations << " iterations, best kernel "
+		<< MipKernelName(BestMipKernel()) << std::endl;
+	for (MipFilter filter : filters)
+	{
+		for (bool srgb : { false, true })
+		{
+			std::vector<MipLevel> reference;
+			double referenceMs = 0.0;
+			for (MipKernel kernel : kernels)
+			{
+				if (kernel > BestMipKernel())
+					break;
+				MipOptions options;
+				options.filter = filter;
+				options.srgb = srgb;
+				options.kernel = kernel;
+
+				std::vector<MipLevel> levels;
+				Timer timer;
+				for (int i = 0; i < iterations; i++)
+					BuildMipChain(src, width, height, components, options, levels);
+				double ms = timer.elapsedMs() / iterations;
+
+				int maxError = 0;
+				if (kernel == MipKernel::Scalar)
+				{
+					reference = levels;
+					referenceMs = ms;
+				}
+				else
+				{
+					for (size_t l = 0; l < levels.size(); l++)
+						for (size_t i = 0; i < levels[l].pixels.size(); i++)
+							maxError = std::max(maxError, std::abs(levels[l].pixels[i] - reference[l].pixels[i]));
+				}
+				std::cout << "  " << (filter == MipFilter::Box ? "box   " : "kaiser") << (srgb ? " srgb   " : " linear ") << MipKernelName(kernel)
+					<< " " << ms << " ms (" << referenceMs / ms << "x, max error " << maxError << ")" << std::endl;
+			}
+		}
+	}
+}
@@ -0,0 +1,185 @@
+//RenderQueue.cpp
+#include "Headers/RenderQueue.h"
+#include "Headers/Timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	const int FINE_DEPTH_BITS = 21;
+	const int VERTEX_ARRAY_BITS = 12;
+	const int MATERIAL_BITS = 14;
+	const int BUCKET_BITS = 3;
+	const int PROGRAM_BITS = 10;
+	const int PASS_BITS = 4;
+	const int DEPTH_BITS = BUCKET_BITS + FINE_DEPTH_BITS;
+
+	const int DIGIT_BITS = 11;
+	const int DIGITS = (64 + DIGIT_BITS - 1) / DIGIT_BITS;
+	const int RADIX = 1 << DIGIT_BITS;
+	const uint64_t DIGIT_MASK = RADIX - 1;
+
+	// where each value of a digit starts in the sorted order
+	void prefixSums(const uint32_t* histogram, uint32_t* offsets)
+	{
+		uint32_t sum = 0;
+		for (int value = 0; value < RADIX; value++)
+		{
+			offsets[value] = sum;
+			sum += histogram[value];
+		}
+	}
+
+	uint64_t field(uint64_t value, int bits, int shift)
+	{
+		return (value & ((1ull << bits) - 1)) << shift;
+	}
+
+	// xorshift, the benchmark wants the same keys on every run
+	uint32_t nextRandom(uint32_t& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+}
+
+uint64_t RenderQueue::MakeKey(unsigned int pass, unsigned int program, unsigned int material, unsigned int vertexArray, float depth)
+{
+	depth = std::min(std::max(depth, 0.0f), 1.0f);
+	uint64_t quantized = (uint64_t)(depth * ((1 << DEPTH_BITS) - 1));
+	uint64_t bucket = quantized >> FINE_DEPTH_BITS;
+	int shift = 0;
+	uint64_t key = field(quantized, FINE_DEPTH_BITS, shift);
+	key |= field(vertexArray, VERTEX_ARRAY_BITS, shift += FINE_DEPTH_BITS);
+	key |= field(material, MATERIAL_BITS, shift += VERTEX_ARRAY_BITS);
+	key |= field(bucket, BUCKET_BITS, shift += MATERIAL_BITS);
+	key |= field(program, PROGRAM_BITS, shift += BUCKET_BITS);
+	key |= field(pass, PASS_BITS, shift += PROGRAM_BITS);
+	return key;
+}
+
+float RenderQueue::NormalizeDepth(float distance, float nearPlane, float farPlane)
+{
+	if (distance <= nearPlane)
+		return 0.0f;
+	return std::log(distance / nearPlane) / std::log(farPlane / nearPlane);
+}
+
+int RenderQueue::sort()
+{
+	const size_t count = m_items.size();
+	if (count < 2)
+		return 0;
+
+	// every digit's histogram from one read of the keys, the offsets after them
+	m_counts.assign((DIGITS + 1) * RADIX, 0);
+	uint32_t* histograms[DIGITS];
+	for (int digit = 0; digit < DIGITS; digit++)
+		histograms[digit] = &m_counts[digit * RADIX];
+	uint32_t* offsets = &m_counts[DIGITS * RADIX];
+	for (size_t i = 0; i < count; i++)
+	{
+		const uint64_t key = m_items[i].key;
+		for (int digit = 0; digit < DIGITS; digit++)
+			histograms[digit][(key >> (digit * DIGIT_BITS)) & DIGIT_MASK]++;
+	}
+
+	// a digit that is the same in every key, often the pass and program one, would only copy
+	int digits[DIGITS];
+	int passes = 0;
+	for (int digit = 0; digit < DIGITS; digit++)
+		if (histograms[digit][(m_items[0].key >> (digit * DIGIT_BITS)) & DIGIT_MASK] != count)
+			digits[passes++] = digit;
+	if (passes == 0)
+		return 0;
+
+	// the first pass reads the items and the last one writes them, those between only move pairs
+	m_scratch.resize(count);
+	int shift = digits[0] * DIGIT_BITS;
+	prefixSums(histograms[digits[0]], offsets);
+	if (passes == 1)
+	{
+		for (size_t i = 0; i < count; i++)
+			m_scratch[offsets[(m_items[i].key >> shift) & DIGIT_MASK]++] = m_items[i];
+		m_items.swap(m_scratch);
+		return passes;
+	}
+	m_pairs.resize(count);
+	m_pairScratch.resize(count);
+	SortPair* source = m_pairs.data();
+	SortPair* target = m_pairScratch.data();
+	for (size_t i = 0; i < count; i++)
+		source[offsets[(m_items[i].key >> shift) & DIGIT_MASK]++] = { m_items[i].key, (uint32_t)i };
+	for (int pass = 1; pass < passes - 1; pass++)
+	{
+		shift = digits[pass] * DIGIT_BITS;
+		prefixSums(histograms[digits[pass]], offsets);
+		for (size_t i = 0; i < count; i++)
+			target[offsets[(source[i].key >> shift) & DIGIT_MASK]++] = source[i];
+		std::swap(source, target);
+	}
+	shift = digits[passes - 1] * DIGIT_BITS;
+	prefixSums(histograms[digits[passes - 1]], offsets);
+	for (size_t i = 0; i < count; i++)
+		m_scratch[offsets[(source[i].key >> shift) & DIGIT_MASK]++] = m_items[source[i].index];
+	m_items.swap(m_scratch);
+	return passes;
+}
+
+void RenderQueue::passRange(unsigned int pass, const RenderItem*& first, const RenderItem*& last) const
+{
+	const RenderItem* begin = m_items.data();
+	const RenderItem* end = begin + m_items.size();
+	first = std::lower_bound(begin, end, pass, [](const RenderItem& item, unsigned int p) { return Pass(item.key) < p; });
+	last = std::lower_bound(first, end, pass + 1, [](const RenderItem& item, unsigned int p) { return Pass(item.key) < p; });
+}
+
+void BenchmarkRenderQueue(size_t count)
+{
+	// a shadow and an opaque pass over a few hundred materials and vertex arrays, plus a couple of programs
+	uint32_t random = 0x9E3779B9u;
+	std::vector<RenderItem> items(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned int pass = nextRandom(random) % 2;
+		unsigned int program = pass == 0 ? 3 : 5 + nextRandom(random) % 2;
+		unsigned int material = nextRandom(random) % 300;
+		unsigned int vertexArray = nextRandom(random) % 400;
+		float depth = (nextRandom(random) & 0xFFFFFF) / float(0xFFFFFF);
+		items[i] = { RenderQueue::MakeKey(pass, program, material, vertexArray, depth), (uint32_t)i, 0 };
+	}
+
+	const int iterations = std::max(5, (int)(10 * 1000 * 1000 / std::max<size_t>(count, 1)));
+	RenderQueue queue;
+	double radixMs = 1e30;
+	int moved = 0;
+	for (int i = 0; i < iterations; i++)
+	{
+		queue.clear();
+		for (const RenderItem& item : items)
+			queue.push(item.key, item.object, item.part);
+		Timer timer;
+		moved = queue.sort();
+		radixMs = std::min(radixMs, timer.elapsedMs());
+	}
+
+	std::vector<RenderItem> reference;
+	double stdMs = 1e30;
+	for (int i = 0; i < iterations; i++)
+	{
+		reference = items;
+		Timer timer;
+		std::stable_sort(reference.begin(), reference.end(), [](const RenderItem& a, const RenderItem& b) { return a.key < b.key; });
+		stdMs = std::min(stdMs, timer.elapsedMs());
+	}
+
+	bool same = true;
+	for (size_t i = 0; i < count && same; i++)
+		same = queue.items()[i].key == reference[i].key && queue.items()[i].object == reference[i].object;
+	std::cout << "RENDERQUEUE::BENCH " << count << " items, best of " << iterations << ": radix " << radixMs << " ms (" << moved
+		<< " of " << DIGITS << " digit passes), std::stable_sort " << stdMs << " ms, " << (same ? "same order" : "ORDER MISMATCH") << std::endl;
+}
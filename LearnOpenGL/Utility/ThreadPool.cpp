@@ -0,0 +1,45 @@
+//ThreadPool.cpp
+#include "Headers/ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned int threadCount) : m_stopping(false)
+{
+	if (threadCount == 0)
+		threadCount = 1;
+	m_workers.reserve(threadCount);
+	for (unsigned int i = 0; i < threadCount; i++)
+		m_workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& worker : m_workers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::Shared()
+{
+	static ThreadPool pool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1);
+	return pool;
+}
+
+void ThreadPool::workerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+			if (m_stopping && m_tasks.empty())
+				return;
+			task = std::move(m_tasks.front());
+			m_tasks.pop();
+		}
+		task();
+	}
+}
@@ -1,27 +1,21 @@
 //Timer.cpp
-#include <chrono> 
+#include "Headers/Timer.h"
 
-class Timer
+Timer::Timer() : m_beg(clock_t::now())
 {
-private:
-	// Type aliases to make accessing nested type easier
-	using clock_t = std::chrono::high_resolution_clock;
-	using second_t = std::chrono::duration<double, std::ratio<1> >;
+}
 
-	std::chrono::time_point<clock_t> m_beg;
-
-public:
-	Timer() : m_beg(clock_t::now())
-	{
-	}
+void Timer::reset()
+{
+	m_beg = clock_t::now();
+}
 
-	void reset()
-	{
-		m_beg = clock_t::now();
-	}
+double Timer::elapsed() const
+{
+	return std::chrono::duration_cast<second_t>(clock_t::now() - m_beg).count();
+}
 
-	double elapsed() const
-	{
-		return std::chrono::duration_cast<second_t>(clock_t::now() - m_beg).count();
-	}
-};
+double Timer::elapsedMs() const
+{
+	return elapsed() * 1000.0;
+}
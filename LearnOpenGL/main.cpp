@@ -7,13 +7,21 @@
 
 #include <iostream>
 #include "Shader.h"
+#include "GLState.h"
 #include "Camera.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #include "Model.h"
+#include "Scene.h"
+#include "TextureCache.h"
+#include "UploadRing.h"
+#include "CubemapLoader.h"
+#include "TextureCooker.h"
 
 #include "Utility/Headers/PRNG.h";
+#include "Utility/Headers/RenderQueue.h"
+#include "Utility/Headers/Timer.h"
 
 #include "Imgui/imgui.h"
 #include "Imgui/imgui_impl_opengl3.h"
@@ -25,11 +33,10 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
-unsigned int loadTexture(char const * path, bool gammaCorrection);
-unsigned int loadCubemap(std::vector<std::string> faces);
 void renderScene(const Shader &shader);
 void renderCube();
 void renderQuad();
+glm::mat4 instanceTransform(int instance, int count);
 
 // settings
 const unsigned int SCR_WIDTH = 1000;
@@ -47,17 +54,112 @@ float lastFrame = 0.0f; // Time of last frame
 
 Camera myCamera;
 
-int main()
+int main(int argc, char** argv)
 {
+	Timer startupTimer;
+	// offline: LearnOpenGL --cook <model or directory>... writes compressed textures and exits
+	if (argc > 1 && std::string(argv[1]) == "--cook")
+		return CookAssets(std::vector<std::string>(argv + 2, argv + argc));
+	// LearnOpenGL --bench-mips <image> times the SIMD mip kernels against the scalar one and exits
+	if (argc > 2 && std::string(argv[1]) == "--bench-mips")
+		return BenchmarkMips(argv[2]);
+	// LearnOpenGL --bench-blend <model.blend> <model.fbx> times the native .blend import against Assimp, the .fbx
+	// being what Blender's FBX export made of the same file
+	if (argc > 3 && std::string(argv[1]) == "--bench-blend")
+		return Model::BenchmarkBlend(argv[2], argv[3]);
+	// LearnOpenGL --bench-sort [count] times RenderQueue's radix sort against std::stable_sort, 100000 items by default
+	if (argc > 1 && std::string(argv[1]) == "--bench-sort")
+	{
+		BenchmarkRenderQueue(argc > 2 ? (size_t)std::max(std::atoi(argv[2]), 1) : 100000);
+		return 0;
+	}
+
+	// quality tier: --max-texture-size <pixels> --mip-filter box|kaiser
+	// --separate-buffers keeps a vertex array per mesh instead of merging each model's buffers
+	// --upload-budget-mb <MB> caps the texture bytes uploaded per frame while streaming
+	// --texture-budget-mb <MB> is the VRAM streamed texture mips are dropped to stay under
+	// --instances <count> draws that many copies of the model in a grid, to see what mesh LOD saves
+	// --skybox <file> loads the skybox from one cross, equirectangular .hdr or .ktx file instead of six faces
+	// --scene <file> is the manifest of shaders, textures, models and lights to load, see Scene.h
+	// --sequential-load loads the scene one asset after the other, to compare the time to first frame
+	// --import-report <file> writes every model's import profile as JSON once its textures are uploaded
+	// --indirect draws each model with glMultiDrawElementsIndirect where GL 4.3 is available
+	TextureQuality textureQuality;
+	bool mergeBuffers = true;
+	bool parallelLoad = true;
+	bool multiDrawIndirect = false;
+	std::string skyboxFile;
+	std::string sceneFile = "scenes/default.scene";
+	std::string importReport;
+	int modelInstances = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--separate-buffers")
+			mergeBuffers = false;
+		else if (std::string(argv[i]) == "--sequential-load")
+			parallelLoad = false;
+		else if (std::string(argv[i]) == "--indirect")
+			multiDrawIndirect = true;
+	}
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--max-texture-size")
+			textureQuality.maxTextureSize = std::atoi(argv[++i]);
+		else if (arg == "--mip-filter")
+			textureQuality.mipFilter = std::string(argv[++i]) == "kaiser" ? MipFilter::Kaiser : MipFilter::Box;
+		else if (arg == "--upload-budget-mb")
+			TextureCache::Shared().SetUploadBudget((size_t)(std::atof(argv[++i]) * 1024 * 1024));
+		else if (arg == "--texture-budget-mb")
+			TextureCache::Shared().SetMemoryBudget((size_t)(std::atof(argv[++i]) * 1024 * 1024));
+		else if (arg == "--instances")
+			modelInstances = std::max(std::atoi(argv[++i]), 1);
+		else if (arg == "--skybox")
+			skyboxFile = argv[++i];
+		else if (arg == "--scene")
+			sceneFile = argv[++i];
+		else if (arg == "--import-report")
+			importReport = argv[++i];
+	}
+
+	SceneManifest manifest;
+	if (!SceneManifest::Read(sceneFile, manifest))
+		return -1;
+	if (manifest.models.empty())
+	{
+		std::cout << "ERROR::SCENE::NO_MODEL " << sceneFile << std::endl;
+		return -1;
+	}
+	if (!skyboxFile.empty())
+		for (SceneManifest::CubemapEntry &cubemap : manifest.cubemaps)
+			if (cubemap.name == "skybox")
+				cubemap.faces = { skyboxFile };
+	// a grid of copies of the first model instead of the manifest's instances
+	if (modelInstances > 0)
+	{
+		manifest.instances.clear();
+		for (int i = 0; i < modelInstances; i++)
+			manifest.instances.push_back({ manifest.models[0].name, instanceTransform(i, modelInstances) });
+	}
+	TextureCache::Shared().SetQuality(textureQuality);
+
 	SetSeed();
 	glfwInit();
 	// GL 3.0 + GLSL 130
 	const char* glsl_version = "#version 130";
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Dear ImGui GLFW+OpenGL3 example", NULL, NULL);
+	// 4.3 for multi-draw indirect, drivers that hand out exactly the version asked for would otherwise stay at 3.3
+	GLFWwindow* window = NULL;
+	const int contextVersions[][2] = { { 4, 3 }, { 3, 3 } };
+	for (const auto &version : contextVersions)
+	{
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+		window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Dear ImGui GLFW+OpenGL3 example", NULL, NULL);
+		if (window != NULL)
+			break;
+	}
 	if (window == NULL)
 	{
 		std::cout << "Failed to create GLFW window" << std::endl;
@@ -73,6 +175,7 @@ int main()
 		glfwTerminate();
 		return -1;
 	}
+	std::cout << "CONTEXT::GL " << glGetString(GL_VERSION) << (Model::IndirectSupported() ? ", multi-draw indirect" : ", drawing per mesh") << std::endl;
 
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -142,78 +245,89 @@ int main()
 		 1.0f, -1.0f,  1.0f
 	};
 
-	std::vector<std::string> faces
+	// models stream in on a background thread, Update() in the render loop uploads what is ready
+	ModelOptions streamingOptions;
+	streamingOptions.async = true;
+	streamingOptions.quantizeVertices = true;
+	streamingOptions.mergeBuffers = mergeBuffers;
+	streamingOptions.multiDrawIndirect = multiDrawIndirect;
+	streamingOptions.streamTextures = true;
+	streamingOptions.generateLods = true;
+	streamingOptions.buildMeshlets = true;
+	LodView lodView;
+	lodView.viewportHeight = (float)SCR_HEIGHT;
+	lodView.cullMeshlets = true;
+
+	// shaders, textures and the skybox load in parallel where their dependencies allow, see Scene.h
+	Scene scene;
+	if (!scene.Load(manifest, streamingOptions, parallelLoad))
 	{
-		"textures/lightblue/right.png",
-		"textures/lightblue/left.png",
-		"textures/lightblue/top.png",
-		"textures/lightblue/bottom.png",
-		"textures/lightblue/front.png",
-		"textures/lightblue/back.png",
-	};
+		glfwTerminate();
+		return -1;
+	}
+	// the stats window reports on the manifest's first model
+	Model &Zero = *scene.models.front();
+	bool firstFrame = true;
+	double firstFrameMs = 0.0;
 
-	//Model SponzaModel("models/Sponza/sponza.obj");
-	Model Zero("models/plane.fbx");
+	// binds and fixed function state go through the state cache, which drops what is already set, see GLState.h
+	GLState &glState = GLState::Shared();
 
 	unsigned int skyboxVAO, skyboxVBO;
 	glGenVertexArrays(1, &skyboxVAO);
 	glGenBuffers(1, &skyboxVBO);
-	glBindVertexArray(skyboxVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
+	glState.BindVertexArray(skyboxVAO);
+	glState.BindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), skyboxVertices, GL_STATIC_DRAW);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
-	glBindVertexArray(0);
-
-	unsigned int skyboxTexture = loadCubemap(faces);
-	unsigned int diff = loadTexture("textures/wood.png", false);
-	unsigned int spec = loadTexture("textures/download.png", false);
-	unsigned int norm = loadTexture("textures/toy_box_normal.png", false);
-	unsigned int depth = loadTexture("textures/toy_box_disp.png", false);
-
-	Shader shadowMapShader("shaders/shadowlight.vert", "shaders/shadowlight.frag");
-	Shader shadowCubeMapShader("shaders/shadowcubemap.vert", "shaders/shadowcubemap.geom", "shaders/shadowcubemap.frag");
-	Shader debugDepthShader("shaders/texture.vert", "shaders/depth.frag");
-	Shader lightingShader("shaders/vertex.vert", "shaders/lighting.frag");
-	Shader skyboxShader("shaders/skybox.vert", "shaders/skybox.frag");
-	Shader colorShader("shaders/vertex.vert", "shaders/color.frag");
-	Shader renderShader("shaders/texture.vert", "shaders/texture.frag");
-	Shader blurShader("shaders/texture.vert", "shaders/blur.frag");
-
-	unsigned int uniformBlockIndex = glGetUniformBlockIndex(lightingShader.ID, "Matrices");
-	glUniformBlockBinding(lightingShader.ID, uniformBlockIndex, 0);
-	glUniformBlockBinding(colorShader.ID, uniformBlockIndex, 0);
+	glState.BindVertexArray(0);
+
+	unsigned int skyboxTexture = scene.GetCubemap("skybox");
+	TextureHandle diff = scene.GetTexture("diffuse");
+	TextureHandle spec = scene.GetTexture("specular");
+	TextureHandle norm = scene.GetTexture("normal");
+	TextureHandle depth = scene.GetTexture("depth");
+
+	Shader &shadowMapShader = scene.GetShader("shadowMap");
+	Shader &shadowCubeMapShader = scene.GetShader("shadowCubeMap");
+	Shader &debugDepthShader = scene.GetShader("debugDepth");
+	Shader &lightingShader = scene.GetShader("lighting");
+	Shader &skyboxShader = scene.GetShader("skybox");
+	Shader &colorShader = scene.GetShader("color");
+	Shader &renderShader = scene.GetShader("render");
+	Shader &blurShader = scene.GetShader("blur");
 
 	unsigned int uboMatrices;
 	glGenBuffers(1, &uboMatrices);
-	glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
+	glState.BindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
 	glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), NULL, GL_STATIC_DRAW);
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glState.BindBuffer(GL_UNIFORM_BUFFER, 0);
 	// define the range of the buffer that links to a uniform binding point
-	glBindBufferRange(GL_UNIFORM_BUFFER, 0, uboMatrices, 0, 2 * sizeof(glm::mat4));
+	glState.BindBufferRange(GL_UNIFORM_BUFFER, 0, uboMatrices, 0, 2 * sizeof(glm::mat4));
 
 	//ModelViewProjectionMatricis 
 	glm::mat4 model = glm::mat4(1.0f);
 	glm::mat4 view = glm::mat4(1.0f);
 	glm::mat4 projection = glm::perspective(glm::radians(myCamera.Zoom), (float)SCR_HEIGHT / (float)SCR_HEIGHT, 0.1f, 100.0f); 	// note that we're translating the scene in the reverse direction of where we want to move		
 
-	glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
+	glState.BindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
 	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(projection));
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glState.BindBuffer(GL_UNIFORM_BUFFER, 0);
 
 	// configure MSAA framebuffer
 	// --------------------------
 	unsigned int framebuffer;
 	glGenFramebuffers(1, &framebuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glState.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 	// create a multisampled color attachment texture
 	unsigned int textureColorBuffersMultiSampled[2];
 	glGenTextures(2, textureColorBuffersMultiSampled);
 	for (size_t i = 0; i < 2; i++)
 	{
-		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, textureColorBuffersMultiSampled[i]);
+		glState.BindTexture(GL_TEXTURE_2D_MULTISAMPLE, textureColorBuffersMultiSampled[i]);
 		glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 4, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, GL_TRUE);
-		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+		glState.BindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D_MULTISAMPLE, textureColorBuffersMultiSampled[i], 0);
 	}
 	unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
@@ -229,17 +343,17 @@ int main()
 
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.BindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	// configure second post-processing framebuffer
 	unsigned int intermediateFBO;
 	glGenFramebuffers(1, &intermediateFBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+	glState.BindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
 	unsigned int colorBuffers[2];
 	glGenTextures(2, colorBuffers);
 	for (size_t i = 0; i < 2; i++)
 	{
-		glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
+		glState.BindTexture(GL_TEXTURE_2D, colorBuffers[i]);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -258,7 +372,7 @@ int main()
 
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "ERROR::FRAMEBUFFER:: Intermediate framebuffer is not complete!" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.BindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	unsigned int pingpongFBO[2];
 	unsigned int pingPongBuffer[2];
@@ -266,8 +380,8 @@ int main()
 	glGenTextures(2, pingPongBuffer);
 	for (unsigned int i = 0; i < 2; i++)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-		glBindTexture(GL_TEXTURE_2D, pingPongBuffer[i]);
+		glState.BindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
+		glState.BindTexture(GL_TEXTURE_2D, pingPongBuffer[i]);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -277,7 +391,7 @@ int main()
 	}
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "ERROR::FRAMEBUFFER:: Intermediate framebuffer is not complete!" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.BindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
 	unsigned int depthMapFBO;
@@ -285,7 +399,7 @@ int main()
 
 	/*unsigned int shadowDepthMap;
 	glGenTextures(1, &shadowDepthMap);
-	glBindTexture(GL_TEXTURE_2D, shadowDepthMap);
+	glState.BindTexture(GL_TEXTURE_2D, shadowDepthMap);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
 		SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -294,7 +408,7 @@ int main()
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
 	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+	glState.BindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowDepthMap, 0);
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
@@ -302,13 +416,13 @@ int main()
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "ERROR::FRAMEBUFFER:: Intermediate framebuffer is not complete!" << std::endl;
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.BindFramebuffer(GL_FRAMEBUFFER, 0);
 	*/
 
 	// create depth cubemap texture
 	unsigned int shadowDepthCubemap;
 	glGenTextures(1, &shadowDepthCubemap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, shadowDepthCubemap);
+	glState.BindTexture(GL_TEXTURE_CUBE_MAP, shadowDepthCubemap);
 	for (unsigned int i = 0; i < 6; ++i)
 		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -317,7 +431,7 @@ int main()
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	// attach depth texture as FBO's depth buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+	glState.BindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
 	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowDepthCubemap, 0);
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
@@ -325,17 +439,31 @@ int main()
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "ERROR::FRAMEBUFFER:: ShadowMap framebuffer is not complete!" << std::endl;
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// fixed function state of the passes, each Apply only changes what differs from the block applied before
+	DepthState sceneDepth;
+	sceneDepth.test = true;
+	DepthState skyboxDepth = sceneDepth;
+	skyboxDepth.func = GL_LEQUAL; // the skybox is drawn at the far plane, where the cleared depth buffer is
+	DepthState screenDepth; // so the screen-space quad isn't discarded by the depth test
+	RasterState sceneRaster;
+	sceneRaster.cull = true;
+	BlendState alphaBlend;
+	alphaBlend.enabled = true;
+	alphaBlend.source = GL_SRC_ALPHA;
+	alphaBlend.destination = GL_ONE_MINUS_SRC_ALPHA;
+	StencilState sceneStencil;
+	sceneStencil.test = true;
+	sceneStencil.depthPass = GL_REPLACE;
 
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_STENCIL_TEST);
-	glEnable(GL_BLEND);
-	glEnable(GL_CULL_FACE);
-	glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	//glCullFace(GL_BACK);
-	//glFrontFace(GL_CCW);
+	glState.Apply(sceneDepth);
+	glState.Apply(sceneStencil);
+	glState.Apply(alphaBlend);
+	glState.Apply(sceneRaster);
+	// the skybox is mipped, filter across cube face edges at the smaller levels
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 	glEnable(GL_PROGRAM_POINT_SIZE);
 
 	glfwWindowHint(GLFW_SAMPLES, 4);
@@ -348,11 +476,30 @@ int main()
 
 	// lighting info
 	// -------------
-	glm::vec3 lightPos(0, 1, -2);
-	glm::vec3 lightColor(1);
-	float lightAmbient = 0.0f;
-	float lightDiffuse = 0.4f;
-	float lightSpecular = 2.5f;
+	SceneLight light = scene.lights.empty() ? SceneLight() : scene.lights.front();
+	glm::vec3 lightPos = light.position;
+	glm::vec3 lightColor = light.color;
+	float lightAmbient = light.ambient;
+	float lightDiffuse = light.diffuse;
+	float lightSpecular = light.specular;
+
+	// uniforms set per object or per cube face, resolved once rather than looked up by name each time
+	Uniform<glm::mat4> shadowModel = shadowCubeMapShader.uniform<glm::mat4>("model");
+	Uniform<glm::mat4> lightingModel = lightingShader.uniform<glm::mat4>("model");
+	Uniform<glm::mat4> shadowMatrices[6];
+	for (unsigned int i = 0; i < 6; ++i)
+		shadowMatrices[i] = shadowCubeMapShader.uniform<glm::mat4>("shadowMatrices[" + std::to_string(i) + "]");
+	UniformLookupStats frameLookups;
+	GLStateStats frameState;
+
+	// every draw of a frame is queued first and submitted sorted, pass by pass in this order
+	enum RenderPass { PASS_SHADOW, PASS_OPAQUE, PASS_SKY };
+	// object ids of the draws that aren't scene objects
+	const uint32_t LIGHT_CUBE = 0xFFFFFFF0u;
+	const uint32_t SKYBOX = 0xFFFFFFF1u;
+	const uint32_t NO_OBJECT = 0xFFFFFFFFu;
+	RenderQueue renderQueue;
+	double sortMs = 0.0;
 
 	// render loop
 	while (!glfwWindowShouldClose(window))
@@ -370,6 +517,36 @@ int main()
 		// input
 		processInput(window);
 
+		// uniform lookups and GL state calls of the previous frame, for the stats window
+		frameLookups = Shader::LookupStats();
+		Shader::LookupStats() = UniformLookupStats();
+		frameState = glState.Stats();
+		glState.ResetStats();
+
+		// upload whatever the loaders finished, bounded so frame time stays flat
+		bool profilesComplete = true;
+		for (const std::unique_ptr<Model> &sceneModel : scene.models)
+		{
+			sceneModel->Update();
+			sceneModel->ResetDrawStats();
+			profilesComplete = profilesComplete && sceneModel->ProfileComplete();
+		}
+		if (!importReport.empty() && profilesComplete)
+		{
+			std::ofstream report(importReport);
+			report << "[\n";
+			for (size_t i = 0; i < scene.models.size(); i++)
+				report << scene.models[i]->Profile().json(manifest.models[i].path) << (i + 1 < scene.models.size() ? ",\n" : "\n");
+			report << "]\n";
+			std::cout << (report ? "MODEL::PROFILE_JSON " : "ERROR::MODEL::PROFILE_JSON ") << importReport << std::endl;
+			importReport.clear();
+		}
+		for (const SceneObject &object : scene.objects)
+			object.model->RequestTextureDetail(object.transform, myCamera.Position, glm::radians(myCamera.Zoom), (float)SCR_HEIGHT);
+		lodView.cameraPos = myCamera.Position;
+		lodView.fovY = glm::radians(myCamera.Zoom);
+		TextureCache::Shared().Update(2.0);
+
 		// render
 		// ------
 
@@ -390,14 +567,31 @@ int main()
 		shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, 0.0, 1.0), glm::vec3(0.0, -1.0, 0.0)));
 		shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, 0.0, -1.0), glm::vec3(0.0, -1.0, 0.0)));
 
+		// shadow depth is measured from the light, the rest from the camera; the skybox is at the far plane
+		Timer sortTimer;
+		renderQueue.clear();
+		for (uint32_t i = 0; i < scene.objects.size(); i++)
+		{
+			const SceneObject &object = scene.objects[i];
+			object.model->Enqueue(renderQueue, PASS_SHADOW, shadowCubeMapShader, object.transform, lightPos, near, far, i);
+			object.model->Enqueue(renderQueue, PASS_OPAQUE, lightingShader, object.transform, myCamera.Position, 0.1f, 100.0f, i);
+		}
+		float lightCubeDepth = RenderQueue::NormalizeDepth(glm::length(lightPos - myCamera.Position), 0.1f, 100.0f);
+		renderQueue.push(RenderQueue::MakeKey(PASS_OPAQUE, colorShader.ID, 0, 0, lightCubeDepth), LIGHT_CUBE, 0);
+		renderQueue.push(RenderQueue::MakeKey(PASS_SKY, skyboxShader.ID, 0, skyboxVAO, 1.0f), SKYBOX, 0);
+		renderQueue.sort();
+		sortMs = sortTimer.elapsedMs();
+		const RenderItem *first, *last;
+		uint32_t currentObject;
+
 		// 1. render scene to depth cubemap
 	   // --------------------------------
-		glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-		glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+		glState.Viewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+		glState.BindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
 		glClear(GL_DEPTH_BUFFER_BIT);
 		shadowCubeMapShader.use();
 		for (unsigned int i = 0; i < 6; ++i)
-			shadowCubeMapShader.setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
+			shadowMatrices[i].set(shadowTransforms[i]);
 		shadowCubeMapShader.setFloat("far_plane", far_plane);
 		shadowCubeMapShader.setVec3("lightPos", lightPos);
 
@@ -412,11 +606,11 @@ int main()
 		//shadowMapShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
 
 
-		glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-		glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-		glEnable(GL_DEPTH_TEST);
+		glState.Viewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+		glState.BindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+		glState.Apply(sceneDepth);
 		glClear(GL_DEPTH_BUFFER_BIT);
-		glCullFace(GL_BACK);
+		glState.Apply(sceneRaster);
 
 		shadowCubeMapShader.use();
 
@@ -427,25 +621,34 @@ int main()
 		shadowCubeMapShader.setMat4("model", model);
 		//renderCube();
 
-		model = glm::mat4(1.0f);
-		//model = glm::rotate(model, glm::radians(currentTime) * 5, glm::vec3(1, 1, 1));
-		model = glm::scale(model, glm::vec3(0.05f));
-		shadowCubeMapShader.setMat4("model", model);
-		Zero.Draw(shadowCubeMapShader);
+		// the shadow cubemap looks in every direction from the light, nothing can be culled for the camera
+		LodView shadowLodView = lodView;
+		shadowLodView.cullMeshlets = false;
+		renderQueue.passRange(PASS_SHADOW, first, last);
+		currentObject = NO_OBJECT;
+		for (const RenderItem *item = first; item != last; item++)
+		{
+			const SceneObject &object = scene.objects[item->object];
+			if (item->object != currentObject)
+				shadowModel.set(object.transform);
+			currentObject = item->object;
+			object.model->DrawPart(shadowCubeMapShader, *item, object.transform, shadowLodView);
+		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-		glEnable(GL_DEPTH_TEST); // enable depth testing (is disabled for rendering screen-space quad)
-		glCullFace(GL_BACK);
+		glState.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glState.Apply(sceneDepth); // depth testing is disabled for rendering the screen-space quad
+		glState.Apply(sceneRaster);
 
 		// reset viewport
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+		glState.Viewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		view = glm::lookAt(myCamera.Position, myCamera.Position + myCamera.Front, myCamera.Up);
-		glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
+		lodView.viewProjection = projection * view;
+		glState.BindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
 		glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(view));
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glState.BindBuffer(GL_UNIFORM_BUFFER, 0);
 
 		lightingShader.use();
 		lightingShader.setVec3("objectColor", glm::vec3(1.0f));
@@ -491,17 +694,13 @@ int main()
 		//model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0, 1, 0));	
 		////model = glm::scale(model, glm::vec3(10.0f));
 		//lightingShader.setMat4("model", model);
-		//glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diff);
+		glState.BindTexture(0, GL_TEXTURE_2D, diff.id());
 		lightingShader.setInt("material.texture_diffuse", 0);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, diff);
+		glState.BindTexture(1, GL_TEXTURE_2D, diff.id());
 		lightingShader.setInt("material.texture_specular", 1);
-		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, norm);
+		glState.BindTexture(3, GL_TEXTURE_2D, norm.id());
 		lightingShader.setInt("material.texture_normal", 3);
-		glActiveTexture(GL_TEXTURE4);
-		glBindTexture(GL_TEXTURE_2D, depth);
+		glState.BindTexture(4, GL_TEXTURE_2D, depth.id());
 		lightingShader.setInt("material.texture_depth", 4);
 		lightingShader.setFloat("material.heightscale", heightScale); // adjust with Q and E keys
 
@@ -515,51 +714,60 @@ int main()
 		//lightingShader.setInt("shadowCubeMap", 5);
 		//renderCube();
 
-		model = glm::mat4(1.0f);
-		//model = glm::rotate(model, glm::radians(currentTime) * 5, glm::vec3(1, 1, 1));
-		model = glm::scale(model, glm::vec3(0.05f));
-		lightingShader.setMat4("model", model);
 		lightingShader.setVec3("cameraPos", myCamera.Position);
 		//lightingShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
 		//glActiveTexture(GL_TEXTURE4);
 		//glBindTexture(GL_TEXTURE_2D, shadowDepthMap);
 		//lightingShader.setInt("shadowMap", 4);
-		glActiveTexture(GL_TEXTURE5);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, shadowDepthCubemap);
+		glState.BindTexture(5, GL_TEXTURE_CUBE_MAP, shadowDepthCubemap);
 		lightingShader.setInt("shadowCubeMap", 5);
-		Zero.Draw(lightingShader);
-
-		colorShader.use();
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, lightPos);
-		model = glm::scale(model, glm::vec3(0.3f));
-		colorShader.setMat4("model", model);
-		colorShader.setVec3("color", lightColor);
-		//glActiveTexture(GL_TEXTURE0);
-		//glBindTexture(GL_TEXTURE_2D, shadowDepthMap);
-		//lightingShader.setInt("material.diffuse", 0);
-		//glActiveTexture(GL_TEXTURE1);	
-		//glBindTexture(GL_TEXTURE_2D, shadowDepthMap);
-		//lightingShader.setInt("material.specular", 1);
-		renderCube();
+		// the programs' uniforms were set above, each item only sets its object's transform
+		renderQueue.passRange(PASS_OPAQUE, first, last);
+		currentObject = NO_OBJECT;
+		for (const RenderItem *item = first; item != last; item++)
+		{
+			if (item->object == LIGHT_CUBE)
+			{
+				colorShader.use();
+				model = glm::mat4(1.0f);
+				model = glm::translate(model, lightPos);
+				model = glm::scale(model, glm::vec3(0.3f));
+				colorShader.setMat4("model", model);
+				colorShader.setVec3("color", lightColor);
+				renderCube();
+				continue;
+			}
+			const SceneObject &object = scene.objects[item->object];
+			if (item->object != currentObject)
+			{
+				// the light cube may have switched to colorShader, the model matrix has to go to lightingShader
+				lightingShader.use();
+				lightingModel.set(object.transform);
+			}
+			currentObject = item->object;
+			object.model->DrawPart(lightingShader, *item, object.transform, lodView);
+		}
 
 		// draw skybox as last
-		glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+		renderQueue.passRange(PASS_SKY, first, last);
+		for (const RenderItem *item = first; item != last; item++)
+		{
+			glState.Apply(skyboxDepth);
 
-		skyboxShader.use();
-		view = glm::mat4(glm::mat3(myCamera.GetViewMatrix()));
-		skyboxShader.setMat4("projection", projection);
-		skyboxShader.setMat4("view", view);
+			skyboxShader.use();
+			view = glm::mat4(glm::mat3(myCamera.GetViewMatrix()));
+			skyboxShader.setMat4("projection", projection);
+			skyboxShader.setMat4("view", view);
 
-		glBindVertexArray(skyboxVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-		glDepthFunc(GL_LESS); // set depth function back to default
+			glState.BindVertexArray(skyboxVAO);
+			glState.BindTexture(0, GL_TEXTURE_CUBE_MAP, skyboxTexture);
+			glDrawArrays(GL_TRIANGLES, 0, 36);
+		}
+		glState.Apply(sceneDepth);
 
 		// 2. now blit multisampled buffer(s) to normal colorbuffer of intermediate FBO. Image is stored in screenTexture
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
+		glState.BindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glState.BindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
 		for (size_t i = 0; i < 2; i++)
 		{
 			glReadBuffer(GL_COLOR_ATTACHMENT0 + i);
@@ -572,30 +780,28 @@ int main()
 		blurShader.use();
 		for (unsigned int i = 0; i < amount; i++)
 		{
-			glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
+			glState.BindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
 			blurShader.setInt("horizontal", horizontal);
-			glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingPongBuffer[!horizontal]);
+			glState.BindTexture(0, GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingPongBuffer[!horizontal]);
 			renderQuad();
 			horizontal = !horizontal;
 			if (first_iteration)
 				first_iteration = false;
 		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glDisable(GL_DEPTH_TEST); // disable depth test so screen-space quad isn't discarded due to depth test.
+		glState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+		glState.Apply(screenDepth);
 
 		// reset viewport
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+		glState.Viewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		// render render map to quad for visual 
 		// ---------------------------------------------
 		renderShader.use();
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, pingPongBuffer[0]);
+		glState.BindTexture(0, GL_TEXTURE_2D, pingPongBuffer[0]);
 		renderShader.setInt("scene", 0);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
+		glState.BindTexture(1, GL_TEXTURE_2D, colorBuffers[0]);
 		renderShader.setInt("bloomBlur", 1);
 		renderShader.setFloat("exposure", exposure);
 
@@ -612,6 +818,55 @@ int main()
 		{
 			ImGui::Begin("Stats");
 			ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+			ImGui::Text("First frame after %.0f ms (scene load %.0f ms, %s)", firstFrameMs, scene.LoadMs(), parallelLoad ? "parallel" : "sequential");
+			if (!Zero.IsLoaded())
+			{
+				size_t loaded, total;
+				Zero.LoadProgress(loaded, total);
+				ImGui::Text("Streaming model: %d / %d meshes", (int)loaded, (int)total);
+			}
+			if (TextureCache::Shared().PendingCount())
+				ImGui::Text("Streaming textures: %d left", (int)TextureCache::Shared().PendingCount());
+			const TextureUploadStats &uploads = TextureCache::Shared().UploadStats();
+			ImGui::Text("Texture uploads: %d, %.2f MB (%.2f MB staged) in %.3f ms, %.0f MB/s",
+				(int)uploads.textures, uploads.bytes / (1024.0 * 1024.0), uploads.stagedBytes / (1024.0 * 1024.0), uploads.ms, uploads.MBPerSecond());
+			ImGui::Text("Upload ring: %.1f / %.0f MB in flight (%s)", UploadRing::Shared().Used() / (1024.0 * 1024.0),
+				UploadRing::Shared().Capacity() / (1024.0 * 1024.0), UploadRing::Shared().Persistent() ? "persistent" : "mapped per upload");
+			size_t residentTextureBytes, requestedTextureBytes;
+			TextureCache::Shared().StreamingMemory(residentTextureBytes, requestedTextureBytes);
+			ImGui::Text("Texture VRAM: %.1f MB resident, %.1f MB requested (budget %.0f MB)", residentTextureBytes / (1024.0 * 1024.0),
+				requestedTextureBytes / (1024.0 * 1024.0), TextureCache::Shared().MemoryBudget() / (1024.0 * 1024.0));
+			size_t textureBytes, uncompressedBytes, compressedCount;
+			Zero.TextureMemory(textureBytes, uncompressedBytes, compressedCount);
+			ImGui::Text("Model textures: %.1f MB, %.1f MB saved by compression (%d compressed)",
+				textureBytes / (1024.0 * 1024.0), (uncompressedBytes - textureBytes) / (1024.0 * 1024.0), (int)compressedCount);
+			size_t submittedTriangles, fullTriangles;
+			Zero.DrawStats(submittedTriangles, fullTriangles);
+			ImGui::Checkbox("Mesh LOD", &lodView.enabled);
+			ImGui::Text("Triangles: %d submitted for %d instances, %d without LOD", (int)submittedTriangles, (int)scene.objects.size(), (int)fullTriangles);
+			size_t modelDraws;
+			double modelDrawMs;
+			Zero.DrawTime(modelDraws, modelDrawMs);
+			ImGui::Text("Model draw CPU: %.3f ms per call over %d calls", modelDraws ? modelDrawMs / modelDraws : 0.0, (int)modelDraws);
+			ImGui::Text("Render queue: %d items, queued and sorted in %.3f ms", (int)renderQueue.size(), sortMs);
+			if (ImGui::Checkbox("Multi-draw indirect", &multiDrawIndirect))
+				for (const std::unique_ptr<Model> &sceneModel : scene.models)
+					sceneModel->options.multiDrawIndirect = multiDrawIndirect;
+			ImGui::SameLine();
+			ImGui::Text(Model::IndirectSupported() ? "(GL 4.3)" : "(needs GL 4.3, drawing per mesh)");
+			size_t meshletsTested, meshletsCulled, meshletTriangles, meshletTrianglesCulled;
+			Zero.MeshletStats(meshletsTested, meshletsCulled, meshletTriangles, meshletTrianglesCulled);
+			ImGui::Checkbox("Meshlet culling", &lodView.cullMeshlets);
+			ImGui::Text("Meshlets: %d of %d culled, %.1f%% of their triangles rejected", (int)meshletsCulled, (int)meshletsTested,
+				meshletTriangles ? 100.0 * meshletTrianglesCulled / meshletTriangles : 0.0);
+			ImGui::Text("Uniforms: %d lookups by name, %d GL location queries last frame", (int)frameLookups.lookups, (int)frameLookups.glQueries);
+			ImGui::Text("GL state: %d calls issued, %d redundant ones dropped last frame", (int)frameState.issued, (int)frameState.elided);
+			ImGui::Text("Model vertex arrays: %d (%s)", (int)Zero.VertexArrayCount(), mergeBuffers ? "merged" : "per mesh");
+			size_t vertexBytes, indexBytes, wideVertexBytes, wideIndexBytes, shortIndexMeshes;
+			Zero.GeometryMemory(vertexBytes, indexBytes, wideVertexBytes, wideIndexBytes, shortIndexMeshes);
+			ImGui::Text("Model geometry: %.2f MB vertices, %.2f MB indices (%d of %d meshes 16 bit, %.2f MB saved)",
+				vertexBytes / (1024.0 * 1024.0), indexBytes / (1024.0 * 1024.0), (int)shortIndexMeshes, (int)Zero.meshes.size(),
+				(wideVertexBytes + wideIndexBytes - vertexBytes - indexBytes) / (1024.0 * 1024.0));
 			ImGui::End();
 		}
 
@@ -631,18 +886,26 @@ int main()
 
 		// swap the buffer
 		glfwSwapBuffers(window);
+		if (firstFrame)
+		{
+			firstFrame = false;
+			firstFrameMs = startupTimer.elapsedMs();
+			std::cout << "SCENE::FIRST_FRAME " << firstFrameMs << " ms after startup, scene load " << scene.LoadMs() << " ms ("
+				<< (parallelLoad ? "parallel" : "sequential") << ")" << std::endl;
+		}
 	}
 
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
 
-	glDeleteVertexArrays(1, &skyboxVAO);
-	glDeleteBuffers(1, &skyboxVBO);
-	glDeleteBuffers(1, &uboMatrices);
-	glDeleteBuffers(1, &intermediateFBO);
-	glDeleteBuffers(1, &framebuffer);
-	glDeleteBuffers(1, &spec);
+	glState.DeleteVertexArray(skyboxVAO);
+	glState.DeleteBuffer(skyboxVBO);
+	glState.DeleteBuffer(uboMatrices);
+	glState.DeleteFramebuffer(intermediateFBO);
+	glState.DeleteFramebuffer(framebuffer);
+	scene.Release();
+	TextureCache::Shared().ReleaseAll();
 	glfwTerminate();
 
 	return 0;
@@ -711,23 +974,22 @@ void renderCube()
 		glGenVertexArrays(1, &cubeVAO);
 		glGenBuffers(1, &cubeVBO);
 		// fill buffer
-		glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+		GLState::Shared().BindBuffer(GL_ARRAY_BUFFER, cubeVBO);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 		// link vertex attributes
-		glBindVertexArray(cubeVAO);
+		GLState::Shared().BindVertexArray(cubeVAO);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(1);
 		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
 		glEnableVertexAttribArray(2);
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindVertexArray(0);
+		GLState::Shared().BindBuffer(GL_ARRAY_BUFFER, 0);
+		GLState::Shared().BindVertexArray(0);
 	}
 	// render Cube
-	glBindVertexArray(cubeVAO);
+	GLState::Shared().BindVertexArray(cubeVAO);
 	glDrawArrays(GL_TRIANGLES, 0, 36);
-	glBindVertexArray(0);
 }
 
 // renderQuad() renders a 1x1 XY quad in NDC
@@ -748,8 +1010,8 @@ void renderQuad()
 		// setup plane VAO
 		glGenVertexArrays(1, &quadVAO);
 		glGenBuffers(1, &quadVBO);
-		glBindVertexArray(quadVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+		GLState::Shared().BindVertexArray(quadVAO);
+		GLState::Shared().BindBuffer(GL_ARRAY_BUFFER, quadVBO);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
@@ -758,9 +1020,8 @@ void renderQuad()
 		glEnableVertexAttribArray(3);
 		glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
 	}
-	glBindVertexArray(quadVAO);
+	GLState::Shared().BindVertexArray(quadVAO);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
 }
 
 void processInput(GLFWwindow* window)
@@ -837,85 +1098,13 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	glViewport(0, 0, width, height);
-}
-
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const * path, bool gammaCorrection)
-{
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum internalFormat;
-		GLenum dataFormat;
-		if (nrComponents == 1)
-		{
-			internalFormat = dataFormat = GL_RED;
-		}
-		else if (nrComponents == 3)
-		{
-			internalFormat = gammaCorrection ? GL_SRGB : GL_RGB;
-			dataFormat = GL_RGB;
-		}
-		else if (nrComponents == 4)
-		{
-			internalFormat = gammaCorrection ? GL_SRGB_ALPHA : GL_RGBA;
-			dataFormat = GL_RGBA;
-		}
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, dataFormat, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
-
-	return textureID;
+	GLState::Shared().Viewport(0, 0, width, height);
 }
 
-unsigned int loadCubemap(std::vector<std::string> faces)
+// the model's copies for --instances, a square grid starting at the origin
+glm::mat4 instanceTransform(int instance, int count)
 {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-	int width, height, nrChannels;
-	for (unsigned int i = 0; i < faces.size(); i++)
-	{
-		unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-		if (data)
-		{
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-				0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-			);
-			stbi_image_free(data);
-		}
-		else
-		{
-			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-			stbi_image_free(data);
-		}
-	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	return textureID;
+	int columns = (int)std::ceil(std::sqrt((float)count));
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3((instance % columns) * 5.0f, 0.0f, -(instance / columns) * 5.0f));
+	return glm::scale(model, glm::vec3(0.05f));
 }
\ No newline at end of file
@@ -327,9 +327,10 @@ void main()
 
 	// obtain normal from normal map in range [0,1]
     vec3 norm = normalize(texture(material.texture_normal, texCoords).rgb);
-    // transform normal vector to range [-1,1]
-	norm = texture(material.texture_normal, texCoords).rgb;
-	norm = normalize(norm * 2.0 - 1.0); 
+    // transform normal vector to range [-1,1], z is rebuilt from xy since compressed (BC5) normal maps only store two channels
+	norm.xy = texture(material.texture_normal, texCoords).rg * 2.0 - 1.0;
+	norm.z = sqrt(max(1.0 - dot(norm.xy, norm.xy), 0.0));
+	norm = normalize(norm); 
 
 	////transform normal from tangent to model space
 //	norm = normalize(fs_in.TBN * norm); 
@@ -1,9 +1,24 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 4) in uint aDrawRecord;
 
 uniform mat4 model;
 
+// PackedVertex meshes, see vertex.vert
+uniform bool quantized;
+uniform vec3 posScale;
+uniform vec3 posOffset;
+// Model's multi-draw indirect path, see vertex.vert
+uniform bool indirect;
+uniform samplerBuffer drawRecords;
+
 void main()
 {
-    gl_Position = model * vec4(aPos, 1.0);
+    vec3 position = quantized ? aPos * posScale + posOffset : aPos;
+    if (indirect)
+    {
+        vec4 first = texelFetch(drawRecords, int(aDrawRecord) * 3);
+        position = first.w > 0.5 ? aPos * first.xyz + texelFetch(drawRecords, int(aDrawRecord) * 3 + 1).xyz : aPos;
+    }
+    gl_Position = model * vec4(position, 1.0);
 }
\ No newline at end of file
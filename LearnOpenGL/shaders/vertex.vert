@@ -4,6 +4,7 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
+layout (location = 4) in uint aDrawRecord;
 
 struct DirLight 
 {
@@ -82,28 +83,74 @@ uniform mat4 lightSpaceMatrix;
 
 uniform vec3 cameraPos;
 
+// PackedVertex meshes: positions and texture coordinates are [0,1] within the mesh bounds,
+// normals and tangents octahedral encoded in .xy
+uniform bool quantized;
+uniform vec3 posScale;
+uniform vec3 posOffset;
+uniform vec2 uvScale;
+uniform vec2 uvOffset;
+
+// Model's multi-draw indirect path: the same per mesh, as three texels per draw record
+// (posScale, quantized) (posOffset, 0) (uvScale, uvOffset)
+uniform bool indirect;
+uniform samplerBuffer drawRecords;
+
+vec3 octDecode(vec2 e)
+{
+	vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (v.z < 0.0)
+		v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(v);
+}
+
 void main()
 {
+	vec3 position = aPos;
+	vec3 normal = aNormal;
+	vec3 tangent = aTangent;
+	vec2 texCoords = aTexCoords;
+	bool packed = quantized;
+	vec3 scale = posScale;
+	vec3 offset = posOffset;
+	vec4 uvTransform = vec4(uvScale, uvOffset);
+	if (indirect)
+	{
+		int record = int(aDrawRecord) * 3;
+		vec4 first = texelFetch(drawRecords, record);
+		packed = first.w > 0.5;
+		scale = first.xyz;
+		offset = texelFetch(drawRecords, record + 1).xyz;
+		uvTransform = texelFetch(drawRecords, record + 2);
+	}
+	if (packed)
+	{
+		position = aPos * scale + offset;
+		normal = octDecode(aNormal.xy);
+		tangent = octDecode(aTangent.xy);
+		texCoords = aTexCoords * uvTransform.xy + uvTransform.zw;
+	}
+
 	vs_lights_out.DirLight = dirLight;
 	vs_lights_out.SpotLight = spotLight;
 	vs_lights_out.PointLights = pointLights;
 	
 	vs_out.CameraPos = cameraPos;
 
-	vs_out.FragPosWorld = vec3(model * vec4(aPos, 1.0));
-	vs_out.NormalWorld = mat3(transpose(inverse(model))) * aNormal;
+	vs_out.FragPosWorld = vec3(model * vec4(position, 1.0));
+	vs_out.NormalWorld = mat3(transpose(inverse(model))) * normal;
 
-    vs_out.FragPosView = vec3(view * model * vec4(aPos, 1.0));
-    vs_out.NormalView = mat3(transpose(inverse(view * model))) * aNormal;
+    vs_out.FragPosView = vec3(view * model * vec4(position, 1.0));
+    vs_out.NormalView = mat3(transpose(inverse(view * model))) * normal;
 
-	vs_out.TexCoords = aTexCoords;
+	vs_out.TexCoords = texCoords;
 	vs_out.View = view;
 
 	mat3 normalMatrix = mat3(transpose(inverse(view * model)));
 	vs_out.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out.FragPosWorld, 1.0);
 
-	vec3 T = normalize(mat3(model) * aTangent);
-    vec3 N = normalize(mat3(model) * aNormal);
+	vec3 T = normalize(mat3(model) * tangent);
+    vec3 N = normalize(mat3(model) * normal);
 	T = normalize(T - dot(T, N) * N);
 	vec3 B = cross(N,T);
 	B =-B;
@@ -114,5 +161,5 @@ void main()
 	vs_out.TangentCameraPos  = transpose(TBN) * cameraPos;
 	vs_out.TangentFragPos  =  transpose(TBN) * vs_out.FragPosWorld;
 
-	gl_Position = projection * view * model * vec4(aPos, 1.0);  
+	gl_Position = projection * view * model * vec4(position, 1.0);  
 } 
\ No newline at end of file